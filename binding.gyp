@@ -5,7 +5,8 @@
             'target_name': 'session',
             'sources': [
                 './src/session/bindings.cpp',
-                './src/session/session.cpp'
+                './src/session/session.cpp',
+                './src/session/types/hierarchy-index.cpp'
             ],
             'include_dirs': [
                 './src/session', '/usr/include/jsoncpp'
@@ -19,3 +19,31 @@ TESTING_SHALLOW=true entwine build \
     -o \
         ellipsoid
 
+
+# Half of the data, and a copy of it with the other half appended in place,
+# for testing reloads of rewritten chunks.  Both take the bounds of the full
+# index so that their chunks line up.
+BOUNDS=$(node -e "console.log(JSON.stringify(JSON.parse(
+    require('fs').readFileSync('ellipsoid/entwine')).bounds))")
+
+TESTING_SHALLOW=true entwine build \
+    -i \
+        "https://s3.amazonaws.com/hobu-lidar/greyhound-test-data/ellipsoid/ned.laz" \
+        "https://s3.amazonaws.com/hobu-lidar/greyhound-test-data/ellipsoid/nwd.laz" \
+        "https://s3.amazonaws.com/hobu-lidar/greyhound-test-data/ellipsoid/sed.laz" \
+        "https://s3.amazonaws.com/hobu-lidar/greyhound-test-data/ellipsoid/swd.laz" \
+    -b "$BOUNDS" \
+    -o \
+        ellipsoid-half
+
+rm -rf ellipsoid-appended
+cp -r ellipsoid-half ellipsoid-appended
+
+TESTING_SHALLOW=true entwine build \
+    -i \
+        "https://s3.amazonaws.com/hobu-lidar/greyhound-test-data/ellipsoid/neu.laz" \
+        "https://s3.amazonaws.com/hobu-lidar/greyhound-test-data/ellipsoid/nwu.laz" \
+        "https://s3.amazonaws.com/hobu-lidar/greyhound-test-data/ellipsoid/seu.laz" \
+        "https://s3.amazonaws.com/hobu-lidar/greyhound-test-data/ellipsoid/swu.laz" \
+    -o \
+        ellipsoid-appended
@@ -11,6 +11,7 @@ var console = require('clim')(),
 
     Controller = require('./controller').Controller,
     HttpHandler = require('./interfaces/http').HttpHandler,
+    WsHandler = require('./interfaces/ws').WsHandler,
     usingDefaultConfig = false,
     configPath = (() => {
         if (argv.c) {
@@ -81,5 +82,10 @@ process.nextTick(function() {
 
         httpHandler.start();
     }
+
+    if (config.ws && config.ws.port) {
+        var wsHandler = new WsHandler(controller, config.ws.port);
+        wsHandler.start();
+    }
 });
 
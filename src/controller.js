@@ -4,6 +4,7 @@ var bytes = require('bytes'),
     Bindings = require('../build/' + buildDir + '/session'),
     Session = Bindings.Session,
     totalThreads = require('os').cpus().length,
+    path = require('path'),
     error = (code, message) => ({ code: code, message: message }),
 
     // resource name -> { session: session, accessed: Date }
@@ -36,6 +37,64 @@ clim(console, true);
         var arbiter = config.arbiter || { };
         var timeoutMs = Math.max(config.resourceTimeoutMinutes, 30) * 60 * 1000;
 
+        // Tile presets name their schema from the configured schemas, which
+        // are resolved here so that tiles match the node reads they answer.
+        var tiles = null;
+        if (config.tiles) {
+            var schemas = config.schemas || { };
+            var presets = config.tiles.presets || [{ schema: 'native' }];
+
+            tiles = {
+                path: path.resolve(config.tiles.path),
+                depths: config.tiles.depths,
+                presets: presets.map((p) => {
+                    var schema = p.schema || 'native';
+                    if (schema != 'native' && !schemas[schema]) {
+                        throw new Error('Unknown tile schema: ' + schema);
+                    }
+
+                    return {
+                        name: schema + (p.compress ? '-compressed' : ''),
+                        schema: schema == 'native' ? null : schemas[schema],
+                        compress: !!p.compress
+                    };
+                })
+            };
+        }
+
+        // The native HTTP server shares the response settings of the JS one.
+        // It has no auth, so it is not started if auth is configured.
+        var nativeHttp = null;
+        if (config.nativeHttp && config.nativeHttp.port) {
+            if (config.auth) {
+                console.log('Native HTTP disabled: auth is not supported');
+            }
+            else {
+                var httpConfig = config.http || { };
+                nativeHttp = {
+                    port: config.nativeHttp.port,
+                    threads: config.nativeHttp.threads,
+                    queue: config.nativeHttp.queue,
+                    timeout: config.nativeHttp.timeout,
+                    notFoundSeconds: config.nativeHttp.notFoundSeconds,
+                    headers: httpConfig.headers || { },
+                    nodeMaxAge: httpConfig.nodeMaxAge || 86400,
+                    schemas: config.schemas || { }
+                };
+            }
+        }
+
+        // Options consumed by the native bindings.
+        var options = {
+            snapshot: config.snapshot || null,
+            export: config.export || null,
+            tiles: tiles,
+            nativeHttp: nativeHttp,
+            hierarchy: config.hierarchy || { },
+            sessionMemory:
+                config.sessionMemory ? bytes('' + config.sessionMemory) : 0
+        };
+
         // We've limited the libuv threadpool size since each of those threads
         // may spawn its own child threads.
         console.log('Using:');
@@ -44,9 +103,24 @@ clim(console, true);
         console.log('\tCache size:', cacheSize, '(' + bytes(cacheSize) + ')');
         console.log('\tThreads identified:', totalThreads);
         console.log('\tUV pool size:', threads);
+        if (options.sessionMemory) {
+            console.log('\tSession memory:', bytes(options.sessionMemory));
+        }
+        if (options.snapshot) {
+            console.log('\tSnapshot path:', options.snapshot.path);
+        }
+        if (options.export) {
+            console.log('\tExport path:', options.export.path);
+        }
+        if (options.tiles) {
+            console.log('\tTile path:', options.tiles.path);
+        }
+        if (options.nativeHttp) {
+            console.log('\tNative HTTP port:', options.nativeHttp.port);
+        }
 
         process.env.UV_THREADPOOL_SIZE = threads;
-        Bindings.global(paths, cacheSize, arbiter);
+        Bindings.global(paths, cacheSize, arbiter, options);
 
         this.getSession = (name, cb) => {
             var session;
@@ -89,6 +163,10 @@ clim(console, true);
             Object.keys(resources).forEach((name) => {
                 if (now - resources[name].accessed > timeoutMs) {
                     console.log('Purging', name);
+
+                    // Free the native index now rather than whenever this
+                    // session happens to be garbage collected.
+                    resources[name].session.release();
                     delete resources[name];
                 }
             });
@@ -97,6 +175,11 @@ clim(console, true);
         setInterval(clean, timeoutMs);
     };
 
+    // Process-wide cache and pool counters.
+    Controller.prototype.stats = function() {
+        return Bindings.stats();
+    };
+
     Controller.prototype.info = function(resource, cb) {
         this.getSession(resource, function(err, session) {
             if (err) return cb(err);
@@ -118,6 +201,13 @@ clim(console, true);
         });
     }
 
+    Controller.prototype.hierarchyBatch = function(resource, query, cb) {
+        this.getSession(resource, (err, session) => {
+            if (err) cb(err);
+            else session.hierarchyBatch(query, cb);
+        });
+    };
+
     Controller.prototype.read = function(resource, query, cb) {
         this.getSession(resource, function(err, session) {
             if (err) return cb(err);
@@ -125,6 +215,62 @@ clim(console, true);
         });
     };
 
+    Controller.prototype.readBatch = function(resource, query, cb) {
+        this.getSession(resource, function(err, session) {
+            if (err) return cb(err);
+            else session.readBatch(query, cb);
+        });
+    };
+
+    Controller.prototype.readView = function(resource, query, cb) {
+        this.getSession(resource, function(err, session) {
+            if (err) return cb(err);
+            else session.readView(query, cb);
+        });
+    };
+
+    Controller.prototype.split = function(resource, query, cb) {
+        this.getSession(resource, (err, session) => {
+            if (err) cb(err);
+            else session.split(query, cb);
+        });
+    };
+
+    Controller.prototype.startExport = function(resource, query, cb) {
+        this.getSession(resource, (err, session) => {
+            if (err) cb(err);
+            else session.startExport(query, cb);
+        });
+    };
+
+    Controller.prototype.exportStatus = function(resource, id, cb) {
+        this.getSession(resource, (err, session) => {
+            if (err) cb(err);
+            else session.exportStatus({ id: id }, cb);
+        });
+    };
+
+    Controller.prototype.cancelExport = function(resource, id, cb) {
+        this.getSession(resource, (err, session) => {
+            if (err) cb(err);
+            else session.cancelExport({ id: id }, cb);
+        });
+    };
+
+    Controller.prototype.materialize = function(resource, cb) {
+        this.getSession(resource, (err, session) => {
+            if (err) cb(err);
+            else session.materialize({ }, cb);
+        });
+    };
+
+    Controller.prototype.reload = function(resource, cb) {
+        this.getSession(resource, (err, session) => {
+            if (err) cb(err);
+            else session.reload(cb);
+        });
+    };
+
     module.exports.Controller = Controller;
 })();
 
@@ -108,7 +108,11 @@ var colors = Object.keys(colorCodes).reduce((p, k) => {
             });
 
             var self = this;
-            app.use('/resource/:resource(*)/:call(info|read|hierarchy)',
+            var calls = [
+                'info', 'read', 'readBatch', 'readView', 'split', 'hierarchy',
+                'hierarchyBatch', 'reload', 'export', 'node', 'materialize'
+            ];
+            app.use('/resource/:resource(*)/:call(' + calls.join('|') + ')',
                     function(req, res, next)
             {
                 var id = req.cookies[self.config.auth.cookieName] || 'anon';
@@ -180,7 +184,10 @@ var colors = Object.keys(colorCodes).reduce((p, k) => {
                     //      ?param=true
                     if (v == 'true' || v == 'false') p[k] = v == 'true';
                     else {
-                        p[k] = JSON.parse(v);
+                        // Names, like schema presets, may be given unquoted:
+                        //      ?schema=rgb
+                        try { p[k] = JSON.parse(v); }
+                        catch (e) { p[k] = v; }
 
                         // We'll also accept the quoted strings 'true' and
                         // 'false' to be boolean:
@@ -195,6 +202,15 @@ var colors = Object.keys(colorCodes).reduce((p, k) => {
             next();
         });
 
+        // Internal counters, which name the resources in use, so these are
+        // only served if enabled.
+        if (this.config.stats) {
+            app.get('/stats', function(req, res) {
+                res.header('Cache-Control', 'no-cache');
+                res.json(controller.stats());
+            });
+        }
+
         app.get('/resource/:resource(*)/info', function(req, res, next) {
             var start = new Date();
 
@@ -267,11 +283,46 @@ var colors = Object.keys(colorCodes).reduce((p, k) => {
             });
         });
 
-        app.get('/resource/:resource(*)/read', function(req, res, next) {
+        // Describe the depths chosen for a point budget read.
+        var setSelection = (res, selection) => {
+            res.header('X-Greyhound-Depth-Begin', selection.depthBegin);
+            res.header('X-Greyhound-Depth-End', selection.depthEnd);
+
+            var exposed = [
+                'X-Greyhound-Depth-Begin', 'X-Greyhound-Depth-End'
+            ];
+
+            if (selection.partialDepth !== undefined) {
+                res.header(
+                        'X-Greyhound-Partial-Depth', selection.partialDepth);
+                exposed.push('X-Greyhound-Partial-Depth');
+            }
+
+            res.header('X-Greyhound-Points', selection.points);
+            exposed.push('X-Greyhound-Points');
+
+            res.header('Access-Control-Expose-Headers', exposed.join(', '));
+        };
+
+        var formatTypes = {
+            framed: 'application/vnd.greyhound.framed',
+            arrow: 'application/vnd.apache.arrow.stream',
+            las: 'application/vnd.las'
+        };
+
+        // Reads with large options, like an exclude set, may be sent as a
+        // POST with a JSON body.
+        var read = function(req, res, next) {
             // Terminate query on socket hangup.
             var stop = false;
 
-            var q = _.merge({ }, req.query);
+            var q = _.merge({ }, req.method == 'POST' ? req.body : req.query);
+
+            // Formats may also be requested by content negotiation.
+            var accept = req.get('Accept') || '';
+            var negotiated = Object.keys(formatTypes).find((f) =>
+                    accept.indexOf(formatTypes[f]) != -1);
+            if (!q.format && negotiated) q.format = negotiated;
 
             req.on('close', () => {
                 console.log('Socket closed - aborting read');
@@ -284,12 +335,22 @@ var colors = Object.keys(colorCodes).reduce((p, k) => {
 
             controller.read(
                 req.params.resource,
-                req.query,
-                (err, data, done) => {
+                q,
+                (err, data, done, selection) => {
                     if (err) return next(err);
 
                     if (first) {
-                        res.header('Content-Type', 'application/octet-stream');
+                        res.header(
+                                'Content-Type',
+                                formatTypes[q.format] ||
+                                    'application/octet-stream');
+                        if (q.format == 'las') {
+                            res.header(
+                                    'Content-Disposition',
+                                    'attachment; filename="' +
+                                        req.params.resource + '.las"');
+                        }
+                        if (selection) setSelection(res, selection);
                         first = false;
                     }
 
@@ -321,6 +382,211 @@ var colors = Object.keys(colorCodes).reduce((p, k) => {
                     return stop;
                 }
             );
+        };
+
+        app.get('/resource/:resource(*)/read', read);
+        app.post('/resource/:resource(*)/read', read);
+
+        // Reads of a single node, addressed by its key, with a schema chosen
+        // from the configured presets rather than given inline.  These URLs
+        // are stable and their responses carry strong ETags, so they may be
+        // served by shared caches.
+        var schemas = this.config.schemas || { };
+        var nodeMaxAge = this.httpConfig.nodeMaxAge || 86400;
+
+        app.get('/resource/:resource(*)/node/:key', function(req, res, next) {
+            var preset = req.query.schema || 'native';
+            var q = { node: req.params.key };
+
+            if (preset != 'native') {
+                if (!schemas[preset]) {
+                    return next({
+                        code: 400,
+                        message: 'Unknown schema preset: ' + preset
+                    });
+                }
+                q.schema = schemas[preset];
+            }
+
+            if (req.query.compress !== undefined) {
+                q.compress = req.query.compress === true;
+            }
+            if (req.query.format) q.format = req.query.format;
+
+            var held = req.get('If-None-Match');
+            if (held) q.ifNoneMatch = held.split(',')[0].trim()
+                .replace(/^W\//, '').replace(/"/g, '');
+
+            var stop = false;
+            req.on('close', () => stop = true);
+
+            var first = true;
+
+            controller.read(req.params.resource, q, (err, data, done, meta) => {
+                if (err) return next(err);
+
+                if (first) {
+                    first = false;
+                    res.header('ETag', '"' + meta.etag + '"');
+                    res.header(
+                            'Cache-Control',
+                            'public, max-age=' + nodeMaxAge);
+
+                    if (meta.notModified) {
+                        res.status(304).end();
+                        return true;
+                    }
+
+                    var type =
+                        formatTypes[q.format] || 'application/octet-stream';
+
+                    // Rendered tiles are sent straight from disk.
+                    if (meta.file) {
+                        res.header('Content-Type', type);
+                        res.sendFile(meta.file, {
+                            maxAge: nodeMaxAge * 1000,
+                            etag: false,
+                            lastModified: false
+                        }, (err) => { if (err && !stop) next(err); });
+                        return true;
+                    }
+
+                    res.header('Content-Type', type);
+                }
+
+                setImmediate(() => {
+                    if (!done) res.write(data);
+                    else res.end(data);
+                });
+
+                return stop;
+            });
+        });
+
+        // Framed reads, which may be sent as a GET or, for large queries, as a
+        // POST with a JSON body.
+        var framed = (call, describe) => function(req, res, next) {
+            var stop = false;
+            var q = req.method == 'POST' ? req.body : req.query;
+
+            req.on('close', () => {
+                console.log('Socket closed - aborting ' + call);
+                stop = true;
+            });
+
+            var start = new Date();
+            var size = 0;
+            var first = true;
+
+            controller[call](req.params.resource, q, (err, data, done) => {
+                if (err) return next(err);
+
+                if (first) {
+                    res.header('Content-Type', 'application/octet-stream');
+                    first = false;
+                }
+
+                size += data.length;
+
+                setImmediate(() => {
+                    if (!done) res.write(data);
+                    else {
+                        res.end(data);
+
+                        var end = new Date();
+                        console.log(
+                                req.params.resource + '/' +
+                                colors.cyan(call) + ':',
+                                colors.magenta(end - start), 'ms',
+                                'L:', bytes(size),
+                                describe(q));
+                    }
+                });
+
+                return stop;
+            });
+        };
+
+        var readBatch = framed('readBatch', (q) =>
+                'Q: ' + (q.queries || []).length);
+        var readView = framed('readView', (q) =>
+                'E: ' + JSON.stringify((q.view || { }).eye));
+
+        app.get('/resource/:resource(*)/readBatch', readBatch);
+        app.post('/resource/:resource(*)/readBatch', readBatch);
+        app.get('/resource/:resource(*)/readView', readView);
+        app.post('/resource/:resource(*)/readView', readView);
+
+        var split = function(req, res, next) {
+            var q = req.method == 'POST' ? req.body : req.query;
+
+            controller.split(req.params.resource, q, (err, data) => {
+                if (err) return next(err);
+                else return res.json(data);
+            });
+        };
+
+        app.get('/resource/:resource(*)/split', split);
+        app.post('/resource/:resource(*)/split', split);
+
+        // Exports run in the background, and are polled for their progress.
+        app.post('/resource/:resource(*)/export', function(req, res, next) {
+            var resource = req.params.resource;
+            var q = _.merge({ }, req.body, req.query);
+
+            controller.startExport(resource, q, (err, data) => {
+                if (err) return next(err);
+
+                console.log(
+                        resource + '/' + colors.green('export') + ':',
+                        data.id, 'T:', data.tiles);
+
+                res.header('Cache-Control', 'no-cache');
+                return res.status(202).json(data);
+            });
+        });
+
+        app.get('/resource/:resource(*)/export/:id', function(req, res, next) {
+            var resource = req.params.resource;
+
+            controller.exportStatus(resource, req.params.id, (err, data) => {
+                if (err) return next(err);
+
+                res.header('Cache-Control', 'no-cache');
+                return res.json(data);
+            });
+        });
+
+        app.delete('/resource/:resource(*)/export/:id',
+                function(req, res, next)
+        {
+            var resource = req.params.resource;
+
+            controller.cancelExport(resource, req.params.id, (err, data) => {
+                if (err) return next(err);
+
+                res.header('Cache-Control', 'no-cache');
+                return res.json(data);
+            });
+        });
+
+        // Renders the static tiles of a resource in the background.  Progress
+        // is polled, and the render cancelled, like an export.
+        app.post('/resource/:resource(*)/materialize',
+                function(req, res, next)
+        {
+            var resource = req.params.resource;
+
+            controller.materialize(resource, (err, data) => {
+                if (err) return next(err);
+
+                console.log(
+                        resource + '/' + colors.green('materialize') + ':',
+                        data.id, 'T:', data.tiles);
+
+                res.header('Cache-Control', 'no-cache');
+                return res.status(202).json(data);
+            });
         });
 
         app.get('/resource/:resource(*)/hierarchy', function(req, res, next) {
@@ -354,6 +620,47 @@ var colors = Object.keys(colorCodes).reduce((p, k) => {
             });
         });
 
+        app.post('/resource/:resource(*)/reload', function(req, res, next) {
+            var start = new Date();
+
+            controller.reload(req.params.resource, (err, data) => {
+                if (err) return next(err);
+
+                var end = new Date();
+                console.log(
+                        req.params.resource + '/' +
+                        colors.blue('reload') + ':',
+                        colors.magenta(end - start), 'ms',
+                        'V:', data.version,
+                        data.reloaded ? '(reloaded)' : '(unchanged)');
+
+                res.header('Cache-Control', 'no-cache');
+                return res.json(data);
+            });
+        });
+
+        var hierarchyBatch = function(req, res, next) {
+            var resource = req.params.resource;
+            var q = req.method == 'POST' ? req.body : req.query;
+            var start = new Date();
+
+            controller.hierarchyBatch(resource, q, (err, data) => {
+                if (err) return next(err);
+
+                var end = new Date();
+                console.log(
+                        resource + '/' +
+                        colors.yellow('hierBatch') + ':',
+                        colors.magenta(end - start), 'ms',
+                        'Q:', (q.queries || []).length);
+
+                return res.json(data);
+            });
+        };
+
+        app.get('/resource/:resource(*)/hierarchyBatch', hierarchyBatch);
+        app.post('/resource/:resource(*)/hierarchyBatch', hierarchyBatch);
+
         app.use(function(err, req, res, next) {
             console.log('Error handling:', err);
             res.header('Cache-Control', 'public, max-age=10');
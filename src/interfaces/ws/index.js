@@ -0,0 +1,173 @@
+var console = require('clim')(),
+    WebSocket = require('ws');
+
+(function() {
+    'use strict';
+
+    // Calls whose responses are streamed as binary frames, and calls whose
+    // responses are a single JSON message.
+    var streamed = ['read', 'readBatch', 'readView'];
+    var single = ['hierarchy', 'hierarchyBatch', 'split'];
+
+    // Each binary message is a frame of a single query, beginning with three
+    // 32-bit little-endian unsigned integers: the query id, a flags field,
+    // and the number of bytes that follow - as for readBatch.
+    var lastFlag = 1;
+
+    var frame = (id, done, data) => {
+        var header = new Buffer(12);
+        header.writeUInt32LE(id, 0);
+        header.writeUInt32LE(done ? lastFlag : 0, 4);
+        header.writeUInt32LE(data.length, 8);
+        return Buffer.concat([header, data]);
+    };
+
+    var WsHandler = function(controller, port) {
+        this.controller = controller;
+        this.port = port;
+        this.config = this.controller.config;
+        this.wsConfig = this.config.ws || { };
+
+        // The number of bytes of a query that may be sent before the client
+        // acknowledges them, after which the query is paused.
+        this.window = this.wsConfig.window || 8 * 1024 * 1024;
+    }
+
+    WsHandler.prototype.start = function() {
+        if (this.config.auth) {
+            console.log('WebSocket server disabled: auth is not supported');
+            return;
+        }
+
+        var server = new WebSocket.Server({ port: this.port });
+        server.on('connection', (socket) => this.connect(socket));
+        console.log('WebSocket server running on port', this.port);
+    }
+
+    // Many queries are multiplexed over each connection, identified by ids
+    // chosen by the client.  Each is started, cancelled, and acknowledged
+    // independently by JSON messages:
+    //      { "id": 1, "call": "read", "resource": "...", "query": { ... } }
+    //      { "id": 1, "cancel": true }
+    //      { "id": 1, "ack": <bytes> }
+    WsHandler.prototype.connect = function(socket) {
+        var self = this;
+        var controller = this.controller;
+
+        // id -> { stopped, unacked, resume }
+        var queries = { };
+
+        var send = (message, binary) => {
+            if (socket.readyState != WebSocket.OPEN) return;
+            if (binary) socket.send(message, { binary: true });
+            else socket.send(JSON.stringify(message));
+        };
+
+        var fail = (id, err) => send({
+            id: id,
+            code: err.code || 500,
+            error: err.message || 'Unknown error'
+        });
+
+        // Stops the native query at its next chunk, or immediately if it is
+        // paused awaiting an acknowledgement.
+        var cancel = (id) => {
+            var q = queries[id];
+            if (!q) return;
+
+            delete queries[id];
+            q.stopped = true;
+
+            if (q.resume) {
+                var resume = q.resume;
+                q.resume = null;
+                resume(true);
+            }
+        };
+
+        var ack = (id, bytes) => {
+            var q = queries[id];
+            if (!q) return;
+
+            q.unacked = Math.max(q.unacked - bytes, 0);
+
+            if (q.resume && q.unacked < self.window) {
+                var resume = q.resume;
+                q.resume = null;
+                resume(false);
+            }
+        };
+
+        var start = (id, call, resource, query) => {
+            if (queries[id]) {
+                return fail(id, { code: 400, message: 'Duplicate query id' });
+            }
+
+            if (call == 'info') {
+                return controller.info(resource, (err, data) => {
+                    if (err) fail(id, err);
+                    else send({ id: id, result: data });
+                });
+            }
+
+            if (single.indexOf(call) != -1) {
+                return controller[call](resource, query, (err, data) => {
+                    if (err) fail(id, err);
+                    else send({ id: id, result: data });
+                });
+            }
+
+            if (streamed.indexOf(call) == -1) {
+                return fail(id, { code: 400, message: 'Invalid call' });
+            }
+
+            var q = queries[id] = { stopped: false, unacked: 0, resume: null };
+
+            controller[call](resource, query, (err, data, done, meta) => {
+                if (q.stopped) return true;
+
+                if (err) {
+                    delete queries[id];
+                    fail(id, err);
+                    return true;
+                }
+
+                if (meta) send({ id: id, meta: meta });
+                send(frame(id, done, data), true);
+
+                if (done) {
+                    delete queries[id];
+                    return false;
+                }
+
+                q.unacked += data.length;
+                if (q.unacked < self.window) return false;
+
+                // Hold the native query until the client catches up.
+                return (resume) => q.resume = resume;
+            });
+        };
+
+        socket.on('message', (message) => {
+            var m;
+            try { m = JSON.parse(message); }
+            catch (e) { return fail(null, { code: 400, message: 'Bad JSON' }); }
+
+            var id = m.id;
+            if (id !== (id >>> 0)) {
+                return fail(id, { code: 400, message: 'Invalid query id' });
+            }
+
+            if (m.cancel) {
+                cancel(id);
+                send({ id: id, cancelled: true });
+            }
+            else if (m.ack) ack(id, m.ack);
+            else start(id, m.call, m.resource, m.query || { });
+        });
+
+        socket.on('close', () => Object.keys(queries).forEach(cancel));
+    }
+
+    module.exports.WsHandler = WsHandler
+})();
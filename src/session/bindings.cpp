@@ -1,6 +1,5 @@
 #include "bindings.hpp"
 
-#include <thread>
 #include <sstream>
 
 #include <execinfo.h>
@@ -23,11 +22,27 @@
 #include <entwine/util/unique.hpp>
 
 #include "session.hpp"
+#include "types/chunk-caches.hpp"
+#include "types/exports.hpp"
+#include "types/hierarchy-cache.hpp"
+#include "types/hierarchy-index.hpp"
+#include "types/http-server.hpp"
+#include "types/session-registry.hpp"
+#include "types/snapshot.hpp"
+#include "types/thread-pool.hpp"
+#include "types/tiles.hpp"
 #include "commands/create.hpp"
+#include "commands/export.hpp"
 #include "commands/info.hpp"
+#include "commands/materialize.hpp"
 #include "commands/files.hpp"
 #include "commands/hierarchy.hpp"
+#include "commands/hierarchy-batch.hpp"
 #include "commands/read.hpp"
+#include "commands/read-batch.hpp"
+#include "commands/read-view.hpp"
+#include "commands/reload.hpp"
+#include "commands/split.hpp"
 
 using namespace v8;
 
@@ -37,7 +52,52 @@ namespace
 
     std::vector<std::string> paths;
     entwine::OuterScope outerScope;
-    std::unique_ptr<entwine::Cache> cache;
+    std::unique_ptr<ChunkCaches> caches;
+    std::unique_ptr<SnapshotStore> snapshots;
+    std::unique_ptr<HierarchyCache> hierarchyCache;
+    std::unique_ptr<ThreadPool> hierarchyPool;
+    HierarchyOptions hierarchyOptions;
+    HierarchyIndexStats hierarchyIndexStats;
+    std::unique_ptr<SessionRegistry> registry;
+    std::unique_ptr<Exports> exportJobs;
+    std::unique_ptr<TileStore> tileStore;
+    std::unique_ptr<HttpServer> httpServer;
+
+    // Sessions are shared between the wrappers of a resource and the native
+    // HTTP server, so that each resource opens its index once.
+    std::mutex sessionsMutex;
+    std::map<std::string, std::weak_ptr<Session>> sessions;
+
+    std::shared_ptr<Session> sessionFor(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(sessionsMutex);
+
+        std::shared_ptr<Session> session(sessions[name].lock());
+
+        if (!session)
+        {
+            // Entries for sessions which no longer exist, like those of names
+            // which failed to resolve, are dropped as new sessions are made.
+            auto it(sessions.begin());
+            while (it != sessions.end())
+            {
+                if (it->second.expired()) it = sessions.erase(it);
+                else ++it;
+            }
+
+            session = std::make_shared<Session>(
+                    name,
+                    paths,
+                    outerScope,
+                    *caches,
+                    snapshots.get(),
+                    hierarchyOptions);
+
+            sessions[name] = session;
+        }
+
+        return session;
+    }
 }
 
 struct CRYPTO_dynlock_value
@@ -48,7 +108,7 @@ struct CRYPTO_dynlock_value
 Persistent<Function> Bindings::constructor;
 
 Bindings::Bindings(std::string name)
-    : m_session(entwine::makeUnique<Session>(name, paths, outerScope, *cache))
+    : m_session(sessionFor(name))
 { }
 
 Bindings::~Bindings()
@@ -65,13 +125,24 @@ void Bindings::init(v8::Handle<v8::Object> exports)
     tpl->InstanceTemplate()->SetInternalFieldCount(1);
 
     NODE_SET_METHOD(exports, "global", global);
+    NODE_SET_METHOD(exports, "stats", stats);
 
     NODE_SET_PROTOTYPE_METHOD(tpl, "construct", construct);
     NODE_SET_PROTOTYPE_METHOD(tpl, "create",    create);
     NODE_SET_PROTOTYPE_METHOD(tpl, "info",      info);
     NODE_SET_PROTOTYPE_METHOD(tpl, "files",     files);
     NODE_SET_PROTOTYPE_METHOD(tpl, "read",      read);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "readBatch", readBatch);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "readView",  readView);
     NODE_SET_PROTOTYPE_METHOD(tpl, "hierarchy", hierarchy);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "hierarchyBatch", hierarchyBatch);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "reload",    reload);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "release",   release);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "split",     split);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "startExport", startExport);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "exportStatus", exportStatus);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "cancelExport", cancelExport);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "materialize", materialize);
 
     constructor.Reset(isolate, tpl->GetFunction());
     exports->Set(toJs(isolate, "Session"), tpl->GetFunction());
@@ -105,7 +176,7 @@ void Bindings::global(const Args& args)
         Isolate* isolate(args.GetIsolate());
         HandleScope scope(isolate);
 
-        if (args.Length() != 3)
+        if (args.Length() != 4)
         {
             throw std::runtime_error("Wrong number of arguments to global");
         }
@@ -114,21 +185,121 @@ void Bindings::global(const Args& args)
         const auto& pathsArg(args[i++]);
         const auto& cacheSizeArg(args[i++]);
         const auto& arbiterArg(args[i++]);
+        const auto& optionsArg(args[i++]);
+
+        const Json::Value options(toJson(isolate, optionsArg));
 
         paths = entwine::extract<std::string>(toJson(isolate, pathsArg));
 
         const std::size_t cacheSize(toJson(isolate, cacheSizeArg).asUInt64());
         isolate->AdjustAmountOfExternalAllocatedMemory(cacheSize);
-        cache = entwine::makeUnique<entwine::Cache>(cacheSize);
+
+        // Hierarchy results are carved out of the same budget as data chunks.
+        // They are only cached in front of each reader, which holds its own
+        // hierarchy, so they are off unless configured.
+        const Json::Value& hierarchyConfig(options["hierarchy"]);
+        const double hierarchyRatio(
+                hierarchyConfig.isMember("cacheRatio") ?
+                    hierarchyConfig["cacheRatio"].asDouble() : 0);
+
+        if (hierarchyRatio < 0 || hierarchyRatio >= 1)
+        {
+            throw std::runtime_error("Invalid hierarchy.cacheRatio");
+        }
+
+        const std::size_t hierarchyBytes(cacheSize * hierarchyRatio);
+
+        if (hierarchyBytes)
+        {
+            hierarchyCache =
+                entwine::makeUnique<HierarchyCache>(hierarchyBytes);
+        }
+
+        caches = entwine::makeUnique<ChunkCaches>(cacheSize - hierarchyBytes);
+
+        // Parallel hierarchy threads compete with the libuv pool for the
+        // same cores and chunk fetches, so they are off unless configured.
+        const std::size_t hierarchyThreads(
+                hierarchyConfig["threads"].asUInt64());
+
+        if (hierarchyThreads > 1)
+        {
+            hierarchyPool = entwine::makeUnique<ThreadPool>(hierarchyThreads);
+        }
+
+        hierarchyOptions.cache = hierarchyCache.get();
+        hierarchyOptions.pool = hierarchyPool.get();
+        hierarchyOptions.indexDepth =
+            hierarchyConfig.isMember("indexDepth") ?
+                hierarchyConfig["indexDepth"].asUInt64() : 0;
+        hierarchyOptions.indexStats = &hierarchyIndexStats;
+        hierarchyOptions.parallelDepth =
+            hierarchyConfig.isMember("parallelDepth") ?
+                hierarchyConfig["parallelDepth"].asUInt64() : 6;
 
         outerScope.getArbiter(toJson(isolate, arbiterArg));
 
+        if (options["snapshot"].isObject())
+        {
+            snapshots = entwine::makeUnique<SnapshotStore>(
+                    options["snapshot"]);
+        }
+
+        if (options["tiles"].isObject())
+        {
+            tileStore = entwine::makeUnique<TileStore>(options["tiles"]);
+        }
+
+        // Tiles are rendered by background jobs, even without an export path.
+        if (options["export"].isObject() || tileStore)
+        {
+            exportJobs = entwine::makeUnique<Exports>(options["export"]);
+        }
+
+        registry = entwine::makeUnique<SessionRegistry>(
+                options["sessionMemory"].asUInt64());
+
+        if (options["nativeHttp"].isObject())
+        {
+            httpServer = entwine::makeUnique<HttpServer>(
+                    options["nativeHttp"],
+                    [](const std::string& name)
+                    {
+                        std::shared_ptr<Session> session(sessionFor(name));
+                        if (!session->initialize()) session.reset();
+                        else Bindings::touch(session);
+                        return session;
+                    },
+                    tileStore.get());
+        }
+
         entwine::stackTraceOn(SIGSEGV);
         entwine::stackTraceOn(SIGBUS);
         curl_global_init(CURL_GLOBAL_ALL);
     });
 }
 
+void Bindings::stats(const Args& args)
+{
+    Isolate* isolate(args.GetIsolate());
+    HandleScope scope(isolate);
+
+    Json::Value json(Json::objectValue);
+
+    if (registry) json["sessions"] = registry->stats();
+    if (caches) json["chunkCache"] = caches->stats();
+    if (hierarchyCache) json["hierarchyCache"] = hierarchyCache->stats();
+    if (exportJobs) json["exports"] = exportJobs->stats();
+    if (httpServer) json["nativeHttp"] = httpServer->stats();
+
+    if (hierarchyOptions.indexDepth)
+    {
+        json["hierarchyIndex"] = hierarchyIndexStats.toJson();
+    }
+
+    args.GetReturnValue().Set(toJs(isolate, json));
+}
+
 void Bindings::create(const Args& args)
 {
     Commander::run<command::Create>(args);
@@ -149,13 +320,85 @@ void Bindings::hierarchy(const Args& args)
     Commander::run<command::Hierarchy>(args);
 }
 
+void Bindings::hierarchyBatch(const Args& args)
+{
+    Commander::run<command::HierarchyBatch>(args);
+}
+
 void Bindings::read(const Args& args)
 {
     Commander::loop<command::Read>(args);
     // Commander::run<command::ReadSingle>(args);
 }
 
-Session& Bindings::session() { return *m_session; }
+void Bindings::readBatch(const Args& args)
+{
+    Commander::loop<command::ReadBatch>(args);
+}
+
+void Bindings::readView(const Args& args)
+{
+    Commander::loop<command::ReadView>(args);
+}
+
+void Bindings::reload(const Args& args)
+{
+    Commander::run<command::Reload>(args);
+}
+
+void Bindings::split(const Args& args)
+{
+    Commander::run<command::Split>(args);
+}
+
+void Bindings::startExport(const Args& args)
+{
+    Commander::run<command::StartExport>(args);
+}
+
+void Bindings::exportStatus(const Args& args)
+{
+    Commander::run<command::ExportStatus>(args);
+}
+
+void Bindings::cancelExport(const Args& args)
+{
+    Commander::run<command::CancelExport>(args);
+}
+
+void Bindings::materialize(const Args& args)
+{
+    Commander::run<command::Materialize>(args);
+}
+
+void Bindings::release(const Args& args)
+{
+    Isolate* isolate(args.GetIsolate());
+    HandleScope scope(isolate);
+
+    Bindings* bindings(ObjectWrap::Unwrap<Bindings>(args.Holder()));
+
+    if (registry) registry->release(*bindings->m_session);
+    else bindings->m_session->release();
+}
+
+void Bindings::touch(const std::shared_ptr<Session>& session)
+{
+    if (registry) registry->touch(session);
+}
+
+Exports& Bindings::exports()
+{
+    if (!exportJobs) throw std::runtime_error("Exports are not configured");
+    return *exportJobs;
+}
+
+const TileStore* Bindings::tiles()
+{
+    return tileStore.get();
+}
+
+std::shared_ptr<Session> Bindings::session() { return m_session; }
 
 //////////////////////////////////////////////////////////////////////////////
 
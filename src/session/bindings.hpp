@@ -10,13 +10,25 @@
 
 class Session;
 class BufferPool;
+class Exports;
+class TileStore;
 
 class Bindings : public node::ObjectWrap
 {
 public:
     static void init(v8::Handle<v8::Object> exports);
 
-    Session& session();
+    std::shared_ptr<Session> session();
+
+    // Mark a session as recently used, which may release the indexes of
+    // other sessions if the session memory budget is exceeded.
+    static void touch(const std::shared_ptr<Session>& session);
+
+    // Throws if exports are not configured.
+    static Exports& exports();
+
+    // Null if static tiles are not configured.
+    static const TileStore* tiles();
 
 private:
     Bindings(std::string name);
@@ -28,12 +40,25 @@ private:
 
     static void global(const Args& args);
 
+    // Counters of the process-wide caches and pools, for monitoring.
+    static void stats(const Args& args);
+
     static void create(const Args& args);
     static void info(const Args& args);
     static void read(const Args& args);
+    static void readBatch(const Args& args);
+    static void readView(const Args& args);
     static void hierarchy(const Args& args);
+    static void hierarchyBatch(const Args& args);
     static void files(const Args& args);
+    static void reload(const Args& args);
+    static void split(const Args& args);
+    static void startExport(const Args& args);
+    static void exportStatus(const Args& args);
+    static void cancelExport(const Args& args);
+    static void materialize(const Args& args);
+    static void release(const Args& args);
 
-    std::unique_ptr<Session> m_session;
+    std::shared_ptr<Session> m_session;
 };
 
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <type_traits>
+#include <vector>
 
 #include <node.h>
 #include <node_object_wrap.h>
@@ -16,6 +18,8 @@
 #include "bindings.hpp"
 #include "session.hpp"
 #include "commands/status.hpp"
+#include "types/boxes.hpp"
+#include "types/cursor.hpp"
 #include "types/js.hpp"
 
 class Command
@@ -29,10 +33,13 @@ public:
         , m_scope(m_isolate)
         , m_cb(getCallback(args))
         , m_bindings(*node::ObjectWrap::Unwrap<Bindings>(args.Holder()))
-        , m_session(m_bindings.session())
+        , m_sessionPtr(m_bindings.session())
+        , m_session(*m_sessionPtr)
+        , m_arena(1024)
+        , m_status(&m_arena)
         , m_json(args.Length() > 1 ?
                 toJson(m_isolate, args[0]) : Json::nullValue)
-        , m_bounds(entwine::maybeCreate<entwine::Bounds>(m_json["bounds"]))
+        , m_bounds(boxes::create(m_json["bounds"]))
         , m_scale(entwine::maybeCreate<entwine::Scale>(m_json["scale"]))
         , m_offset(entwine::maybeCreate<entwine::Offset>(m_json["offset"]))
         , m_depthBegin(
@@ -55,13 +62,45 @@ public:
 
     virtual ~Command() { }
 
+protected:
+    // Only reads support a "bounds" option of multiple boxes.
+    void requireSingleBounds() const
+    {
+        if (boxes::isMulti(m_json["bounds"]))
+        {
+            throw std::runtime_error("Multiple bounds are only valid for read");
+        }
+    }
+
+    // The cells into which a resumable read of this query is split.  This
+    // opens the index, so it must be called from a worker thread.
+    std::vector<entwine::Bounds> cursorCells() const
+    {
+        const entwine::Bounds cubic(
+                m_session.bounds(m_scale.get(), m_offset.get()));
+        const Json::Value info(m_session.info());
+
+        std::vector<entwine::Bounds> cells(Cursor::cells(
+                cubic,
+                m_bounds ? *m_bounds : cubic,
+                info["baseDepth"].asUInt64(),
+                info["type"].asString() == "octree"));
+
+        boxes::prune(cells, m_json["bounds"]);
+        return cells;
+    }
+
+    uint64_t cursorFingerprint() const
+    {
+        return Cursor::fingerprintOf(m_json, m_session.version());
+    }
+
 protected:
     virtual void work() = 0;
 
     virtual void run() noexcept
     {
-        const Status current(Status::safe([this]() { work(); }));
-        if (!current.ok()) m_status = current;
+        m_status.safely([this]() { work(); });
     }
 
     Status& status() { return m_status; }
@@ -74,9 +113,17 @@ protected:
     v8::UniquePersistent<v8::Function> m_cb;
 
     Bindings& m_bindings;
+
+    // Keeps the session alive for the duration of this command, even if its
+    // wrapper is collected.
+    const std::shared_ptr<Session> m_sessionPtr;
     Session& m_session;
 
+    // Backs the callback arguments in m_status, which are replaced for each
+    // send of a looping command.
+    Arena m_arena;
     Status m_status;
+
     const Json::Value m_json;
 
     // These are pretty common across multiple commands, so they'll be
@@ -95,6 +142,7 @@ class Loopable : public Command
 public:
     Loopable(const Args& args)
         : Command(args)
+        , m_stop(false)
     { }
 
     void initAsync()
@@ -111,7 +159,14 @@ public:
             try
             {
                 const auto s(loopable->status().call(isolate, loopable->cb()));
-                if (toJson(isolate, s).asBool()) loopable->stop();
+
+                if (s->IsFunction())
+                {
+                    // The worker is released until the callback resumes this
+                    // loopable.
+                    loopable->pause(isolate, v8::Local<v8::Function>::Cast(s));
+                }
+                else if (toJson(isolate, s).asBool()) loopable->stop();
             }
             catch (std::exception& e)
             {
@@ -129,18 +184,30 @@ public:
 
     uv_async_t* async() { return m_async.get(); }
 
+    // Queues the loop of this loopable on the libuv pool, which owns it from
+    // here on.  Must be called from the main loop.
+    void queue()
+    {
+        uv_work_t* req(new uv_work_t());
+        req->data = this;
+        uv_queue_work(uv_default_loop(), req, iterate, after);
+    }
+
 protected:
     virtual bool done() const
     {
         return !m_status.ok() || m_stop;
     }
 
-    void send()
+    // Returns false if the callback paused this loopable, in which case the
+    // worker must be released.
+    bool send()
     {
         std::unique_lock<std::mutex> lock(m_mutex);
         m_wait = true;
         uv_async_send(async());
         m_cv.wait(lock, [this]()->bool { return !m_wait; });
+        return !m_paused;
     }
 
     void sent()
@@ -153,10 +220,119 @@ protected:
     void stop() { m_stop = true; }
     bool stopped() const { return m_stop; }
 
+    // A callback may return a function rather than a boolean, to apply flow
+    // control to a query.  That function is called with a "resume" function,
+    // and no more data is produced until "resume" is called - with true to
+    // stop the query, or false to continue it.  Only the first call to
+    // "resume" has any effect.
+    //
+    // A paused loopable holds no worker, so that a slow client can't starve
+    // the libuv pool.  Its loop is queued again once it is resumed.
+    void pause(v8::Isolate* isolate, v8::Local<v8::Function> paused)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_paused = true;
+        }
+
+        v8::Local<v8::ObjectTemplate> tpl(v8::ObjectTemplate::New(isolate));
+        tpl->SetInternalFieldCount(1);
+
+        v8::Local<v8::Object> handle(tpl->NewInstance());
+        handle->SetAlignedPointerInInternalField(0, this);
+
+        Arg argv[] = { v8::Function::New(isolate, resume, handle) };
+        paused->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+    }
+
+    static void resume(const Args& args)
+    {
+        v8::Local<v8::Object> handle(v8::Local<v8::Object>::Cast(args.Data()));
+
+        // Once resumed, this loopable may complete and be destroyed, so the
+        // handle must not be followed again.
+        Loopable* loopable(
+                static_cast<Loopable*>(
+                    handle->GetAlignedPointerFromInternalField(0)));
+
+        if (!loopable) return;
+        handle->SetAlignedPointerInInternalField(0, nullptr);
+
+        if (args.Length() && args[0]->BooleanValue()) loopable->stop();
+
+        {
+            std::lock_guard<std::mutex> lock(loopable->m_mutex);
+            loopable->m_paused = false;
+        }
+
+        // If the worker has not yet been released, then its completion will
+        // queue the loop again instead.
+        if (loopable->m_parked)
+        {
+            loopable->m_parked = false;
+            loopable->queue();
+        }
+    }
+
+    bool paused()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_paused;
+    }
+
+    // Runs on a worker until this loopable is done or paused.  A loopable
+    // that was stopped while paused is queued once more, and completes here
+    // without producing anything further.
+    static void iterate(uv_work_t* req) noexcept
+    {
+        Loopable* loopable(static_cast<Loopable*>(req->data));
+
+        while (!loopable->done())
+        {
+            loopable->run();
+            if (!loopable->send()) return;
+        }
+    }
+
+    static void after(uv_work_t* req, int status)
+    {
+        v8::Isolate* isolate(v8::Isolate::GetCurrent());
+        v8::HandleScope scope(isolate);
+
+        std::unique_ptr<uv_work_t> work(req);
+        Loopable* loopable(static_cast<Loopable*>(req->data));
+
+        Bindings::touch(loopable->m_sessionPtr);
+
+        // Left to be queued again by "resume".
+        if (loopable->paused())
+        {
+            loopable->m_parked = true;
+            return;
+        }
+
+        // Resumed before the worker was released.
+        if (!loopable->done()) return loopable->queue();
+
+        std::unique_ptr<Loopable> owned(loopable);
+
+        if (owned->stopped())
+        {
+            std::cout << "Read command was stopped" << std::endl;
+        }
+    }
+
     std::mutex m_mutex;
     std::condition_variable m_cv;
     bool m_wait = false;
-    bool m_stop = false;
+    std::atomic<bool> m_stop;
+
+    // Set while a callback holds this loopable paused.
+    bool m_paused = false;
+
+    // Set while paused with no worker, until "resume" queues it again.  Only
+    // accessed from the main loop.
+    bool m_parked = false;
 
     struct AsyncDeleter
     {
@@ -202,6 +378,7 @@ public:
                     std::unique_ptr<Command> command(
                             static_cast<Command*>(req->data));
 
+                    Bindings::touch(command->m_sessionPtr);
                     command->status().call(isolate, command->cb());
                 }));
     }
@@ -215,36 +392,7 @@ public:
         std::unique_ptr<Loopable> loopable(createSafe<T>(args));
         if (!loopable) return;
         loopable->initAsync();
-
-        auto work = (uv_work_cb)[](uv_work_t* req) noexcept
-        {
-            Loopable* loopable(static_cast<Loopable*>(req->data));
-
-            do
-            {
-                loopable->run();
-                loopable->send();
-            }
-            while (!loopable->done());
-        };
-
-        queue(
-                std::move(loopable),
-                work,
-                (uv_after_work_cb)([](uv_work_t* req, int status)
-                {
-                    v8::Isolate* isolate(v8::Isolate::GetCurrent());
-                    v8::HandleScope scope(isolate);
-
-                    std::unique_ptr<uv_work_t> work(req);
-                    std::unique_ptr<Loopable> loopable(
-                            static_cast<Loopable*>(req->data));
-
-                    if (loopable->stopped())
-                    {
-                        std::cout << "Read command was stopped" << std::endl;
-                    }
-                }));
+        loopable.release()->queue();
     }
 
 private:
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+
+#include <entwine/types/schema.hpp>
+
+#include "commands/command.hpp"
+#include "read-queries/base.hpp"
+#include "types/exports.hpp"
+
+namespace command
+{
+
+// Starts a background export of a read to local files, which is split into
+// tiles written in parallel.  Responds with the initial status of the job.
+class StartExport : public Command
+{
+public:
+    StartExport(const Args& args)
+        : Command(args)
+        , m_compress(m_json["compress"].asBool())
+        , m_format(parseReadFormat(m_json["format"]))
+        , m_filter(boxes::combine(m_json["bounds"], m_json["filter"]))
+        , m_schema(entwine::maybeCreate<entwine::Schema>(m_json["schema"]))
+    {
+        if (m_format == ReadFormat::Arrow && m_compress)
+        {
+            throw std::runtime_error("The arrow format cannot be compressed");
+        }
+
+        if (m_format == ReadFormat::Las)
+        {
+            if (m_compress || m_schema)
+            {
+                throw std::runtime_error(
+                        "The las format may not be compressed or given a "
+                        "schema");
+            }
+
+            if (boxes::isMulti(m_json["bounds"]))
+            {
+                throw std::runtime_error(
+                        "Multiple bounds may not be used with the las format");
+            }
+        }
+    }
+
+protected:
+    virtual void work() override
+    {
+        Exports& exports(Bindings::exports());
+
+        const std::string id(exports.start<ExportJob>(
+                    m_sessionPtr,
+                    exports.path(),
+                    std::move(m_bounds),
+                    m_json["bounds"],
+                    std::move(m_scale),
+                    std::move(m_offset),
+                    m_depthBegin,
+                    m_depthEnd,
+                    std::move(m_schema),
+                    m_filter,
+                    m_format,
+                    m_compress));
+
+        m_status.set(exports.status(m_session.name(), id));
+    }
+
+private:
+    const bool m_compress;
+    const ReadFormat m_format;
+    const Json::Value m_filter;
+    std::unique_ptr<entwine::Schema> m_schema;
+};
+
+class ExportStatus : public Command
+{
+public:
+    ExportStatus(const Args& args)
+        : Command(args)
+        , m_id(m_json["id"].asString())
+    { }
+
+protected:
+    virtual void work() override
+    {
+        m_status.set(Bindings::exports().status(m_session.name(), m_id));
+    }
+
+private:
+    const std::string m_id;
+};
+
+// Stops an export after the chunks of its tiles that are being read.  Tiles
+// that were not completed are removed.
+class CancelExport : public Command
+{
+public:
+    CancelExport(const Args& args)
+        : Command(args)
+        , m_id(m_json["id"].asString())
+    { }
+
+protected:
+    virtual void work() override
+    {
+        Exports& exports(Bindings::exports());
+        exports.cancel(m_session.name(), m_id);
+        m_status.set(exports.status(m_session.name(), m_id));
+    }
+
+private:
+    const std::string m_id;
+};
+
+}
+
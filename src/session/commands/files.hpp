@@ -11,6 +11,7 @@ public:
     Files(const Args& args)
         : Command(args)
     {
+        requireSingleBounds();
         m_search = entwine::maybeCreate<Json::Value>(m_json["search"]);
 
         if (m_search && m_bounds)
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "commands/command.hpp"
+
+namespace command
+{
+
+class HierarchyBatch : public Command
+{
+public:
+    HierarchyBatch(const Args& args)
+        : Command(args)
+        , m_vertical(m_json["vertical"].asBool())
+        , m_depths(m_json["depths"].asUInt64())
+    { }
+
+protected:
+    virtual void work() override
+    {
+        const Json::Value result(
+                m_session.hierarchyBatch(
+                    m_json["queries"],
+                    m_depths,
+                    m_vertical,
+                    m_scale.get(),
+                    m_offset.get()));
+
+        m_status.set(result);
+    }
+
+    bool m_vertical;
+    std::size_t m_depths;
+};
+
+}
+
@@ -11,7 +11,9 @@ public:
     Hierarchy(const Args& args)
         : Command(args)
         , m_vertical(m_json["vertical"].asBool())
-    { }
+    {
+        requireSingleBounds();
+    }
 
 protected:
     virtual void work() override
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+#include "commands/command.hpp"
+#include "types/exports.hpp"
+#include "types/tiles.hpp"
+
+namespace command
+{
+
+// Starts a background render of the static tiles of a resource.  The job is
+// polled and cancelled like an export.
+class Materialize : public Command
+{
+public:
+    Materialize(const Args& args)
+        : Command(args)
+    { }
+
+protected:
+    virtual void work() override
+    {
+        const TileStore* tiles(Bindings::tiles());
+        if (!tiles) throw std::runtime_error("Tiles are not configured");
+
+        Exports& exports(Bindings::exports());
+
+        const std::string id(
+                exports.start<MaterializeJob>(m_sessionPtr, *tiles));
+
+        m_status.set(exports.status(m_session.name(), id));
+    }
+};
+
+}
+
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+
+#include <entwine/types/schema.hpp>
+
+#include "commands/command.hpp"
+#include "read-queries/base.hpp"
+#include "types/buffer-pool.hpp"
+#include "types/frames.hpp"
+
+namespace command
+{
+
+// Runs many bounds/depth sub-queries, which share a schema, filter, and
+// compression setting, as a single command.  Sub-queries run in order on the
+// same worker, so chunks shared between them are fetched once and then hit
+// in the chunk cache.  The response is framed by sub-query index, and each
+// sub-query's frames carry exactly its legacy read response.
+class ReadBatch : public Loopable
+{
+public:
+    ReadBatch(const Args& args)
+        : Loopable(args)
+        , m_compress(m_json["compress"].asBool())
+        , m_filter(m_json["filter"])
+        , m_schema(entwine::maybeCreate<entwine::Schema>(m_json["schema"]))
+    {
+        const Json::Value& queries(m_json["queries"]);
+
+        if (!queries.isArray() || queries.empty())
+        {
+            throw std::runtime_error("Batch requires a \"queries\" array");
+        }
+
+        for (const Json::Value& q : queries)
+        {
+            m_queries.emplace_back(q, m_filter);
+        }
+    }
+
+protected:
+    virtual void work() override
+    {
+        auto& bufferPool(ReadPool::get());
+        std::vector<char>& buffer(bufferPool.acquire());
+
+        // Small sub-queries are coalesced into a single send.
+        ReadPool::gather(buffer, [this, &buffer]() -> bool
+        {
+            const SubQuery& sub(m_queries[m_index]);
+            if (!m_query) m_query = makeQuery(sub);
+
+            m_chunk->clear();
+            m_query->read(*m_chunk);
+
+            const bool last(m_query->done());
+            frames::append(buffer, m_index, last ? frames::last : 0, *m_chunk);
+
+            if (last)
+            {
+                m_query.reset();
+                ++m_index;
+            }
+
+            return !finished();
+        });
+
+        bufferPool.capture(buffer);
+        m_status.set(buffer, finished());
+    }
+
+    virtual bool done() const override
+    {
+        return finished() || Loopable::done();
+    }
+
+private:
+    struct SubQuery
+    {
+        SubQuery(const Json::Value& json, const Json::Value& filter)
+            : bounds(boxes::create(json["bounds"]))
+            , filter(boxes::combine(json["bounds"], filter))
+            , depthBegin(
+                    json.isMember("depth") ?
+                        json["depth"].asUInt64() :
+                        json["depthBegin"].asUInt64())
+            , depthEnd(
+                    json.isMember("depth") ?
+                        json["depth"].asUInt64() + 1 :
+                        json["depthEnd"].asUInt64())
+        {
+            if (
+                    json.isMember("depth") &&
+                    (json.isMember("depthBegin") || json.isMember("depthEnd")))
+            {
+                throw std::runtime_error("Invalid depth specification");
+            }
+        }
+
+        std::unique_ptr<entwine::Bounds> bounds;
+        Json::Value filter;
+        std::size_t depthBegin;
+        std::size_t depthEnd;
+    };
+
+    bool finished() const { return m_index == m_queries.size(); }
+
+    std::unique_ptr<ReadQuery> makeQuery(const SubQuery& sub) const
+    {
+        return m_session.getQuery(
+                sub.bounds.get(),
+                sub.depthBegin,
+                sub.depthEnd,
+                m_scale.get(),
+                m_offset.get(),
+                m_schema.get(),
+                sub.filter,
+                m_compress);
+    }
+
+    bool m_compress;
+    Json::Value m_filter;
+    std::unique_ptr<entwine::Schema> m_schema;
+
+    std::vector<SubQuery> m_queries;
+    std::size_t m_index = 0;
+
+    std::unique_ptr<ReadQuery> m_query;
+    PooledBuffer m_chunk;
+};
+
+}
+
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <entwine/types/bounds.hpp>
+#include <entwine/types/schema.hpp>
+
+#include "commands/command.hpp"
+#include "read-queries/base.hpp"
+#include "types/buffer-pool.hpp"
+#include "types/frames.hpp"
+#include "types/hierarchy.hpp"
+#include "types/view.hpp"
+
+namespace command
+{
+
+// Streams the nodes of the tree that are visible from a camera, most
+// important first, until each streamed node is refined to within the
+// screen-space error target of the view or the point budget is spent.  The
+// traversal is driven by hierarchy counts, fetched a few depths at a time as
+// it descends, so a single request replaces the refinement round trips of a
+// client-side traversal.
+//
+// The response is framed by the order in which nodes are streamed.  Each
+// node begins with a meta frame describing it, followed by frames carrying
+// exactly the legacy read response for its bounds and depth.
+class ReadView : public Loopable
+{
+public:
+    ReadView(const Args& args)
+        : Loopable(args)
+        , m_compress(m_json["compress"].asBool())
+        , m_filter(m_json["filter"])
+        , m_schema(entwine::maybeCreate<entwine::Schema>(m_json["schema"]))
+        , m_view(m_json["view"])
+        , m_pointBudget(m_json["pointBudget"].asUInt64())
+    {
+        if (boxes::isMulti(m_json["bounds"]))
+        {
+            throw std::runtime_error(
+                    "Multiple bounds may not be used with a view");
+        }
+    }
+
+protected:
+    virtual void work() override
+    {
+        if (!m_started) start();
+
+        auto& bufferPool(ReadPool::get());
+        std::vector<char>& buffer(bufferPool.acquire());
+
+        ReadPool::gather(buffer, [this, &buffer]() -> bool
+        {
+            if (!m_query && !next(buffer))
+            {
+                m_finished = true;
+                return false;
+            }
+
+            m_chunk->clear();
+            m_query->read(*m_chunk);
+
+            const bool last(m_query->done());
+            frames::append(buffer, m_index, last ? frames::last : 0, *m_chunk);
+
+            if (last)
+            {
+                m_query.reset();
+                ++m_index;
+            }
+
+            return true;
+        });
+
+        bufferPool.capture(buffer);
+        m_status.set(buffer, m_finished);
+    }
+
+    virtual bool done() const override
+    {
+        return m_finished || Loopable::done();
+    }
+
+private:
+    struct Node
+    {
+        entwine::Bounds bounds;
+        std::size_t depth;
+        uint64_t n;
+        double error;
+
+        // Hierarchy rooted at this node, which has "levels" depths including
+        // this one.
+        Json::Value tree;
+        std::size_t levels;
+
+        bool operator<(const Node& other) const
+        {
+            return error < other.error;
+        }
+    };
+
+    // Depths of hierarchy fetched at a time during the traversal.
+    static constexpr std::size_t fetchDepths = 4;
+
+    static uint64_t count(const Json::Value& tree)
+    {
+        return tree.isObject() ? tree["n"].asUInt64() : 0;
+    }
+
+    void start()
+    {
+        m_started = true;
+
+        const entwine::Bounds bounds(
+                m_bounds ?
+                    *m_bounds :
+                    m_session.bounds(m_scale.get(), m_offset.get()));
+
+        const std::size_t depth(
+                std::max<std::size_t>(
+                    m_depthBegin,
+                    m_session.info()["baseDepth"].asUInt64()));
+
+        if (m_depthEnd && depth >= m_depthEnd) return;
+
+        push(bounds, depth, fetch(bounds, depth), fetchDepths);
+    }
+
+    Json::Value fetch(const entwine::Bounds& bounds, std::size_t depth) const
+    {
+        return m_session.hierarchy(
+                &bounds,
+                depth,
+                depth + fetchDepths,
+                false,
+                m_scale.get(),
+                m_offset.get());
+    }
+
+    void push(
+            const entwine::Bounds& bounds,
+            std::size_t depth,
+            const Json::Value& tree,
+            std::size_t levels)
+    {
+        const uint64_t n(count(tree));
+        if (!n || !m_view.visible(bounds)) return;
+
+        const double error(m_view.error(bounds, n));
+
+        m_queue.push_back(Node { bounds, depth, n, error, tree, levels });
+        std::push_heap(m_queue.begin(), m_queue.end());
+    }
+
+    // Queue the children of a node that is not yet fine enough.
+    void expand(Node& node)
+    {
+        if (node.error <= m_view.maxError()) return;
+        if (m_depthEnd && node.depth + 1 >= m_depthEnd) return;
+
+        if (node.levels == 1)
+        {
+            node.tree = fetch(node.bounds, node.depth);
+            node.levels = fetchDepths;
+        }
+
+        const Json::Value& tree(node.tree);
+
+        for (const std::string& dir : hierarchy::children(tree))
+        {
+            push(
+                    hierarchy::bisect(node.bounds, dir),
+                    node.depth + 1,
+                    tree[dir],
+                    node.levels - 1);
+        }
+    }
+
+    // Begins streaming the most important remaining node, returning false if
+    // the traversal is complete.
+    bool next(std::vector<char>& buffer)
+    {
+        if (m_queue.empty()) return false;
+
+        std::pop_heap(m_queue.begin(), m_queue.end());
+        Node node(std::move(m_queue.back()));
+        m_queue.pop_back();
+
+        if (m_pointBudget && m_points + node.n > m_pointBudget)
+        {
+            m_queue.clear();
+            return false;
+        }
+
+        m_points += node.n;
+        expand(node);
+
+        Json::Value meta;
+        meta["depth"] = static_cast<Json::UInt64>(node.depth);
+        meta["bounds"] = node.bounds.toJson();
+        meta["points"] = static_cast<Json::UInt64>(node.n);
+        meta["error"] = node.error;
+
+        const std::string json(Json::FastWriter().write(meta));
+        frames::append(
+                buffer,
+                m_index,
+                frames::meta,
+                std::vector<char>(json.begin(), json.end()));
+
+        m_query = m_session.getQuery(
+                &node.bounds,
+                node.depth,
+                node.depth + 1,
+                m_scale.get(),
+                m_offset.get(),
+                m_schema.get(),
+                m_filter,
+                m_compress);
+
+        return true;
+    }
+
+    bool m_compress;
+    Json::Value m_filter;
+    std::unique_ptr<entwine::Schema> m_schema;
+    const View m_view;
+    const uint64_t m_pointBudget;
+
+    bool m_started = false;
+    bool m_finished = false;
+    std::vector<Node> m_queue;
+    uint64_t m_points = 0;
+    std::size_t m_index = 0;
+
+    std::unique_ptr<ReadQuery> m_query;
+    PooledBuffer m_chunk;
+};
+
+}
+
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+#include <string>
 #include <vector>
 
 #include <entwine/types/schema.hpp>
@@ -7,6 +9,11 @@
 #include "commands/command.hpp"
 #include "read-queries/base.hpp"
 #include "types/buffer-pool.hpp"
+#include "types/frames.hpp"
+#include "types/key.hpp"
+#include "types/las.hpp"
+#include "types/node-set.hpp"
+#include "types/tiles.hpp"
 
 namespace command
 {
@@ -17,40 +24,516 @@ public:
     Read(const Args& args)
         : Loopable(args)
         , m_compress(m_json["compress"].asBool())
-        , m_filter(m_json["filter"])
+        , m_format(parseReadFormat(m_json["format"]))
+        , m_filter(boxes::combine(m_json["bounds"], m_json["filter"]))
         , m_schema(entwine::maybeCreate<entwine::Schema>(m_json["schema"]))
-        , m_query(
-                m_session.getQuery(
-                    m_bounds.get(),
-                    m_depthBegin,
-                    m_depthEnd,
-                    m_scale.get(),
-                    m_offset.get(),
-                    m_schema.get(),
-                    m_filter,
-                    m_compress))
-    { }
+        , m_pointBudget(m_json["pointBudget"].asUInt64())
+        , m_exclude(NodeSet::create(m_json["exclude"]))
+        , m_ordered(m_json["depthOrdered"].asBool())
+        , m_depth(m_depthBegin)
+        , m_resumable(
+                m_json["cursor"].isString() || m_json["cursor"].asBool())
+        , m_node(
+                m_json.isMember("node") ?
+                    entwine::makeUnique<Key>(
+                        Key::parse(m_json["node"].asString())) :
+                    nullptr)
+        , m_answered(false)
+    {
+        if (m_node)
+        {
+            if (
+                    m_bounds || m_json.isMember("depth") ||
+                    m_json.isMember("depthBegin") ||
+                    m_json.isMember("depthEnd"))
+            {
+                throw std::runtime_error(
+                        "A node may not be used with bounds or depths");
+            }
+
+            if (m_ordered || m_resumable || m_json.isMember("pointBudget"))
+            {
+                throw std::runtime_error(
+                        "A node may not be used with depthOrdered, cursor, "
+                        "or pointBudget");
+            }
+        }
+
+        if (m_format == ReadFormat::Arrow && m_compress)
+        {
+            throw std::runtime_error("The arrow format cannot be compressed");
+        }
+
+        if (m_format == ReadFormat::Las)
+        {
+            if (m_compress || m_json.isMember("schema"))
+            {
+                throw std::runtime_error(
+                        "The las format may not be compressed or given a "
+                        "schema");
+            }
+
+            if (
+                    m_ordered || m_resumable || m_exclude ||
+                    m_json.isMember("pointBudget"))
+            {
+                throw std::runtime_error(
+                        "The las format may not be used with depthOrdered, "
+                        "cursor, exclude, or pointBudget");
+            }
+
+            if (boxes::isMulti(m_json["bounds"]))
+            {
+                throw std::runtime_error(
+                        "Multiple bounds may not be used with the las format");
+            }
+        }
+
+        if (m_resumable)
+        {
+            if (m_ordered || m_json.isMember("pointBudget"))
+            {
+                throw std::runtime_error(
+                        "A cursor may not be used with depthOrdered or "
+                        "pointBudget");
+            }
+        }
+
+        if (m_ordered)
+        {
+            if (m_depthEnd <= m_depthBegin)
+            {
+                throw std::runtime_error("depthOrdered requires depthEnd");
+            }
+
+            if (m_json.isMember("pointBudget"))
+            {
+                throw std::runtime_error(
+                        "A pointBudget may not be used with depthOrdered");
+            }
+        }
+
+        if (m_exclude)
+        {
+            if (boxes::isMulti(m_json["bounds"]))
+            {
+                throw std::runtime_error(
+                        "Multiple bounds may not be used with exclude");
+            }
+
+            if (m_json.isMember("pointBudget"))
+            {
+                throw std::runtime_error(
+                        "A pointBudget may not be used with exclude");
+            }
+        }
+
+        if (m_json.isMember("pointBudget"))
+        {
+            if (!m_pointBudget)
+            {
+                throw std::runtime_error("Invalid pointBudget");
+            }
+
+            if (boxes::isMulti(m_json["bounds"]))
+            {
+                throw std::runtime_error(
+                        "Multiple bounds may not be used with pointBudget");
+            }
+        }
+    }
 
 protected:
     virtual void work() override
     {
+        if (m_ordered) return workOrdered();
+        if (m_resumable) return workResumable();
+
+        if (!m_started)
+        {
+            m_started = true;
+            if (m_node && !selectNode(m_meta)) return;
+        }
+
+        if (m_format == ReadFormat::Las && !m_las && !countLas()) return;
+
+        if (!m_query)
+        {
+            m_query = m_pointBudget ?
+                makeBudgetQuery(m_meta) :
+                makeQuery(m_bounds.get(), m_depthBegin, m_depthEnd);
+        }
+
         auto& bufferPool(ReadPool::get());
         std::vector<char>& buffer(bufferPool.acquire());
         m_query->read(buffer);
 
+        ReadPool::gather(buffer, [this, &buffer]() -> bool
+        {
+            if (m_query->done()) return false;
+
+            // Index queries fill the buffer they are given, so each further
+            // chunk is read into scratch space and appended.
+            m_chunk->clear();
+            m_query->read(*m_chunk);
+            buffer.insert(buffer.end(), m_chunk->begin(), m_chunk->end());
+            return true;
+        });
+
         bufferPool.capture(buffer);
-        m_status.set(buffer, m_query->done());
+        respond(buffer, m_query->done());
+    }
+
+    // The selected depths, or the ETag of a node, are reported along with
+    // the first response.
+    void respond(std::vector<char>& buffer, bool done)
+    {
+        if (m_meta.isNull()) return m_status.set(buffer, done);
+
+        m_status.set(buffer, done, m_meta);
+        m_meta = Json::nullValue;
+    }
+
+    // A node is read by its key, and its response is identified by the index
+    // version and the query, so it may be cached under that ETag.  If the
+    // client holds the current response, or it has been rendered to a static
+    // tile, no points are sent.
+    bool selectNode(Json::Value& meta)
+    {
+        // The key is hashed in its canonical form, so that every spelling
+        // of it, from either HTTP server, shares one ETag.
+        Json::Value query(m_json);
+        query["node"] = m_node->toString();
+
+        const std::string version(m_session.version());
+        const std::string etag(nodeEtag(version, query));
+
+        meta["etag"] = etag;
+
+        if (m_json["ifNoneMatch"].asString() == etag)
+        {
+            meta["notModified"] = true;
+            answer(meta);
+            return false;
+        }
+
+        if (const TileStore* tiles = Bindings::tiles())
+        {
+            const std::string path(
+                    tiles->find(m_session.name(), version, *m_node, m_json));
+
+            if (!path.empty())
+            {
+                meta["file"] = path;
+                answer(meta);
+                return false;
+            }
+        }
+
+        const Json::Value info(m_session.info());
+        const std::size_t baseDepth(info["baseDepth"].asUInt64());
+        const bool is3d(info["type"].asString() == "octree");
+        const Key& key(*m_node);
+        key.validate(baseDepth, is3d);
+
+        m_bounds = entwine::makeUnique<entwine::Bounds>(key.bounds(
+                    m_session.bounds(m_scale.get(), m_offset.get()),
+                    baseDepth,
+                    is3d));
+
+        m_depthBegin = key.depth;
+        m_depthEnd = key.depth + 1;
+        return true;
+    }
+
+    // Responds with "meta" alone, in place of any points.
+    void answer(const Json::Value& meta)
+    {
+        m_answered = true;
+
+        auto& bufferPool(ReadPool::get());
+        std::vector<char>& buffer(bufferPool.acquire());
+        bufferPool.capture(buffer);
+        m_status.set(buffer, true, meta);
+    }
+
+    // Each depth is read by its own query and framed by its depth, and a
+    // send never spans a depth boundary, so the client sees each depth
+    // completed in order and may stop between them.
+    void workOrdered()
+    {
+        auto& bufferPool(ReadPool::get());
+        std::vector<char>& buffer(bufferPool.acquire());
+
+        ReadPool::gather(buffer, [this, &buffer]() -> bool
+        {
+            if (!m_query)
+            {
+                m_query = makeQuery(m_bounds.get(), m_depth, m_depth + 1);
+            }
+
+            m_chunk->clear();
+            m_query->read(*m_chunk);
+
+            const bool last(m_query->done());
+            frames::append(buffer, m_depth, last ? frames::last : 0, *m_chunk);
+
+            if (!last) return true;
+
+            m_query.reset();
+            ++m_depth;
+            return false;
+        });
+
+        bufferPool.capture(buffer);
+        m_status.set(buffer, m_depth == m_depthEnd);
+    }
+
+    // Each cell of the read is framed by its position in the sequence of
+    // cells, and each completed cell is followed by a meta frame holding
+    // the cursor that resumes the read after it.
+    void workResumable()
+    {
+        if (!m_cursor)
+        {
+            m_cells = cursorCells();
+
+            const uint64_t fingerprint(cursorFingerprint());
+            const Json::Value& token(m_json["cursor"]);
+
+            m_cursor = entwine::makeUnique<Cursor>(
+                    token.isString() ?
+                        Cursor::parse(token.asString(), fingerprint) :
+                        Cursor(fingerprint, 0, m_cells.size()));
+
+            if (m_cursor->end > m_cells.size())
+            {
+                throw std::runtime_error("Invalid cursor");
+            }
+        }
+
+        Cursor& cursor(*m_cursor);
+
+        auto& bufferPool(ReadPool::get());
+        std::vector<char>& buffer(bufferPool.acquire());
+
+        ReadPool::gather(buffer, [this, &cursor, &buffer]() -> bool
+        {
+            if (!m_query)
+            {
+                m_query = makeQuery(
+                        &m_cells[cursor.begin],
+                        m_depthBegin,
+                        m_depthEnd);
+            }
+
+            m_chunk->clear();
+            m_query->read(*m_chunk);
+
+            const bool last(m_query->done());
+            frames::append(
+                    buffer,
+                    cursor.begin,
+                    last ? frames::last : 0,
+                    *m_chunk);
+
+            if (last)
+            {
+                m_query.reset();
+                const uint32_t index(cursor.begin++);
+
+                Json::Value meta;
+                if (cursor.begin < cursor.end)
+                {
+                    meta["cursor"] = cursor.toString();
+                }
+                else meta["cursor"] = Json::nullValue;
+
+                const std::string json(Json::FastWriter().write(meta));
+                frames::append(
+                        buffer,
+                        index,
+                        frames::meta,
+                        std::vector<char>(json.begin(), json.end()));
+            }
+
+            return cursor.begin < cursor.end;
+        });
+
+        bufferPool.capture(buffer);
+        m_status.set(buffer, cursor.begin == cursor.end);
     }
 
     virtual bool done() const override
     {
-        return m_query->done() || Loopable::done();
+        if (m_ordered) return m_depth == m_depthEnd || Loopable::done();
+
+        if (m_resumable)
+        {
+            return
+                (m_cursor && m_cursor->begin == m_cursor->end) ||
+                Loopable::done();
+        }
+
+        return
+            m_answered ||
+            (m_query && m_query->done()) ||
+            Loopable::done();
+    }
+
+    // The index may not have been opened yet, so this is deferred until we
+    // are running on a worker thread.
+    std::unique_ptr<ReadQuery> makeQuery(
+            const entwine::Bounds* bounds,
+            std::size_t depthBegin,
+            std::size_t depthEnd) const
+    {
+        std::unique_ptr<ReadQuery> query(
+                makeQueryRaw(bounds, depthBegin, depthEnd, m_schema.get()));
+        query->setFormat(m_format);
+        if (m_las) query->setLas(*m_las);
+        return query;
+    }
+
+    std::unique_ptr<ReadQuery> makeQueryRaw(
+            const entwine::Bounds* bounds,
+            std::size_t depthBegin,
+            std::size_t depthEnd,
+            const entwine::Schema* schema) const
+    {
+        if (m_exclude)
+        {
+            return m_session.getDeltaQuery(
+                    bounds,
+                    depthBegin,
+                    depthEnd,
+                    *m_exclude,
+                    m_scale.get(),
+                    m_offset.get(),
+                    schema,
+                    m_filter,
+                    m_compress);
+        }
+
+        return m_session.getQuery(
+                bounds,
+                depthBegin,
+                depthEnd,
+                m_scale.get(),
+                m_offset.get(),
+                schema,
+                m_filter,
+                m_compress,
+                m_pin.get());
+    }
+
+    std::unique_ptr<ReadQuery> makeBudgetQuery(Json::Value& selection) const
+    {
+        std::unique_ptr<ReadQuery> query(m_session.getBudgetQuery(
+                m_bounds.get(),
+                m_depthBegin,
+                m_depthEnd,
+                m_pointBudget,
+                m_scale.get(),
+                m_offset.get(),
+                m_schema.get(),
+                m_filter,
+                m_compress,
+                selection));
+
+        query->setFormat(m_format);
+        return query;
+    }
+
+    // Sets the schema, scale, and offset of a LAS read, and its header once
+    // the point count is known.  The count precedes the points, so it is
+    // found by a pass over the query with a minimal schema, which also
+    // leaves its chunks cached for the pass that follows.  Both passes read
+    // the same version of the index, so the count matches the points even
+    // if the resource is reloaded in between.
+    //
+    // The count is taken a slice at a time.  Returns false, having set an
+    // empty response, if it is not yet complete, so that the read may be
+    // stopped between slices.
+    bool countLas()
+    {
+        if (!m_counter)
+        {
+            m_pin = m_session.pin();
+
+            m_lasHeader = entwine::makeUnique<las::Header>(las::prepare(
+                        m_session.info(*m_pin),
+                        m_scale,
+                        m_offset,
+                        m_bounds));
+
+            m_schema = entwine::makeUnique<entwine::Schema>(
+                    las::schema(m_lasHeader->rgb));
+            m_countSchema = entwine::makeUnique<entwine::Schema>(
+                    las::countSchema());
+
+            m_counter = makeQueryRaw(
+                    m_bounds.get(),
+                    m_depthBegin,
+                    m_depthEnd,
+                    m_countSchema.get());
+        }
+
+        const auto deadline(std::chrono::steady_clock::now() + countSlice());
+
+        while (
+                !m_counter->done() &&
+                std::chrono::steady_clock::now() < deadline)
+        {
+            m_chunk->clear();
+            m_counter->read(*m_chunk);
+        }
+
+        if (m_counter->done())
+        {
+            m_lasHeader->numPoints = m_counter->numPoints();
+            m_las = std::move(m_lasHeader);
+            m_counter.reset();
+            return true;
+        }
+
+        auto& bufferPool(ReadPool::get());
+        std::vector<char>& buffer(bufferPool.acquire());
+        bufferPool.capture(buffer);
+        respond(buffer, false);
+        return false;
+    }
+
+    // The longest that a LAS count runs without a chance to be stopped.
+    static std::chrono::milliseconds countSlice()
+    {
+        return std::chrono::milliseconds(250);
     }
 
     bool m_compress;
+    const ReadFormat m_format;
     Json::Value m_filter;
     std::unique_ptr<entwine::Schema> m_schema;
+    const uint64_t m_pointBudget;
+    std::unique_ptr<NodeSet> m_exclude;
+    const bool m_ordered;
+    std::size_t m_depth;
+    const bool m_resumable;
+    std::vector<entwine::Bounds> m_cells;
+    std::unique_ptr<Cursor> m_cursor;
     std::unique_ptr<ReadQuery> m_query;
+    PooledBuffer m_chunk;
+    std::unique_ptr<las::Header> m_las;
+    std::unique_ptr<Key> m_node;
+    bool m_answered;
+    bool m_started = false;
+    Json::Value m_meta;
+
+    // State of a LAS read while its points are counted.
+    std::shared_ptr<Session::State> m_pin;
+    std::unique_ptr<las::Header> m_lasHeader;
+    std::unique_ptr<entwine::Schema> m_countSchema;
+    std::unique_ptr<ReadQuery> m_counter;
 };
 
 class ReadSingle : public Command
@@ -59,22 +542,14 @@ public:
     ReadSingle(const Args& args)
         : Command(args)
         , m_compress(m_json["compress"].asBool())
-        , m_filter(m_json["filter"])
+        , m_filter(boxes::combine(m_json["bounds"], m_json["filter"]))
         , m_schema(entwine::maybeCreate<entwine::Schema>(m_json["schema"]))
-        , m_query(
-                m_session.getQuery(
-                    m_bounds.get(),
-                    m_depthBegin,
-                    m_depthEnd,
-                    m_scale.get(),
-                    m_offset.get(),
-                    m_schema.get(),
-                    m_filter,
-                    m_compress))
     { }
 
     virtual void work() override
     {
+        m_query = makeQuery();
+
         auto& bufferPool(ReadPool::get());
         std::vector<char>& buffer(bufferPool.acquire());
 
@@ -85,6 +560,21 @@ public:
     }
 
 protected:
+    // The index may not have been opened yet, so this is deferred until we
+    // are running on a worker thread.
+    std::unique_ptr<ReadQuery> makeQuery() const
+    {
+        return m_session.getQuery(
+                m_bounds.get(),
+                m_depthBegin,
+                m_depthEnd,
+                m_scale.get(),
+                m_offset.get(),
+                m_schema.get(),
+                m_filter,
+                m_compress);
+    }
+
     bool m_compress;
     Json::Value m_filter;
     std::unique_ptr<entwine::Schema> m_schema;
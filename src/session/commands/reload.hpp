@@ -0,0 +1,21 @@
+#pragma once
+
+#include "commands/command.hpp"
+
+namespace command
+{
+
+class Reload : public Command
+{
+public:
+    Reload(const Args& args) : Command(args) { }
+
+protected:
+    virtual void work() override
+    {
+        m_status.set(m_session.reload());
+    }
+};
+
+}
+
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm>
+
+#include "commands/command.hpp"
+
+namespace command
+{
+
+// Splits a read into cursors over disjoint parts of it, which may be read in
+// parallel with the "cursor" option of a read.
+class Split : public Command
+{
+public:
+    Split(const Args& args)
+        : Command(args)
+        , m_count(m_json["split"].asUInt64())
+    {
+        if (!m_count) throw std::runtime_error("Invalid split count");
+    }
+
+protected:
+    virtual void work() override
+    {
+        const std::size_t cells(cursorCells().size());
+        const uint64_t fingerprint(cursorFingerprint());
+        const std::size_t count(std::min<std::size_t>(m_count, cells));
+
+        Json::Value result(Json::arrayValue);
+
+        for (std::size_t i(0); i < count; ++i)
+        {
+            const Cursor cursor(
+                    fingerprint,
+                    cells * i / count,
+                    cells * (i + 1) / count);
+
+            result.append(cursor.toString());
+        }
+
+        m_status.set(result);
+    }
+
+private:
+    const uint64_t m_count;
+};
+
+}
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <array>
+#include <initializer_list>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "types/arena.hpp"
 #include "types/js.hpp"
 
 class JsConvertible
@@ -47,36 +51,68 @@ private:
     const std::vector<char>& m_buffer;
 };
 
+// The arguments of a command's next callback.  A looping command replaces
+// them for every chunk it sends, so they are allocated from an arena owned by
+// the command, which is rewound for each set, rather than from the shared
+// heap.  Without an arena they come from the heap.  A status without
+// arguments is a success, so an empty status allocates nothing.
+//
+// Arguments are only ever held by their status, which is not copyable, so
+// nothing refers to the arena once they are replaced.
 class Status
 {
 public:
-    Status() : m_args{ std::make_shared<JsonConvertible>() } { }
+    explicit Status(Arena* arena = nullptr) : m_arena(arena) { }
+
+    Status(Status&& other)
+        : m_arena(other.m_arena)
+        , m_args(std::move(other.m_args))
+        , m_count(other.m_count)
+    {
+        other.m_count = 0;
+    }
 
     template<typename F>
     static Status safe(F f) noexcept
     {
         Status status;
-        try { f(); }
-        catch (std::exception& e) { status.setError(400, e.what()); }
-        catch (...) { status.setError(500); }
+        status.safely(f);
         return status;
     }
 
+    // Runs "f", and if it throws, replaces the arguments with the error.
+    template<typename F>
+    void safely(F f) noexcept
+    {
+        try { f(); }
+        catch (std::exception& e) { setError(400, e.what()); }
+        catch (...) { setError(500); }
+    }
+
     void set(const Json::Value& json)
     {
-        m_args = {
-            std::make_shared<JsonConvertible>(),
-            std::make_shared<JsonConvertible>(json)
-        };
+        clear();
+        assign({ make<JsonConvertible>(), make<JsonConvertible>(json) });
     }
 
     void set(const std::vector<char>& buffer, bool done)
     {
-        m_args = {
-            std::make_shared<JsonConvertible>(),
-            std::make_shared<BufferConvertible>(buffer),
-            std::make_shared<JsonConvertible>(done)
-        };
+        clear();
+        assign({
+            make<JsonConvertible>(),
+            make<BufferConvertible>(buffer),
+            make<JsonConvertible>(done)
+        });
+    }
+
+    // As above, with a fourth argument describing the response.
+    void set(
+            const std::vector<char>& buffer,
+            bool done,
+            const Json::Value& meta)
+    {
+        set(buffer, done);
+        m_args[m_count++] = make<JsonConvertible>(meta);
     }
 
     void setError(int code)
@@ -89,37 +125,73 @@ public:
         Json::Value err;
         err["code"] = code;
         err["message"] = message;
-        m_args = { std::make_shared<JsonConvertible>(err) };
+        clear();
+        assign({ make<JsonConvertible>(err) });
     }
 
     bool ok() const
     {
-        return m_args.empty() || m_args.front()->toJson() == Json::nullValue;
+        return !m_count || m_args.front()->toJson() == Json::nullValue;
     }
 
+    // The converted arguments are few and bounded, so they are gathered on
+    // the stack rather than allocated for every call.
     Arg call(
             v8::Isolate* isolate,
             v8::UniquePersistent<v8::Function>& f) const
     {
-        auto converted(toJs(isolate));
+        std::array<Arg, 4> js;
+        std::size_t count(0);
+
+        if (!m_count) js[count++] = v8::Null(isolate);
+        for (std::size_t i(0); i < m_count; ++i)
+        {
+            js[count++] = m_args[i]->convert(isolate);
+        }
+
         v8::Local<v8::Function> local(v8::Local<v8::Function>::New(isolate, f));
         return local->Call(
                 isolate->GetCurrentContext()->Global(),
-                converted.size(),
-                converted.data());
+                count,
+                js.data());
     }
 
-    std::vector<Arg> toJs(v8::Isolate* isolate) const
+private:
+    using Convertible = std::shared_ptr<JsConvertible>;
+
+    template<typename T, typename... Args>
+    Convertible make(Args&&... args)
     {
-        std::vector<Arg> js;
-        for (const auto& arg : m_args) js.push_back(arg->convert(isolate));
-        return js;
+        if (!m_arena) return std::make_shared<T>(std::forward<Args>(args)...);
+
+        return std::allocate_shared<T>(
+                ArenaAllocator<T>(*m_arena),
+                std::forward<Args>(args)...);
     }
 
-private:
+    void assign(std::initializer_list<Convertible> args)
+    {
+        m_count = 0;
+        for (const auto& arg : args) m_args[m_count++] = arg;
+    }
+
+    void clear()
+    {
+        for (auto& arg : m_args) arg.reset();
+        m_count = 0;
+
+        if (m_arena) m_arena->reset();
+    }
+
+    Arena* m_arena;
+
     // We can't just store Arg values here, since our native values might be
     // defined within a different isolate context than the one at which we
     // actually invoke a callback.
-    std::vector<std::shared_ptr<JsConvertible>> m_args;
+    std::array<Convertible, 4> m_args;
+    std::size_t m_count = 0;
+
+    Status(const Status&);
+    Status& operator=(const Status&);
 };
 
@@ -1,13 +1,21 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
+#include <json/json.h>
+
 #include <pdal/Dimension.hpp>
 #include <pdal/Compression.hpp>
 
 #include <entwine/types/schema.hpp>
-#include <entwine/util/compression.hpp>
+
+#include "types/arrow.hpp"
+#include "types/buffer-pool.hpp"
+#include "types/compression-sink.hpp"
+#include "types/las.hpp"
 
 namespace entwine
 {
@@ -15,36 +23,113 @@ namespace entwine
     class DimInfo;
 }
 
+// Wire formats of a read response.
+//
+// Legacy: the points, possibly as a single compressed stream, followed by a
+// uint32 point count.
+//
+// Framed: a header of the magic "GHFR", a uint32 version, uint32 flags (bit
+// 0 set if frames are compressed), and a uint32 length followed by the JSON
+// schema of the points.  Then a frame per chunk of points, each a uint32
+// point count and uint32 byte length followed by the points, compressed on
+// their own if requested so that frames may be decoded independently.  The
+// frames end with a frame of zero points and zero bytes, followed by the
+// uint64 total point count.  All integers are little-endian.
+//
+// Arrow: an Apache Arrow IPC stream with a column per dimension, and a record
+// batch per chunk of points.  Compression is not supported.
+//
+// Las: a LAS 1.4 file, whose header must be supplied with setLas() since its
+// point count precedes the points.  The schema must be that of las::schema().
+enum class ReadFormat
+{
+    Legacy,
+    Framed,
+    Arrow,
+    Las
+};
+
+inline ReadFormat parseReadFormat(const Json::Value& json)
+{
+    const std::string format(json.asString());
+
+    if (format.empty() || format == "legacy") return ReadFormat::Legacy;
+    if (format == "framed") return ReadFormat::Framed;
+    if (format == "arrow") return ReadFormat::Arrow;
+    if (format == "las") return ReadFormat::Las;
+
+    throw std::runtime_error("Invalid format: " + format);
+}
+
 class ReadQuery
 {
 public:
     ReadQuery(const entwine::Schema& schema, bool compress)
-        : m_compressionStream(0)
+        : m_sink()
         , m_compressor(
                 compress ?
-                    new pdal::LazPerfCompressor<entwine::CompressionStream>(
-                        m_compressionStream,
+                    new pdal::LazPerfCompressor<CompressionSink>(
+                        m_sink,
                         schema.pdalLayout().dimTypes()) :
                     0)
-        , m_compressionOffset(0)
         , m_schema(schema)
         , m_done(false)
+        , m_format(ReadFormat::Legacy)
+        , m_compressFrames(false)
+        , m_started(false)
     { }
 
     virtual ~ReadQuery() { if (m_compressor) m_compressor->done(); }
 
+    // Must be called before the first read.
+    void setFormat(ReadFormat format)
+    {
+        m_format = format;
+
+        if (m_format == ReadFormat::Framed && m_compressor)
+        {
+            // Frames are compressed individually rather than as one stream.
+            m_compressFrames = true;
+            m_compressor.reset();
+        }
+
+        if (m_format == ReadFormat::Arrow && m_compressor)
+        {
+            throw std::runtime_error("The arrow format cannot be compressed");
+        }
+
+        if (m_format == ReadFormat::Las && m_compressor)
+        {
+            throw std::runtime_error("The las format cannot be compressed");
+        }
+    }
+
+    // Must be called before the first read of the Las format.
+    void setLas(const las::Header& header) { m_las = header; }
+
     void read(std::vector<char>& buffer)
     {
         if (m_done) throw std::runtime_error("Tried to call read() after done");
 
-        m_done = readSome(buffer);
+        if (m_format == ReadFormat::Framed) return readFramed(buffer);
+        if (m_format == ReadFormat::Arrow) return readArrow(buffer);
+        if (m_format == ReadFormat::Las) return readLas(buffer);
 
         if (compress())
         {
-            m_compressor->compress(buffer.data(), buffer.size());
+            // Points are gathered in scratch space that persists across
+            // reads, and compressed straight into the caller's buffer.  The
+            // output is a fraction of the chunk, which a pooled buffer
+            // already has room for, so nothing is reserved for it.
+            m_chunk->clear();
+            m_done = readSome(*m_chunk);
+
+            m_sink.target(&buffer);
+            m_compressor->compress(m_chunk->data(), m_chunk->size());
             if (m_done) m_compressor->done();
-            buffer = std::move(*m_compressionStream.data());
+            m_sink.target(nullptr);
         }
+        else m_done = readSome(buffer);
 
         if (m_done)
         {
@@ -62,12 +147,120 @@ protected:
     // Must return true if done, else false.
     virtual bool readSome(std::vector<char>& buffer) = 0;
 
-    entwine::CompressionStream m_compressionStream;
-    std::unique_ptr<pdal::LazPerfCompressor<
-            entwine::CompressionStream>> m_compressor;
-    std::size_t m_compressionOffset;
+    void readFramed(std::vector<char>& buffer)
+    {
+        if (!m_started)
+        {
+            m_started = true;
+
+            const std::string schema(
+                    Json::FastWriter().write(m_schema.toJson()));
+
+            const char magic[] = "GHFR";
+            buffer.insert(buffer.end(), magic, magic + 4);
+            put<uint32_t>(buffer, 1);
+            put<uint32_t>(buffer, m_compressFrames ? 1 : 0);
+            put<uint32_t>(buffer, schema.size());
+            buffer.insert(buffer.end(), schema.begin(), schema.end());
+        }
+
+        m_chunk->clear();
+        m_done = readSome(*m_chunk);
+
+        if (const uint32_t points = m_chunk->size() / m_schema.pointSize())
+        {
+            put<uint32_t>(buffer, points);
+
+            // The byte length is filled in once the frame is written, so
+            // that a compressed frame is written in place.
+            const std::size_t lengthPos(buffer.size());
+            put<uint32_t>(buffer, 0);
+
+            if (m_compressFrames)
+            {
+                CompressionSink sink;
+                sink.target(&buffer);
+
+                pdal::LazPerfCompressor<CompressionSink> compressor(
+                        sink,
+                        m_schema.pdalLayout().dimTypes());
+
+                compressor.compress(m_chunk->data(), m_chunk->size());
+                compressor.done();
+            }
+            else buffer.insert(buffer.end(), m_chunk->begin(), m_chunk->end());
+
+            set<uint32_t>(buffer, lengthPos, buffer.size() - lengthPos - 4);
+        }
+
+        if (m_done)
+        {
+            put<uint32_t>(buffer, 0);
+            put<uint32_t>(buffer, 0);
+            put<uint64_t>(buffer, numPoints());
+        }
+    }
+
+    void readArrow(std::vector<char>& buffer)
+    {
+        if (!m_started)
+        {
+            m_started = true;
+            arrow::writeSchema(buffer, m_schema);
+        }
+
+        m_chunk->clear();
+        m_done = readSome(*m_chunk);
+
+        if (m_chunk->size() >= m_schema.pointSize())
+        {
+            arrow::writeBatch(buffer, m_schema, *m_chunk);
+        }
+
+        if (m_done) arrow::writeEnd(buffer);
+    }
+
+    void readLas(std::vector<char>& buffer)
+    {
+        if (!m_started)
+        {
+            m_started = true;
+            las::writeHeader(buffer, m_las);
+        }
+
+        m_chunk->clear();
+        m_done = readSome(*m_chunk);
+        las::pack(*m_chunk, m_las.rgb, buffer);
+    }
+
+    template<typename T>
+    static void put(std::vector<char>& buffer, T v)
+    {
+        for (std::size_t i(0); i < sizeof(T); ++i)
+        {
+            buffer.push_back(static_cast<char>((v >> (i * 8)) & 0xFF));
+        }
+    }
+
+    template<typename T>
+    static void set(std::vector<char>& buffer, std::size_t pos, T v)
+    {
+        for (std::size_t i(0); i < sizeof(T); ++i)
+        {
+            buffer[pos + i] = static_cast<char>((v >> (i * 8)) & 0xFF);
+        }
+    }
+
+    CompressionSink m_sink;
+    std::unique_ptr<pdal::LazPerfCompressor<CompressionSink>> m_compressor;
 
     const entwine::Schema& m_schema;
     bool m_done;
+
+    ReadFormat m_format;
+    bool m_compressFrames;
+    bool m_started;
+    PooledBuffer m_chunk;
+    las::Header m_las;
 };
 
@@ -8,23 +8,53 @@
 class EntwineReadQuery : public ReadQuery
 {
 public:
-    EntwineReadQuery(bool compress, std::unique_ptr<entwine::Query> query)
+    EntwineReadQuery(
+            bool compress,
+            std::shared_ptr<entwine::Reader> reader,
+            std::unique_ptr<entwine::Query> query)
         : ReadQuery(query->schema(), compress)
-        , m_query(std::move(query))
+        , m_reader(reader)
+        , m_current(0)
+    {
+        m_queries.push_back(std::move(query));
+    }
+
+    // Streams the results of several queries, in order, as one response.
+    // Each query must have been created with "schema".
+    EntwineReadQuery(
+            bool compress,
+            std::shared_ptr<entwine::Reader> reader,
+            const entwine::Schema& schema,
+            std::vector<std::unique_ptr<entwine::Query>> queries)
+        : ReadQuery(schema, compress)
+        , m_reader(reader)
+        , m_queries(std::move(queries))
+        , m_current(0)
     { }
 
 private:
     virtual bool readSome(std::vector<char>& buffer) override
     {
-        m_query->next(buffer);
-        return m_query->done();
+        if (m_current < m_queries.size())
+        {
+            entwine::Query& query(*m_queries[m_current]);
+            query.next(buffer);
+            if (query.done()) ++m_current;
+        }
+
+        return m_current == m_queries.size();
     }
 
     virtual uint64_t numPoints() const override
     {
-        return m_query->numPoints();
+        uint64_t n(0);
+        for (const auto& query : m_queries) n += query->numPoints();
+        return n;
     }
 
-    std::unique_ptr<entwine::Query> m_query;
+    // The reader must outlive the queries, even if its session is released.
+    std::shared_ptr<entwine::Reader> m_reader;
+    std::vector<std::unique_ptr<entwine::Query>> m_queries;
+    std::size_t m_current;
 };
 
@@ -1,5 +1,8 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <thread>
 
 #include <json/json.h>
 
@@ -16,12 +19,28 @@
 #include <entwine/util/executor.hpp>
 
 #include "read-queries/entwine.hpp"
+#include "types/boxes.hpp"
+#include "types/chunk-caches.hpp"
 #include "types/buffer-pool.hpp"
+#include "types/hash.hpp"
+#include "types/hierarchy.hpp"
+#include "types/hierarchy-index.hpp"
+#include "types/key.hpp"
+#include "types/node-set.hpp"
+#include "types/snapshot.hpp"
+#include "types/thread-pool.hpp"
 
 #include "session.hpp"
 
 namespace
 {
+    // Name of the top-level index metadata file, which is also the source of
+    // the version against which snapshots are validated.
+    const std::string metadataFile("entwine");
+
+    // Deepest range a point budget query will consider, if unbounded.
+    const std::size_t budgetDepths(32);
+
     std::string getTypeString(const entwine::Structure& structure)
     {
         if (structure.dimensions() == 2)
@@ -35,124 +54,1017 @@ namespace
         }
         else
         {
-            throw std::runtime_error("Invalid structure");
+            throw std::runtime_error("Invalid structure");
+        }
+    }
+
+    Json::Value getInfo(const entwine::Metadata& metadata)
+    {
+        Json::Value json;
+
+        const std::size_t numPoints(
+                metadata.manifest().pointStats().inserts());
+
+        json["type"] = getTypeString(metadata.structure());
+        json["numPoints"] = static_cast<Json::UInt64>(numPoints);
+        json["schema"] = metadata.schema().toJson();
+        json["bounds"] = metadata.boundsNativeCubic().toJson();
+        json["boundsConforming"] = metadata.boundsNativeConforming().toJson();
+        json["srs"] = metadata.srs();
+        json["baseDepth"] = static_cast<Json::UInt64>(
+                metadata.structure().nullDepthEnd());
+
+        if (const entwine::Reprojection* r = metadata.reprojection())
+        {
+            json["reprojection"] = r->toJson();
+        }
+
+        if (const entwine::Delta* delta = metadata.delta())
+        {
+            const entwine::Point& scale(delta->scale());
+
+            if (scale.x == scale.y && scale.x == scale.z)
+            {
+                json["scale"] = scale.x;
+            }
+            else
+            {
+                json["scale"] = scale.toJsonArray();
+            }
+
+            json["offset"] = delta->offset().toJsonArray();
+        }
+
+        return json;
+    }
+
+    // A reader holds every point of its base depths in memory, so estimate
+    // its footprint as the smaller of the number of points in the resource
+    // and the number of cells in those depths.
+    std::size_t estimateSize(const entwine::Metadata& metadata)
+    {
+        const entwine::Structure& structure(metadata.structure());
+        const std::size_t bits(structure.dimensions() == 3 ? 3 : 2);
+        const uint64_t numPoints(metadata.manifest().pointStats().inserts());
+
+        uint64_t cells(0);
+        for (
+                std::size_t depth(structure.nullDepthEnd());
+                depth < structure.baseDepthEnd() && cells < numPoints;
+                ++depth)
+        {
+            if (depth * bits >= 62) cells = numPoints;
+            else cells += static_cast<uint64_t>(1) << (depth * bits);
+        }
+
+        return std::min(cells, numPoints) * metadata.schema().pointSize();
+    }
+
+    // Splits a read into the parts of the tree that hold points outside of
+    // a set of nodes held by the client.  Whole subtrees without any held
+    // nodes are read with a single query, so the number of queries grows
+    // with the boundary of the held set rather than with the number of
+    // nodes read.
+    class DeltaTraversal
+    {
+    public:
+        struct Range
+        {
+            entwine::Bounds bounds;
+            std::size_t depthBegin;
+            std::size_t depthEnd;
+        };
+
+        DeltaTraversal(
+                const Session& session,
+                const entwine::Bounds& bounds,
+                std::size_t depthBegin,
+                std::size_t depthEnd,
+                const NodeSet& exclude,
+                const entwine::Scale* scale,
+                const entwine::Offset* offset,
+                bool is3d)
+            : m_session(session)
+            , m_bounds(bounds)
+            , m_depthBegin(depthBegin)
+            , m_depthEnd(depthEnd)
+            , m_exclude(exclude)
+            , m_scale(scale)
+            , m_offset(offset)
+            , m_is3d(is3d)
+        { }
+
+        std::vector<Range> run(const Key& root, const entwine::Bounds& cell)
+        {
+            std::vector<Range> out;
+            const Json::Value tree(fetch(cell, root.depth));
+
+            if (
+                    relevant(tree, cell, root.depth) &&
+                    visit(root, cell, tree, fetchDepths, out))
+            {
+                out.push_back(whole(cell, root.depth));
+            }
+
+            return out;
+        }
+
+    private:
+        // Depths of hierarchy fetched at a time during the traversal.
+        static constexpr std::size_t fetchDepths = 4;
+
+        Json::Value fetch(const entwine::Bounds& cell, std::size_t depth) const
+        {
+            return m_session.hierarchy(
+                    &cell,
+                    depth,
+                    depth + fetchDepths,
+                    false,
+                    m_scale,
+                    m_offset);
+        }
+
+        // The whole subtree of a cell, from "depth" down.
+        Range whole(const entwine::Bounds& cell, std::size_t depth) const
+        {
+            return Range {
+                boxes::intersect(cell, m_bounds),
+                std::max(depth, m_depthBegin),
+                m_depthEnd
+            };
+        }
+
+        bool within(std::size_t depth) const
+        {
+            return !m_depthEnd || depth < m_depthEnd;
+        }
+
+        // True if this node, and therefore its subtree, may hold points that
+        // this read selects.
+        bool relevant(
+                const Json::Value& tree,
+                const entwine::Bounds& cell,
+                std::size_t depth) const
+        {
+            return
+                tree.isObject() && tree["n"].asUInt64() &&
+                within(depth) && cell.overlaps(m_bounds);
+        }
+
+        // Returns true if nothing in this subtree is excluded, in which case
+        // nothing has been collected for it.
+        bool visit(
+                const Key& key,
+                const entwine::Bounds& cell,
+                Json::Value tree,
+                std::size_t levels,
+                std::vector<Range>& out)
+        {
+            if (!relevant(tree, cell, key.depth)) return true;
+
+            const bool excluded(
+                    key.depth >= m_depthBegin && m_exclude.contains(key));
+
+            if (levels == 1 && within(key.depth + 1))
+            {
+                tree = fetch(cell, key.depth);
+                levels = fetchDepths;
+            }
+
+            std::vector<Range> clean;
+            bool dirty(excluded);
+
+            for (unsigned int c(0); c < (m_is3d ? 8u : 4u); ++c)
+            {
+                const std::string dir(hierarchy::direction(c, m_is3d));
+                if (levels == 1 || !tree.isMember(dir)) continue;
+
+                const Key child(key.child(c));
+                const entwine::Bounds bounds(hierarchy::bisect(cell, dir));
+                const Json::Value& sub(tree[dir]);
+
+                if (!relevant(sub, bounds, child.depth)) continue;
+
+                if (visit(child, bounds, sub, levels - 1, out))
+                {
+                    clean.push_back(whole(bounds, child.depth));
+                }
+                else dirty = true;
+            }
+
+            if (!dirty) return true;
+
+            if (!excluded && key.depth >= m_depthBegin)
+            {
+                out.push_back(
+                        Range {
+                            boxes::intersect(cell, m_bounds),
+                            key.depth,
+                            key.depth + 1
+                        });
+            }
+
+            out.insert(out.end(), clean.begin(), clean.end());
+            return false;
+        }
+
+        const Session& m_session;
+        const entwine::Bounds& m_bounds;
+        const std::size_t m_depthBegin;
+        const std::size_t m_depthEnd;
+        const NodeSet& m_exclude;
+        const entwine::Scale* m_scale;
+        const entwine::Offset* m_offset;
+        const bool m_is3d;
+    };
+}
+
+struct Session::State
+{
+    std::string path;
+    std::string version;
+    std::shared_ptr<entwine::arbiter::Endpoint> endpoint;
+    Json::Value info;
+
+    // Hierarchy of the full bounds for depths [hierarchyBegin,
+    // hierarchyEnd), if present.
+    Json::Value hierarchy;
+    std::size_t hierarchyBegin = 0;
+    std::size_t hierarchyEnd = 0;
+
+    std::mutex readerMutex;
+    std::shared_ptr<entwine::Reader> reader;
+    std::size_t readerBytes = 0;
+
+    // Set once by a background build, and never replaced.
+    std::mutex indexMutex;
+    bool indexing = false;
+    std::unique_ptr<HierarchyIndex> index;
+
+    bool indexed() const { return !info.isNull(); }
+};
+
+Session::Session(
+        const std::string name,
+        const std::vector<std::string>& paths,
+        entwine::OuterScope& outerScope,
+        ChunkCaches& caches,
+        const SnapshotStore* snapshots,
+        const HierarchyOptions& hierarchyOptions)
+    : m_name(name)
+    , m_paths(paths)
+    , m_outerScope(outerScope)
+    , m_caches(caches)
+    , m_snapshots(snapshots)
+    , m_hierarchyOptions(hierarchyOptions)
+    , m_hierarchyCache(hierarchyOptions.cache)
+{ }
+
+Session::~Session()
+{ }
+
+bool Session::initialize()
+{
+    std::call_once(m_initOnce, [this]()
+    {
+        std::cout << "Discovering " << m_name << std::endl;
+
+        std::shared_ptr<State> s(resolve());
+
+        if (!s)
+        {
+            std::cout << "\tBacking for " << m_name << " NOT found" <<
+                std::endl;
+            return;
+        }
+
+        std::cout << "\tIndex for " << m_name << " found" << std::endl;
+
+        if (load(*s))
+        {
+            std::lock_guard<std::mutex> lock(m_stateMutex);
+            m_state = s;
+        }
+    });
+
+    const std::shared_ptr<State> s(state());
+    return s && s->indexed();
+}
+
+Json::Value Session::reload()
+{
+    std::lock_guard<std::mutex> reloadLock(m_reloadMutex);
+
+    const std::shared_ptr<State> current(check());
+
+    std::cout << "Reloading " << m_name << std::endl;
+
+    std::shared_ptr<State> next(resolve());
+    if (!next) throw std::runtime_error("Could not resolve " + m_name);
+
+    Json::Value result;
+    result["version"] = next->version;
+    result["reloaded"] = false;
+
+    if (next->version == current->version && next->path == current->path)
+    {
+        std::cout << "\tUnchanged" << std::endl;
+        return result;
+    }
+
+    if (!load(*next)) throw std::runtime_error("Could not reload " + m_name);
+
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_state = next;
+    }
+
+    // Results of the previous version can no longer be hit.
+    if (m_hierarchyCache) m_hierarchyCache->clear(resultPrefix(*current));
+
+    std::cout << "\tReloaded " << m_name << " at version " << next->version <<
+        std::endl;
+
+    result["reloaded"] = true;
+    return result;
+}
+
+std::shared_ptr<Session::State> Session::state() const
+{
+    std::lock_guard<std::mutex> lock(m_stateMutex);
+    return m_state;
+}
+
+std::shared_ptr<Session::State> Session::check() const
+{
+    std::shared_ptr<State> s(state());
+    if (!s || !s->indexed())
+    {
+        throw std::runtime_error("Session was not created");
+    }
+    return s;
+}
+
+bool Session::load(State& s) const
+{
+    if (loadSnapshot(s))
+    {
+        std::cout << "\tLoaded snapshot for " << m_name << std::endl;
+        return true;
+    }
+
+    try
+    {
+        s.info = getInfo(reader(s)->metadata());
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << "\tFailed to open " << m_name << ": " << e.what() <<
+            std::endl;
+        return false;
+    }
+
+    if (!m_snapshots) return true;
+
+    try
+    {
+        const auto r(reader(s));
+        const entwine::Metadata& metadata(r->metadata());
+
+        s.hierarchyBegin = metadata.structure().nullDepthEnd();
+        s.hierarchyEnd = s.hierarchyBegin + m_snapshots->hierarchyDepth();
+        s.hierarchy = r->hierarchy(
+                metadata.boundsCubic(),
+                s.hierarchyBegin,
+                s.hierarchyEnd,
+                false,
+                nullptr,
+                nullptr);
+
+        saveSnapshot(s);
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << "\tCould not snapshot " << m_name << ": " <<
+            e.what() << std::endl;
+        s.hierarchy = Json::nullValue;
+    }
+
+    return true;
+}
+
+std::shared_ptr<Session::State> Session::pin() const
+{
+    return check();
+}
+
+Json::Value Session::info() const
+{
+    return check()->info;
+}
+
+Json::Value Session::info(const State& pinned) const
+{
+    return pinned.info;
+}
+
+Json::Value Session::hierarchy(
+        const entwine::Bounds* inBounds,
+        const std::size_t depthBegin,
+        const std::size_t depthEnd,
+        const bool vertical,
+        const entwine::Scale* scale,
+        const entwine::Offset* offset) const
+{
+    const std::shared_ptr<State> s(check());
+
+    if (
+            auto h = snapshotHierarchy(
+                *s,
+                inBounds,
+                depthBegin,
+                depthEnd,
+                vertical))
+    {
+        return *h;
+    }
+
+    const entwine::Bounds nativeBounds(reader(*s)->metadata().boundsCubic());
+    const entwine::Delta delta(scale, offset);
+    const entwine::Bounds cubic(nativeBounds.deltify(delta));
+    const entwine::Bounds bounds(inBounds ? *inBounds : cubic);
+
+    const auto key(
+            Key::fromBounds(
+                cubic,
+                bounds,
+                depthBegin,
+                s->info["baseDepth"].asUInt64(),
+                s->info["type"].asString() == "octree"));
+
+    const HierarchyIndex* index(
+            key ? hierarchyIndex(s, depthBegin, depthEnd) : nullptr);
+
+    if (index)
+    {
+        ++m_hierarchyOptions.indexStats->answered;
+        return vertical ?
+            index->vertical(*key, depthEnd) :
+            index->hierarchy(*key, depthEnd);
+    }
+
+    return computeHierarchy(
+            *s,
+            bounds,
+            depthBegin,
+            depthEnd,
+            vertical,
+            scale,
+            offset);
+}
+
+Json::Value Session::hierarchyBatch(
+        const Json::Value& queries,
+        const std::size_t depths,
+        const bool vertical,
+        const entwine::Scale* scale,
+        const entwine::Offset* offset) const
+{
+    const std::shared_ptr<State> s(check());
+
+    if (!queries.isArray())
+    {
+        throw std::runtime_error("Batch requires a \"queries\" array");
+    }
+
+    const entwine::Bounds nativeBounds(reader(*s)->metadata().boundsCubic());
+    const entwine::Delta delta(scale, offset);
+    const entwine::Bounds cubic(nativeBounds.deltify(delta));
+    const std::size_t baseDepth(s->info["baseDepth"].asUInt64());
+    const bool is3d(s->info["type"].asString() == "octree");
+
+    struct Request
+    {
+        Request(const entwine::Bounds& bounds) : bounds(bounds) { }
+
+        std::unique_ptr<Key> key;
+        entwine::Bounds bounds;
+        std::size_t depthBegin = 0;
+        std::size_t depthEnd = 0;
+    };
+
+    std::vector<Request> requests;
+    requests.reserve(queries.size());
+
+    for (const Json::Value& q : queries)
+    {
+        if (q.isString())
+        {
+            if (!depths) throw std::runtime_error("Node keys require depths");
+
+            const Key key(Key::parse(q.asString()));
+            requests.emplace_back(key.bounds(cubic, baseDepth, is3d));
+
+            Request& r(requests.back());
+            r.key = entwine::makeUnique<Key>(key);
+            r.depthBegin = key.depth;
+            r.depthEnd = key.depth + depths;
+        }
+        else if (q.isObject())
+        {
+            if (boxes::isMulti(q["bounds"]))
+            {
+                throw std::runtime_error(
+                        "Multiple bounds are only valid for read");
+            }
+
+            requests.emplace_back(
+                    q.isMember("bounds") ?
+                        entwine::Bounds(q["bounds"]) : cubic);
+
+            Request& r(requests.back());
+
+            if (q.isMember("depth"))
+            {
+                r.depthBegin = q["depth"].asUInt64();
+                r.depthEnd = r.depthBegin + 1;
+            }
+            else
+            {
+                r.depthBegin = q["depthBegin"].asUInt64();
+                r.depthEnd = q["depthEnd"].asUInt64();
+            }
+
+            r.key = Key::fromBounds(
+                    cubic,
+                    r.bounds,
+                    r.depthBegin,
+                    baseDepth,
+                    is3d);
+        }
+        else
+        {
+            throw std::runtime_error("Invalid hierarchy batch query");
+        }
+    }
+
+    Json::Value results(Json::arrayValue);
+    results.resize(requests.size());
+
+    // Requests which the index can't answer are grouped by their parent
+    // node and depth range, so each group of siblings is traversed once.
+    std::map<std::string, std::vector<std::size_t>> groups;
+
+    for (std::size_t i(0); i < requests.size(); ++i)
+    {
+        const Request& r(requests[i]);
+        const HierarchyIndex* index(
+                r.key ? hierarchyIndex(s, r.depthBegin, r.depthEnd) : nullptr);
+
+        if (index)
+        {
+            ++m_hierarchyOptions.indexStats->answered;
+            results[Json::ArrayIndex(i)] = vertical ?
+                index->vertical(*r.key, r.depthEnd) :
+                index->hierarchy(*r.key, r.depthEnd);
+        }
+        else if (r.key && r.depthBegin > baseDepth)
+        {
+            const Key parent(
+                    r.key->depth - 1,
+                    r.key->x / 2,
+                    r.key->y / 2,
+                    r.key->z / 2);
+
+            groups[parent.toString() + "/" + std::to_string(r.depthEnd)]
+                .push_back(i);
+        }
+        else
+        {
+            results[Json::ArrayIndex(i)] = computeHierarchy(
+                    *s,
+                    r.bounds,
+                    r.depthBegin,
+                    r.depthEnd,
+                    vertical,
+                    scale,
+                    offset);
+        }
+    }
+
+    for (const auto& group : groups)
+    {
+        const std::vector<std::size_t>& members(group.second);
+        const Request& first(requests[members.front()]);
+
+        if (members.size() == 1)
+        {
+            results[Json::ArrayIndex(members.front())] = computeHierarchy(
+                    *s,
+                    first.bounds,
+                    first.depthBegin,
+                    first.depthEnd,
+                    vertical,
+                    scale,
+                    offset);
+            continue;
+        }
+
+        const Key parent(
+                first.key->depth - 1,
+                first.key->x / 2,
+                first.key->y / 2,
+                first.key->z / 2);
+
+        const Json::Value tree(
+                computeHierarchy(
+                    *s,
+                    parent.bounds(cubic, baseDepth, is3d),
+                    parent.depth,
+                    first.depthEnd,
+                    false,
+                    scale,
+                    offset));
+
+        for (const std::size_t i : members)
+        {
+            const Key& key(*requests[i].key);
+            const unsigned int c(
+                    (key.x & 1) | ((key.y & 1) << 1) | ((key.z & 1) << 2));
+            const std::string dir(hierarchy::direction(c, is3d));
+
+            const Json::Value child(
+                    tree.isObject() && tree.isMember(dir) ?
+                        tree[dir] : Json::nullValue);
+
+            if (vertical)
+            {
+                Json::Value counts(Json::arrayValue);
+                counts.resize(first.depthEnd - key.depth);
+                for (auto& v : counts) v = 0;
+
+                if (!child.isNull()) hierarchy::flatten(child, counts);
+                results[Json::ArrayIndex(i)] = counts;
+            }
+            else
+            {
+                results[Json::ArrayIndex(i)] = child;
+            }
+        }
+    }
+
+    return results;
+}
+
+Json::Value Session::computeHierarchy(
+        State& s,
+        const entwine::Bounds& bounds,
+        const std::size_t depthBegin,
+        const std::size_t depthEnd,
+        const bool vertical,
+        const entwine::Scale* scale,
+        const entwine::Offset* offset) const
+{
+    const std::size_t parallelDepth(m_hierarchyOptions.parallelDepth);
+
+    if (
+            m_hierarchyOptions.pool &&
+            parallelDepth &&
+            depthEnd > depthBegin &&
+            depthEnd - depthBegin >= parallelDepth)
+    {
+        return parallelHierarchy(
+                s,
+                bounds,
+                depthBegin,
+                depthEnd,
+                vertical,
+                scale,
+                offset);
+    }
+
+    return serialHierarchy(
+            s,
+            bounds,
+            depthBegin,
+            depthEnd,
+            vertical,
+            scale,
+            offset);
+}
+
+Json::Value Session::parallelHierarchy(
+        State& s,
+        const entwine::Bounds& bounds,
+        const std::size_t depthBegin,
+        const std::size_t depthEnd,
+        const bool vertical,
+        const entwine::Scale* scale,
+        const entwine::Offset* offset) const
+{
+    Json::Value result(
+            serialHierarchy(
+                s,
+                bounds,
+                depthBegin,
+                depthBegin + 1,
+                vertical,
+                scale,
+                offset));
+
+    const Json::Value& top(result);
+    if (top.isNull()) return result;
+
+    const uint64_t n(vertical ? top[0].asUInt64() : top["n"].asUInt64());
+    if (!n) return result;
+
+    const bool is3d(s.info["type"].asString() == "octree");
+    const unsigned int numChildren(is3d ? 8 : 4);
+
+    std::vector<Json::Value> children(numChildren);
+    TaskGroup group(*m_hierarchyOptions.pool);
+
+    for (unsigned int c(0); c < numChildren; ++c)
+    {
+        Json::Value& child(children[c]);
+        const entwine::Bounds childBounds(
+                hierarchy::bisect(bounds, hierarchy::direction(c, is3d)));
+
+        group.add([&, childBounds]()
+        {
+            child = serialHierarchy(
+                    s,
+                    childBounds,
+                    depthBegin + 1,
+                    depthEnd,
+                    vertical,
+                    scale,
+                    offset);
+        });
+    }
+
+    group.wait();
+
+    if (vertical)
+    {
+        result.resize(depthEnd - depthBegin);
+
+        for (const Json::Value& child : children)
+        {
+            for (Json::ArrayIndex i(0); i < child.size(); ++i)
+            {
+                result[i + 1] = result[i + 1].asUInt64() + child[i].asUInt64();
+            }
+        }
+    }
+    else
+    {
+        for (unsigned int c(0); c < numChildren; ++c)
+        {
+            const Json::Value& child(children[c]);
+            if (child.isObject() && child["n"].asUInt64())
+            {
+                result[hierarchy::direction(c, is3d)] = child;
+            }
         }
     }
+
+    return result;
 }
 
-Session::Session(
-        const std::string name,
-        const std::vector<std::string>& paths,
-        entwine::OuterScope& outerScope,
-        entwine::Cache& cache)
-    : m_name(name)
-    , m_paths(paths)
-    , m_outerScope(outerScope)
-    , m_cache(cache)
-{ }
+Json::Value Session::serialHierarchy(
+        State& s,
+        const entwine::Bounds& bounds,
+        const std::size_t depthBegin,
+        const std::size_t depthEnd,
+        const bool vertical,
+        const entwine::Scale* scale,
+        const entwine::Offset* offset) const
+{
+    if (!m_hierarchyCache)
+    {
+        return reader(s)->hierarchy(
+                bounds,
+                depthBegin,
+                depthEnd,
+                vertical,
+                scale,
+                offset);
+    }
 
-Session::~Session()
-{ }
+    return cachedHierarchy(
+            s,
+            bounds,
+            depthBegin,
+            depthEnd,
+            vertical,
+            scale,
+            offset);
+}
 
-bool Session::initialize()
+const HierarchyIndex* Session::hierarchyIndex(
+        const std::shared_ptr<State>& s,
+        const std::size_t depthBegin,
+        const std::size_t depthEnd) const
 {
-    std::call_once(m_initOnce, [this]()
+    const std::size_t indexDepth(m_hierarchyOptions.indexDepth);
+    const std::size_t begin(s->info["baseDepth"].asUInt64());
+
+    if (
+            !indexDepth ||
+            depthBegin < begin ||
+            depthEnd <= depthBegin ||
+            depthEnd > begin + indexDepth)
     {
-        std::cout << "Discovering " << m_name << std::endl;
+        return nullptr;
+    }
 
-        if (resolveIndex())
-        {
-            std::cout << "\tIndex for " << m_name << " found" << std::endl;
+    std::lock_guard<std::mutex> lock(s->indexMutex);
+    if (s->index || s->indexing) return s->index.get();
 
-            Json::Value json;
-            const entwine::Metadata& metadata(m_entwine->metadata());
+    // The build may outlive both this query and a reload, so it holds on to
+    // this session and its state.
+    s->indexing = true;
+    std::shared_ptr<const Session> self(shared_from_this());
+    std::shared_ptr<State> state(s);
+    std::thread([self, state]() { self->buildIndex(*state); }).detach();
 
-            const std::size_t numPoints(
-                    metadata.manifest().pointStats().inserts());
+    return nullptr;
+}
 
-            json["type"] = getTypeString(metadata.structure());
-            json["numPoints"] = static_cast<Json::UInt64>(numPoints);
-            json["schema"] = metadata.schema().toJson();
-            json["bounds"] = metadata.boundsNativeCubic().toJson();
-            json["boundsConforming"] =
-                metadata.boundsNativeConforming().toJson();
-            json["srs"] = metadata.srs();
-            json["baseDepth"] = static_cast<Json::UInt64>(
-                    metadata.structure().nullDepthEnd());
+void Session::buildIndex(State& s) const
+{
+    HierarchyIndexStats& stats(*m_hierarchyOptions.indexStats);
 
-            if (const entwine::Reprojection* r = metadata.reprojection())
-            {
-                json["reprojection"] = r->toJson();
-            }
+    const uint64_t version(fnv1a(s.version));
+    const std::string path(m_snapshots ? m_snapshots->indexPath(m_name) : "");
 
-            if (const entwine::Delta* delta = metadata.delta())
-            {
-                const entwine::Point& scale(delta->scale());
+    const std::size_t begin(s.info["baseDepth"].asUInt64());
+    const std::size_t end(begin + m_hierarchyOptions.indexDepth);
+    const bool is3d(s.info["type"].asString() == "octree");
 
-                if (scale.x == scale.y && scale.x == scale.z)
-                {
-                    json["scale"] = scale.x;
-                }
-                else
-                {
-                    json["scale"] = scale.toJsonArray();
-                }
+    std::unique_ptr<HierarchyIndex> index;
+    bool opened(false);
 
-                json["offset"] = delta->offset().toJsonArray();
-            }
+    try
+    {
+        if (!path.empty()) index = HierarchyIndex::open(path, version);
 
-            m_info = json;
-        }
-        else
+        // An index stored with other depths is rebuilt.
+        opened =
+            index && index->depthBegin() == begin && index->depthEnd() == end;
+
+        if (!opened)
         {
-            std::cout << "\tBacking for " << m_name << " NOT found" <<
-                std::endl;
+            index.reset();
+
+            std::cout << "Indexing hierarchy for " << m_name << std::endl;
+
+            std::unique_ptr<Json::Value> full(
+                    snapshotHierarchy(s, nullptr, begin, end, false));
+
+            if (!full)
+            {
+                full = entwine::makeUnique<Json::Value>(
+                        computeHierarchy(
+                            s,
+                            reader(s)->metadata().boundsCubic(),
+                            begin,
+                            end,
+                            false,
+                            nullptr,
+                            nullptr));
+            }
+
+            index = HierarchyIndex::create(
+                    *full,
+                    begin,
+                    end,
+                    is3d,
+                    version,
+                    path);
+
+            std::cout << "\tIndexed " << index->numNodes() << " nodes in " <<
+                index->size() << " bytes" << std::endl;
         }
-    });
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << "\tCould not index hierarchy for " << m_name << ": " <<
+            e.what() << std::endl;
+        return;
+    }
+    catch (...)
+    {
+        // This runs on its own thread, so nothing may escape.
+        std::cout << "\tCould not index hierarchy for " << m_name << std::endl;
+        return;
+    }
 
-    return !!m_entwine;
-}
+    {
+        std::lock_guard<std::mutex> lock(s.indexMutex);
+        s.index = std::move(index);
+    }
 
-Json::Value Session::info() const
-{
-    check();
-    return m_info;
+    ++(opened ? stats.opened : stats.built);
 }
 
-Json::Value Session::hierarchy(
-        const entwine::Bounds* inBounds,
+Json::Value Session::cachedHierarchy(
+        State& s,
+        const entwine::Bounds& bounds,
         const std::size_t depthBegin,
         const std::size_t depthEnd,
         const bool vertical,
         const entwine::Scale* scale,
         const entwine::Offset* offset) const
 {
-    check();
-    const auto& nativeBounds(m_entwine->metadata().boundsCubic());
-    const entwine::Delta delta(scale, offset);
-    const entwine::Bounds bounds(
-            inBounds ? *inBounds : nativeBounds.deltify(delta));
+    Json::Value json;
+    json["bounds"] = bounds.toJson();
+    json["depthBegin"] = static_cast<Json::UInt64>(depthBegin);
+    json["depthEnd"] = static_cast<Json::UInt64>(depthEnd);
+    if (vertical) json["vertical"] = true;
+    if (scale) json["scale"] = scale->toJsonArray();
+    if (offset) json["offset"] = offset->toJsonArray();
 
-    return m_entwine->hierarchy(
-            bounds,
-            depthBegin,
-            depthEnd,
-            vertical,
-            scale,
-            offset);
+    const std::string key(resultPrefix(s) + Json::FastWriter().write(json));
+
+    if (HierarchyCache::Result cached = m_hierarchyCache->get(key))
+    {
+        return *cached;
+    }
+
+    HierarchyCache::Result result(
+            std::make_shared<const Json::Value>(
+                reader(s)->hierarchy(
+                    bounds,
+                    depthBegin,
+                    depthEnd,
+                    vertical,
+                    scale,
+                    offset)));
+
+    m_hierarchyCache->set(key, result, hierarchy::estimateSize(*result));
+    return *result;
+}
+
+std::string Session::resultPrefix(const State& s) const
+{
+    return m_name + '\0' + s.version + '\0';
+}
+
+std::unique_ptr<Json::Value> Session::snapshotHierarchy(
+        const State& s,
+        const entwine::Bounds* bounds,
+        const std::size_t depthBegin,
+        const std::size_t depthEnd,
+        const bool vertical) const
+{
+    std::unique_ptr<Json::Value> result;
+
+    // Only full-bounds queries may be answered, since hierarchy nesting is
+    // relative to the queried bounds and starting depth.  A scale and offset
+    // without explicit bounds don't change the counts.
+    if (
+            bounds ||
+            s.hierarchy.isNull() ||
+            depthBegin != s.hierarchyBegin ||
+            depthEnd <= depthBegin ||
+            depthEnd > s.hierarchyEnd)
+    {
+        return result;
+    }
+
+    const std::size_t levels(depthEnd - depthBegin);
+
+    if (vertical)
+    {
+        Json::Value counts(Json::arrayValue);
+        counts.resize(levels);
+        for (auto& c : counts) c = 0;
+
+        hierarchy::flatten(s.hierarchy, counts);
+        result = entwine::makeUnique<Json::Value>(counts);
+    }
+    else
+    {
+        result = entwine::makeUnique<Json::Value>(
+                hierarchy::prune(s.hierarchy, levels));
+    }
+
+    return result;
 }
 
-Json::Value Session::filesSingle(const Json::Value& in) const
+Json::Value Session::filesSingle(State& s, const Json::Value& in) const
 {
     Json::Value result;
     if (in.isNumeric())
     {
-        try { return m_entwine->files(in.asUInt64()).toJson(); }
+        try { return reader(s)->files(in.asUInt64()).toJson(); }
         catch (...) { return Json::nullValue; }
     }
     else if (in.isString())
     {
-        try { return m_entwine->files(in.asString()).toJson(); }
+        try { return reader(s)->files(in.asString()).toJson(); }
         catch (...) { return Json::nullValue; }
     }
     else
@@ -163,15 +1075,17 @@ Json::Value Session::filesSingle(const Json::Value& in) const
 
 Json::Value Session::files(const Json::Value& search) const
 {
+    const std::shared_ptr<State> s(check());
+
     if (search.isArray())
     {
         Json::Value result;
-        for (const auto& f : search) result.append(filesSingle(f));
+        for (const auto& f : search) result.append(filesSingle(*s, f));
         return result;
     }
     else
     {
-        return filesSingle(search);
+        return filesSingle(*s, search);
     }
 }
 
@@ -180,7 +1094,8 @@ Json::Value Session::files(
         const entwine::Scale* scale,
         const entwine::Offset* offset) const
 {
-    const auto fileInfo(m_entwine->files(bounds, scale, offset));
+    const std::shared_ptr<State> s(check());
+    const auto fileInfo(reader(*s)->files(bounds, scale, offset));
     if (fileInfo.empty()) return Json::nullValue;
 
     const auto json(entwine::toJsonArrayOfObjects(fileInfo));
@@ -197,12 +1112,12 @@ std::shared_ptr<ReadQuery> Session::query(
         const std::size_t depthBegin,
         const std::size_t depthEnd)
 {
-    check();
+    const auto r(reader(*check()));
     std::unique_ptr<entwine::Query> q;
 
     if (inBounds)
     {
-        q = m_entwine->getQuery(
+        q = r->getQuery(
                 schema,
                 filter,
                 *inBounds,
@@ -213,7 +1128,7 @@ std::shared_ptr<ReadQuery> Session::query(
     }
     else
     {
-        q = m_entwine->getQuery(
+        q = r->getQuery(
                 schema,
                 filter,
                 depthBegin,
@@ -223,7 +1138,7 @@ std::shared_ptr<ReadQuery> Session::query(
     }
 
     return std::shared_ptr<ReadQuery>(
-            new EntwineReadQuery(compress, std::move(q)));
+            new EntwineReadQuery(compress, r, std::move(q)));
 }
 
 std::unique_ptr<ReadQuery> Session::getQuery(
@@ -234,17 +1149,18 @@ std::unique_ptr<ReadQuery> Session::getQuery(
         const entwine::Offset* offset,
         const entwine::Schema* inSchema,
         const Json::Value& filter,
-        const bool compress) const
+        const bool compress,
+        State* pinned) const
 {
-    check();
+    const auto r(reader(pinned ? *pinned : *check()));
     std::unique_ptr<entwine::Query> q;
 
     const entwine::Schema& schema(
-            inSchema ? *inSchema : m_entwine->metadata().schema());
+            inSchema ? *inSchema : r->metadata().schema());
 
     if (bounds)
     {
-        q = m_entwine->getQuery(
+        q = r->getQuery(
                 schema,
                 filter,
                 *bounds,
@@ -255,7 +1171,7 @@ std::unique_ptr<ReadQuery> Session::getQuery(
     }
     else
     {
-        q = m_entwine->getQuery(
+        q = r->getQuery(
                 schema,
                 filter,
                 depthBegin,
@@ -264,17 +1180,287 @@ std::unique_ptr<ReadQuery> Session::getQuery(
                 offset);
     }
 
-    return entwine::makeUnique<EntwineReadQuery>(compress, std::move(q));
+    return entwine::makeUnique<EntwineReadQuery>(compress, r, std::move(q));
+}
+
+std::unique_ptr<ReadQuery> Session::getDeltaQuery(
+        const entwine::Bounds* inBounds,
+        const std::size_t depthBegin,
+        const std::size_t depthEnd,
+        const NodeSet& exclude,
+        const entwine::Scale* scale,
+        const entwine::Offset* offset,
+        const entwine::Schema* inSchema,
+        const Json::Value& filter,
+        const bool compress) const
+{
+    const std::shared_ptr<State> s(check());
+    const auto r(reader(*s));
+
+    const std::size_t baseDepth(s->info["baseDepth"].asUInt64());
+    const bool is3d(s->info["type"].asString() == "octree");
+
+    const entwine::Bounds cubic(bounds(scale, offset));
+    const entwine::Bounds queryBounds(inBounds ? *inBounds : cubic);
+
+    DeltaTraversal traversal(
+            *this,
+            queryBounds,
+            depthBegin,
+            depthEnd,
+            exclude,
+            scale,
+            offset,
+            is3d);
+
+    const entwine::Schema& schema(
+            inSchema ? *inSchema : r->metadata().schema());
+
+    std::vector<std::unique_ptr<entwine::Query>> queries;
+
+    for (const auto& range : traversal.run(Key(baseDepth, 0, 0, 0), cubic))
+    {
+        queries.push_back(
+                r->getQuery(
+                    schema,
+                    filter,
+                    range.bounds,
+                    range.depthBegin,
+                    range.depthEnd,
+                    scale,
+                    offset));
+    }
+
+    return entwine::makeUnique<EntwineReadQuery>(
+            compress,
+            r,
+            schema,
+            std::move(queries));
+}
+
+std::unique_ptr<ReadQuery> Session::getBudgetQuery(
+        const entwine::Bounds* inBounds,
+        const std::size_t depthBegin,
+        const std::size_t depthEnd,
+        const uint64_t pointBudget,
+        const entwine::Scale* scale,
+        const entwine::Offset* offset,
+        const entwine::Schema* inSchema,
+        const Json::Value& filter,
+        const bool compress,
+        Json::Value& selection) const
+{
+    const std::shared_ptr<State> s(check());
+    const auto r(reader(*s));
+
+    const std::size_t baseDepth(s->info["baseDepth"].asUInt64());
+    const bool is3d(s->info["type"].asString() == "octree");
+
+    // Depths above the base depth hold no points.
+    const std::size_t first(std::max(depthBegin, baseDepth));
+    const std::size_t limit(depthEnd ? depthEnd : first + budgetDepths);
+
+    // Accumulate the counts of whole depths, a few at a time, until the
+    // budget is exceeded or the data runs out.
+    uint64_t total(0);
+    std::size_t end(first);
+    bool over(false);
+
+    while (end < limit && !over)
+    {
+        const std::size_t windowEnd(std::min(limit, end + 4));
+        const Json::Value counts(
+                hierarchy(inBounds, end, windowEnd, true, scale, offset));
+
+        bool any(false);
+
+        for (const Json::Value& count : counts)
+        {
+            const uint64_t n(count.asUInt64());
+            if (n) any = true;
+
+            if (total + n > pointBudget)
+            {
+                over = true;
+                break;
+            }
+
+            total += n;
+            ++end;
+        }
+
+        if (!any) break;
+    }
+
+    const entwine::Schema& schema(
+            inSchema ? *inSchema : r->metadata().schema());
+
+    std::vector<std::unique_ptr<entwine::Query>> queries;
+
+    if (end > depthBegin && total)
+    {
+        queries.push_back(
+                inBounds ?
+                    r->getQuery(
+                        schema,
+                        filter,
+                        *inBounds,
+                        depthBegin,
+                        end,
+                        scale,
+                        offset) :
+                    r->getQuery(
+                        schema,
+                        filter,
+                        depthBegin,
+                        end,
+                        scale,
+                        offset));
+    }
+
+    selection["depthBegin"] = static_cast<Json::UInt64>(depthBegin);
+    selection["depthEnd"] = static_cast<Json::UInt64>(end);
+
+    // Fill the remaining budget with cells of the depth that didn't fit,
+    // preferring the sparsest so that as much area as possible is refined.
+    // Cells are taken from a grid of limited resolution, so the number of
+    // candidates stays small regardless of depth.
+    const std::size_t levels(
+            over ? std::min<std::size_t>(end - baseDepth, is3d ? 4 : 6) : 0);
+
+    if (levels)
+    {
+        const entwine::Delta delta(scale, offset);
+        const entwine::Bounds bounds(
+                inBounds ?
+                    *inBounds :
+                    r->metadata().boundsCubic().deltify(delta));
+
+        const Json::Value tree(
+                hierarchy(
+                    inBounds,
+                    end - levels,
+                    end + 1,
+                    false,
+                    scale,
+                    offset));
+
+        std::vector<std::pair<uint64_t, entwine::Bounds>> cells;
+        hierarchy::leaves(tree, bounds, levels, cells);
+
+        std::sort(
+                cells.begin(),
+                cells.end(),
+                [](
+                    const std::pair<uint64_t, entwine::Bounds>& a,
+                    const std::pair<uint64_t, entwine::Bounds>& b)
+                {
+                    return a.first < b.first;
+                });
+
+        Json::Value selected(Json::arrayValue);
+        uint64_t partial(0);
+
+        for (const auto& cell : cells)
+        {
+            if (total + partial + cell.first > pointBudget) break;
+
+            partial += cell.first;
+            selected.append(cell.second.toJson());
+        }
+
+        if (selected.size())
+        {
+            const entwine::Bounds cellBounds(boxes::unionOf(selected));
+
+            queries.push_back(
+                    r->getQuery(
+                        schema,
+                        boxes::filter(selected, filter),
+                        cellBounds,
+                        end,
+                        end + 1,
+                        scale,
+                        offset));
+
+            total += partial;
+            selection["partialDepth"] = static_cast<Json::UInt64>(end);
+            selection["partialCells"] = selected.size();
+        }
+    }
+
+    selection["points"] = static_cast<Json::UInt64>(total);
+
+    return entwine::makeUnique<EntwineReadQuery>(
+            compress,
+            r,
+            schema,
+            std::move(queries));
+}
+
+entwine::Schema Session::schema() const
+{
+    return reader(*check())->metadata().schema();
+}
+
+std::string Session::version() const
+{
+    return check()->version;
+}
+
+entwine::Bounds Session::bounds(
+        const entwine::Scale* scale,
+        const entwine::Offset* offset,
+        State* pinned) const
+{
+    const entwine::Delta delta(scale, offset);
+    const auto r(reader(pinned ? *pinned : *check()));
+    return r->metadata().boundsCubic().deltify(delta);
+}
+
+std::size_t Session::residentBytes() const
+{
+    const std::shared_ptr<State> s(state());
+    if (!s) return 0;
+
+    std::lock_guard<std::mutex> lock(s->readerMutex);
+    return s->reader ? s->readerBytes : 0;
+}
+
+bool Session::idle() const
+{
+    const std::shared_ptr<State> s(state());
+    if (!s) return true;
+
+    std::lock_guard<std::mutex> lock(s->readerMutex);
+    return !s->reader || s->reader.use_count() == 1;
 }
 
-const entwine::Schema& Session::schema() const
+void Session::release()
 {
-    check();
-    return m_entwine->metadata().schema();
+    const std::shared_ptr<State> s(state());
+    if (!s) return;
+
+    std::shared_ptr<entwine::Reader> released;
+
+    {
+        std::lock_guard<std::mutex> lock(s->readerMutex);
+        released.swap(s->reader);
+        s->readerBytes = 0;
+    }
+
+    if (m_hierarchyCache) m_hierarchyCache->clear(resultPrefix(*s));
+
+    if (released)
+    {
+        std::cout << "Released " << m_name << std::endl;
+    }
 }
 
-bool Session::resolveIndex()
+std::shared_ptr<Session::State> Session::resolve() const
 {
+    std::shared_ptr<State> s;
+
     for (std::string path : m_paths)
     {
         std::string err;
@@ -282,9 +1468,22 @@ bool Session::resolveIndex()
         try
         {
             if (path.size() && path.back() != '/') path.push_back('/');
-            entwine::arbiter::Endpoint endpoint(
-                    m_outerScope.getArbiterPtr()->getEndpoint(path + m_name));
-            m_entwine.reset(new entwine::Reader(endpoint, m_cache));
+            auto endpoint(
+                    std::make_shared<entwine::arbiter::Endpoint>(
+                        m_outerScope.getArbiterPtr()->getEndpoint(
+                            path + m_name)));
+
+            if (auto metadata = endpoint->tryGet(metadataFile))
+            {
+                s = std::make_shared<State>();
+                s->path = path;
+                s->version = toHex(fnv1a(*metadata));
+                s->endpoint = endpoint;
+            }
+            else
+            {
+                err = "no index metadata";
+            }
         }
         catch (const std::exception& e)
         {
@@ -293,11 +1492,10 @@ bool Session::resolveIndex()
         catch (...)
         {
             err = "unknown error";
-            m_entwine.reset();
         }
 
         std::cout << "\tTried resolving index at " << path << ": ";
-        if (m_entwine)
+        if (s)
         {
             std::cout << "SUCCESS" << std::endl;
             break;
@@ -308,6 +1506,83 @@ bool Session::resolveIndex()
         }
     }
 
-    return !!m_entwine;
+    return s;
+}
+
+std::shared_ptr<entwine::Reader> Session::reader(State& s) const
+{
+    std::lock_guard<std::mutex> lock(s.readerMutex);
+
+    if (!s.reader)
+    {
+        // The reader refers to its endpoint and chunk cache, which must
+        // outlive it even if this state is replaced by a reload while a query
+        // is in flight.
+        const std::shared_ptr<entwine::arbiter::Endpoint> endpoint(
+                s.endpoint);
+        const std::shared_ptr<entwine::Cache> cache(
+                m_caches.get(s.path, s.version));
+
+        s.reader = std::shared_ptr<entwine::Reader>(
+                new entwine::Reader(*endpoint, *cache),
+                [endpoint, cache](entwine::Reader* r) { delete r; });
+        s.readerBytes = estimateSize(s.reader->metadata());
+    }
+
+    return s.reader;
+}
+
+bool Session::loadSnapshot(State& s) const
+{
+    if (!m_snapshots) return false;
+
+    std::unique_ptr<Json::Value> snapshot;
+
+    try { snapshot = m_snapshots->load(m_name); }
+    catch (...) { return false; }
+
+    if (!snapshot) return false;
+
+    const Json::Value& hierarchy((*snapshot)["hierarchy"]);
+
+    if (
+            (*snapshot)["path"].asString() != s.path ||
+            (*snapshot)["version"].asString() != s.version ||
+            hierarchy["depthEnd"].asUInt64() -
+                hierarchy["depthBegin"].asUInt64() !=
+                m_snapshots->hierarchyDepth())
+    {
+        return false;
+    }
+
+    s.info = (*snapshot)["info"];
+    s.hierarchy = hierarchy["tree"];
+    s.hierarchyBegin = hierarchy["depthBegin"].asUInt64();
+    s.hierarchyEnd = hierarchy["depthEnd"].asUInt64();
+
+    return s.indexed();
 }
 
+void Session::saveSnapshot(const State& s) const
+{
+    Json::Value snapshot;
+    snapshot["name"] = m_name;
+    snapshot["path"] = s.path;
+    snapshot["version"] = s.version;
+    snapshot["info"] = s.info;
+
+    Json::Value& hierarchy(snapshot["hierarchy"]);
+    hierarchy["depthBegin"] = static_cast<Json::UInt64>(s.hierarchyBegin);
+    hierarchy["depthEnd"] = static_cast<Json::UInt64>(s.hierarchyEnd);
+    hierarchy["tree"] = s.hierarchy;
+
+    try
+    {
+        m_snapshots->save(m_name, snapshot);
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << "\tCould not save snapshot for " << m_name << ": " <<
+            e.what() << std::endl;
+    }
+}
@@ -2,11 +2,14 @@
 
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include <entwine/types/defs.hpp>
 
+#include "types/hierarchy-cache.hpp"
+
 namespace pdal
 {
     class PointContext;
@@ -21,9 +24,36 @@ namespace entwine
     class Query;
     class Reader;
     class Schema;
+
+    namespace arbiter
+    {
+        class Endpoint;
+    }
 }
 
+class ChunkCaches;
+class HierarchyIndex;
+struct HierarchyIndexStats;
+class NodeSet;
 class ReadQuery;
+class SnapshotStore;
+class ThreadPool;
+
+// Process-wide hierarchy settings shared by all sessions.
+struct HierarchyOptions
+{
+    // Result cache, or null to query the index directly.
+    HierarchyCache* cache = nullptr;
+
+    // Number of depths of the hierarchy index, or zero for no index.
+    std::size_t indexDepth = 0;
+    HierarchyIndexStats* indexStats = nullptr;
+
+    // Queries spanning at least "parallelDepth" depths are split by subtree
+    // and run on "pool", if it exists.
+    ThreadPool* pool = nullptr;
+    std::size_t parallelDepth = 0;
+};
 
 class WrongQueryType : public std::runtime_error
 {
@@ -33,21 +63,38 @@ public:
     { }
 };
 
-class Session
+class Session : public std::enable_shared_from_this<Session>
 {
 public:
     Session(
             const std::string name,
             const std::vector<std::string>& paths,
             entwine::OuterScope& outerScope,
-            entwine::Cache& cache);
+            ChunkCaches& caches,
+            const SnapshotStore* snapshots,
+            const HierarchyOptions& hierarchyOptions);
     ~Session();
 
     // Returns true if initialization was successful.  If false, this session
     // should not be used.
     bool initialize();
 
+    // Re-resolve the index metadata, and if it has changed, swap in the new
+    // version for subsequent queries.  Queries already in flight finish on
+    // the version with which they started.
+    Json::Value reload();
+
+    // Everything derived from a single version of the index.  A reload swaps
+    // in a new State, while commands in flight hold on to the previous one.
+    struct State;
+
+    // The version of the index currently in use.  Queries given it read that
+    // version even if this session is reloaded meanwhile, so that the
+    // queries of a single command agree with one another.
+    std::shared_ptr<State> pin() const;
+
     Json::Value info() const;
+    Json::Value info(const State& pinned) const;
     Json::Value hierarchy(
             const entwine::Bounds* bounds,
             std::size_t depthBegin,
@@ -56,6 +103,18 @@ public:
             const entwine::Scale* scale,
             const entwine::Offset* offset) const;
 
+    // Answers many hierarchy queries in one call, returning an array of
+    // results in order.  Each query is either a node key string, answered for
+    // "depths" depths beginning at its own depth, or an object with "bounds"
+    // and depth options like a single hierarchy query.  Sibling nodes are
+    // answered from one traversal of their parent.
+    Json::Value hierarchyBatch(
+            const Json::Value& queries,
+            std::size_t depths,
+            bool vertical,
+            const entwine::Scale* scale,
+            const entwine::Offset* offset) const;
+
     Json::Value files(const Json::Value& search) const;
 
     Json::Value files(
@@ -63,6 +122,9 @@ public:
             const entwine::Scale* scale,
             const entwine::Offset* offset) const;
 
+    // A read of several boxes is given the union of the boxes as "bounds",
+    // with a filter selecting the points within any of them - see
+    // boxes::combine - so it is traversed once.
     std::unique_ptr<ReadQuery> getQuery(
             const entwine::Bounds* bounds,
             std::size_t depthBegin,
@@ -71,6 +133,37 @@ public:
             const entwine::Offset* offset,
             const entwine::Schema* schema,
             const Json::Value& filter,
+            bool compress,
+            State* pinned = nullptr) const;
+
+    // Returns a query for the deepest depth range beginning at "depthBegin",
+    // and ending no deeper than "depthEnd" if it is non-zero, whose points
+    // within "bounds" fit within "pointBudget".  The depth after that range
+    // may be partially selected by cells to use the remaining budget.  The
+    // chosen range is written to "selection".
+    std::unique_ptr<ReadQuery> getBudgetQuery(
+            const entwine::Bounds* bounds,
+            std::size_t depthBegin,
+            std::size_t depthEnd,
+            uint64_t pointBudget,
+            const entwine::Scale* scale,
+            const entwine::Offset* offset,
+            const entwine::Schema* schema,
+            const Json::Value& filter,
+            bool compress,
+            Json::Value& selection) const;
+
+    // As getQuery, but skipping the nodes of the tree in "exclude", which the
+    // client already holds.
+    std::unique_ptr<ReadQuery> getDeltaQuery(
+            const entwine::Bounds* bounds,
+            std::size_t depthBegin,
+            std::size_t depthEnd,
+            const NodeSet& exclude,
+            const entwine::Scale* scale,
+            const entwine::Offset* offset,
+            const entwine::Schema* schema,
+            const Json::Value& filter,
             bool compress) const;
 
     // Read quad-tree indexed data with a bounding box query and min/max tree
@@ -85,35 +178,137 @@ public:
             std::size_t depthBegin,
             std::size_t depthEnd);
 
-    const entwine::Schema& schema() const;
+    entwine::Schema schema() const;
+
+    // Identifies the version of the index currently in use.
+    std::string version() const;
+
+    // Cubic bounds of the index in the coordinate system given by "scale"
+    // and "offset".
+    entwine::Bounds bounds(
+            const entwine::Scale* scale,
+            const entwine::Offset* offset,
+            State* pinned = nullptr) const;
+
+    const std::string& name() const { return m_name; }
+
+    // Estimated number of bytes held by the open index of this session, or
+    // zero if it is not open.
+    std::size_t residentBytes() const;
+
+    // True if no query is currently using the open index of this session.
+    bool idle() const;
+
+    // Close the index of this session.  Queries already in flight keep it
+    // alive until they complete, and subsequent queries reopen it.
+    void release();
 
 private:
-    Json::Value filesSingle(const Json::Value& search) const;
+    std::shared_ptr<State> state() const;
 
-    void check() const
-    {
-        if (!m_entwine)
-        {
-            throw std::runtime_error("Session was not created");
-        }
-    }
+    // Returns the current state, throwing if this session is not indexed.
+    std::shared_ptr<State> check() const;
+
+    // Locates the index metadata, without opening the index itself.  Returns
+    // null if no index is found.
+    std::shared_ptr<State> resolve() const;
+
+    // Populates a resolved state from its snapshot, or from the index.
+    bool load(State& state) const;
+
+    // Opens the index on first use, which may happen well after
+    // initialization if this session was brought up from a snapshot, or
+    // after it has been released.
+    std::shared_ptr<entwine::Reader> reader(State& state) const;
+
+    bool loadSnapshot(State& state) const;
+    void saveSnapshot(const State& state) const;
+
+    // Returns the hierarchy index for this version if it is ready and the
+    // depths [depthBegin, depthEnd) are within it.  Otherwise returns null,
+    // and on the first such query, starts building the index in the
+    // background so that no query waits on it.
+    const HierarchyIndex* hierarchyIndex(
+            const std::shared_ptr<State>& state,
+            std::size_t depthBegin,
+            std::size_t depthEnd) const;
+
+    // Maps the stored index of this version, or builds it.
+    void buildIndex(State& state) const;
+
+    Json::Value filesSingle(State& state, const Json::Value& search) const;
+
+    // Returns the snapshotted hierarchy if it can fully answer this query,
+    // otherwise null.
+    std::unique_ptr<Json::Value> snapshotHierarchy(
+            const State& state,
+            const entwine::Bounds* bounds,
+            std::size_t depthBegin,
+            std::size_t depthEnd,
+            bool vertical) const;
+
+    // Compute a hierarchy from the index, bypassing the snapshot and the
+    // hierarchy index.
+    Json::Value computeHierarchy(
+            State& state,
+            const entwine::Bounds& bounds,
+            std::size_t depthBegin,
+            std::size_t depthEnd,
+            bool vertical,
+            const entwine::Scale* scale,
+            const entwine::Offset* offset) const;
+
+    // Compute a hierarchy by splitting it into a query for its top depth and
+    // parallel queries for each of its immediate subtrees.
+    Json::Value parallelHierarchy(
+            State& state,
+            const entwine::Bounds& bounds,
+            std::size_t depthBegin,
+            std::size_t depthEnd,
+            bool vertical,
+            const entwine::Scale* scale,
+            const entwine::Offset* offset) const;
 
-    bool resolveIndex();
+    Json::Value serialHierarchy(
+            State& state,
+            const entwine::Bounds& bounds,
+            std::size_t depthBegin,
+            std::size_t depthEnd,
+            bool vertical,
+            const entwine::Scale* scale,
+            const entwine::Offset* offset) const;
+
+    // Answer a hierarchy query from the result cache, or the reader.
+    Json::Value cachedHierarchy(
+            State& state,
+            const entwine::Bounds& bounds,
+            std::size_t depthBegin,
+            std::size_t depthEnd,
+            bool vertical,
+            const entwine::Scale* scale,
+            const entwine::Offset* offset) const;
 
-    bool indexed() const { return m_entwine.get(); }
+    // Cache keys are scoped to this resource and its index version.
+    std::string resultPrefix(const State& state) const;
 
     const std::string m_name;
     const std::vector<std::string>& m_paths;
     entwine::OuterScope& m_outerScope;
-    entwine::Cache& m_cache;
+    ChunkCaches& m_caches;
+    const SnapshotStore* m_snapshots;
+    const HierarchyOptions m_hierarchyOptions;
+    HierarchyCache* m_hierarchyCache;
 
     std::once_flag m_initOnce;
 
-    std::unique_ptr<entwine::Reader> m_entwine;
-    Json::Value m_info;
+    // Serializes reloads, which may be slow, separately from swapping the
+    // state, which must not be.
+    std::mutex m_reloadMutex;
+
+    mutable std::mutex m_stateMutex;
+    std::shared_ptr<State> m_state;
 
     // Disallow copy/assignment.
     Session(const Session&);
     Session& operator=(const Session&);
 };
-
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// A monotonic allocator: allocations bump a pointer through large blocks,
+// deallocation is a no-op, and everything is freed at once by reset() or
+// destruction.  Not thread-safe.
+class Arena
+{
+public:
+    Arena(std::size_t blockSize = 4096)
+        : m_blockSize(blockSize)
+        , m_capacity(0)
+        , m_firstCapacity(0)
+        , m_used(0)
+    { }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(std::size_t size, std::size_t align)
+    {
+        if (!m_blocks.empty())
+        {
+            const std::size_t pos((m_used + align - 1) / align * align);
+            if (pos + size <= m_capacity)
+            {
+                m_used = pos + size;
+                return m_blocks.back().get() + pos;
+            }
+        }
+
+        // Blocks come from operator new, so they are aligned for any type.
+        const std::size_t capacity(std::max(size, m_blockSize));
+        m_blocks.emplace_back(new char[capacity]);
+        if (m_blocks.size() == 1) m_firstCapacity = capacity;
+        m_capacity = capacity;
+        m_used = size;
+        return m_blocks.back().get();
+    }
+
+    // Frees every allocation, keeping the first block for reuse.
+    void reset()
+    {
+        if (m_blocks.empty()) return;
+
+        m_blocks.resize(1);
+        m_capacity = m_firstCapacity;
+        m_used = 0;
+    }
+
+private:
+    const std::size_t m_blockSize;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    std::size_t m_capacity;
+    std::size_t m_firstCapacity;
+    std::size_t m_used;
+};
+
+// A standard allocator drawing from an Arena, which must outlive everything
+// allocated from it.
+template<typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    ArenaAllocator(Arena& arena) : m_arena(&arena) { }
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.arena()) { }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, std::size_t) { }
+
+    Arena* arena() const { return m_arena; }
+
+private:
+    Arena* m_arena;
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena() == b.arena();
+}
+
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return !(a == b);
+}
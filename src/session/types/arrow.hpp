@@ -0,0 +1,418 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <entwine/types/dim-info.hpp>
+#include <entwine/types/schema.hpp>
+
+// A minimal writer for the Apache Arrow IPC streaming format, sufficient to
+// send points as record batches of primitive, non-nullable columns - one per
+// dimension of the schema.  Arrow's message metadata is encoded with
+// flatbuffers, for which a small builder is included here rather than taking
+// on a dependency for the handful of tables that we write.
+namespace arrow
+{
+
+// Builds a flatbuffer back to front, as the reference implementation does,
+// so that every object is at a higher address than the offsets that refer to
+// it.  Objects are referred to by their distance from the end of the buffer.
+class FlatBuilder
+{
+public:
+    using Ref = uint32_t;
+
+    class Table
+    {
+        friend class FlatBuilder;
+
+    public:
+        template<typename T>
+        void add(uint16_t field, T value)
+        {
+            Field f(field, sizeof(T), false);
+            f.bytes.resize(sizeof(T));
+            std::memcpy(f.bytes.data(), &value, sizeof(T));
+            m_fields.push_back(f);
+        }
+
+        void addRef(uint16_t field, Ref ref)
+        {
+            Field f(field, sizeof(uint32_t), true);
+            f.ref = ref;
+            m_fields.push_back(f);
+        }
+
+    private:
+        struct Field
+        {
+            Field(uint16_t index, std::size_t size, bool isRef)
+                : index(index)
+                , size(size)
+                , isRef(isRef)
+                , ref(0)
+            { }
+
+            uint16_t index;
+            std::size_t size;
+            bool isRef;
+            Ref ref;
+            std::vector<char> bytes;
+        };
+
+        std::vector<Field> m_fields;
+    };
+
+    Ref table(Table table)
+    {
+        auto& fields(table.m_fields);
+
+        // Place the widest fields first so that each is aligned.
+        std::stable_sort(
+                fields.begin(),
+                fields.end(),
+                [](const Table::Field& a, const Table::Field& b)
+                {
+                    return a.size > b.size;
+                });
+
+        uint16_t numFields(0);
+        for (const auto& f : fields)
+        {
+            numFields = std::max<uint16_t>(numFields, f.index + 1);
+        }
+
+        const bool wide(!fields.empty() && fields.front().size == 8);
+        std::size_t tableSize(wide ? 8 : 4);
+
+        std::vector<uint16_t> offsets(numFields, 0);
+        for (const auto& f : fields)
+        {
+            offsets[f.index] = tableSize;
+            tableSize += f.size;
+        }
+
+        const std::size_t vtableSize(4 + 2 * numFields);
+        const std::size_t tableStart((vtableSize + 7) / 8 * 8);
+
+        std::vector<char> block(tableStart + tableSize, 0);
+        put<uint16_t>(block, 0, vtableSize);
+        put<uint16_t>(block, 2, tableSize);
+        for (uint16_t i(0); i < numFields; ++i)
+        {
+            put<uint16_t>(block, 4 + 2 * i, offsets[i]);
+        }
+
+        // The vtable immediately precedes its table.
+        put<int32_t>(block, tableStart, tableStart);
+
+        const std::size_t end(endAfter(block.size(), tableStart, 8));
+
+        for (const auto& f : fields)
+        {
+            const std::size_t pos(tableStart + offsets[f.index]);
+
+            if (f.isRef) put<uint32_t>(block, pos, end - pos - f.ref);
+            else std::memcpy(block.data() + pos, f.bytes.data(), f.size);
+        }
+
+        return prepend(block, tableStart, 8);
+    }
+
+    Ref string(const std::string& s)
+    {
+        std::vector<char> block(4 + s.size() + 1, 0);
+        put<uint32_t>(block, 0, s.size());
+        std::memcpy(block.data() + 4, s.data(), s.size());
+        return prepend(block, 0, 4);
+    }
+
+    // A vector of structs, given as their packed bytes.
+    Ref structs(const std::vector<char>& data, std::size_t count)
+    {
+        std::vector<char> block(4 + data.size(), 0);
+        put<uint32_t>(block, 0, count);
+        std::copy(data.begin(), data.end(), block.begin() + 4);
+
+        // The elements, rather than the length, must be 8-byte aligned.
+        const std::size_t end(endAfter(block.size(), 4, 8));
+        return prepend(block, 0, 8, 4, end);
+    }
+
+    // A vector of tables.
+    Ref refs(const std::vector<Ref>& refs)
+    {
+        std::vector<char> block(4 + 4 * refs.size(), 0);
+        put<uint32_t>(block, 0, refs.size());
+
+        const std::size_t end(endAfter(block.size(), 0, 4));
+        for (std::size_t i(0); i < refs.size(); ++i)
+        {
+            const std::size_t pos(4 + 4 * i);
+            put<uint32_t>(block, pos, end - pos - refs[i]);
+        }
+
+        return prepend(block, 0, 4);
+    }
+
+    std::vector<char> finish(Ref root)
+    {
+        std::vector<char> block(4, 0);
+        const std::size_t end(endAfter(block.size(), 0, 8));
+        put<uint32_t>(block, 0, end - root);
+        prepend(block, 0, 8);
+        return m_data;
+    }
+
+    template<typename T>
+    static void put(std::vector<char>& out, std::size_t pos, T v)
+    {
+        std::memcpy(out.data() + pos, &v, sizeof(T));
+    }
+
+private:
+    // Padding needed between a new block and the existing data so that the
+    // position "alignPos" within the block is aligned.  The final buffer is
+    // a multiple of 8 bytes, so alignment from the end implies alignment
+    // from the start.
+    std::size_t padFor(
+            std::size_t blockSize,
+            std::size_t alignPos,
+            std::size_t alignment) const
+    {
+        const std::size_t distance(m_data.size() + blockSize - alignPos);
+        return (alignment - distance % alignment) % alignment;
+    }
+
+    // Distance from the end of the buffer to the start of a block once it
+    // is prepended.
+    std::size_t endAfter(
+            std::size_t blockSize,
+            std::size_t alignPos,
+            std::size_t alignment) const
+    {
+        return m_data.size() + padFor(blockSize, alignPos, alignment) +
+            blockSize;
+    }
+
+    Ref prepend(
+            const std::vector<char>& block,
+            std::size_t anchor,
+            std::size_t alignment)
+    {
+        return prepend(
+                block,
+                anchor,
+                alignment,
+                anchor,
+                endAfter(block.size(), anchor, alignment));
+    }
+
+    Ref prepend(
+            const std::vector<char>& block,
+            std::size_t anchor,
+            std::size_t alignment,
+            std::size_t alignPos,
+            std::size_t end)
+    {
+        const std::size_t pad(padFor(block.size(), alignPos, alignment));
+        m_data.insert(m_data.begin(), pad, 0);
+        m_data.insert(m_data.begin(), block.begin(), block.end());
+
+        if (m_data.size() != end)
+        {
+            throw std::runtime_error("Inconsistent flatbuffer layout");
+        }
+
+        return end - anchor;
+    }
+
+    std::vector<char> m_data;
+};
+
+namespace detail
+{
+
+const int16_t metadataV5(4);
+
+const uint8_t schemaHeader(1);
+const uint8_t recordBatchHeader(3);
+
+const uint8_t intType(2);
+const uint8_t floatingPointType(3);
+
+inline void putLE(std::vector<char>& out, uint64_t v, std::size_t bytes)
+{
+    for (std::size_t i(0); i < bytes; ++i)
+    {
+        out.push_back(static_cast<char>((v >> (i * 8)) & 0xFF));
+    }
+}
+
+inline std::size_t padded(std::size_t size) { return (size + 7) / 8 * 8; }
+
+// Frames a message as: continuation marker, metadata length, metadata, body.
+inline void encapsulate(
+        std::vector<char>& out,
+        const std::vector<char>& metadata,
+        const std::vector<char>& body)
+{
+    const std::size_t size(padded(metadata.size()));
+
+    putLE(out, 0xFFFFFFFF, 4);
+    putLE(out, size, 4);
+    out.insert(out.end(), metadata.begin(), metadata.end());
+    out.insert(out.end(), size - metadata.size(), 0);
+    out.insert(out.end(), body.begin(), body.end());
+}
+
+inline std::vector<char> message(
+        FlatBuilder& builder,
+        uint8_t headerType,
+        FlatBuilder::Ref header,
+        uint64_t bodyLength)
+{
+    FlatBuilder::Table m;
+    m.add<int16_t>(0, metadataV5);
+    m.add<uint8_t>(1, headerType);
+    m.addRef(2, header);
+    m.add<int64_t>(3, bodyLength);
+    return builder.finish(builder.table(m));
+}
+
+} // namespace detail
+
+// The schema message that begins a stream.
+inline void writeSchema(std::vector<char>& out, const entwine::Schema& schema)
+{
+    FlatBuilder builder;
+    std::vector<FlatBuilder::Ref> fields;
+
+    for (const entwine::DimInfo& dim : schema.dims())
+    {
+        const std::string type(dim.typeString());
+        const std::size_t size(dim.size());
+
+        FlatBuilder::Table t;
+        uint8_t typeType(0);
+
+        if (type == "floating")
+        {
+            if (size != 4 && size != 8)
+            {
+                throw std::runtime_error("Invalid size for " + dim.name());
+            }
+
+            typeType = detail::floatingPointType;
+            t.add<int16_t>(0, size == 4 ? 1 : 2);
+        }
+        else
+        {
+            typeType = detail::intType;
+            t.add<int32_t>(0, size * 8);
+            t.add<uint8_t>(1, type == "signed");
+        }
+
+        const FlatBuilder::Ref typeRef(builder.table(t));
+        const FlatBuilder::Ref children(builder.refs({ }));
+        const FlatBuilder::Ref name(builder.string(dim.name()));
+
+        FlatBuilder::Table f;
+        f.addRef(0, name);
+        f.add<uint8_t>(1, 0);
+        f.add<uint8_t>(2, typeType);
+        f.addRef(3, typeRef);
+        f.addRef(5, children);
+        fields.push_back(builder.table(f));
+    }
+
+    const FlatBuilder::Ref fieldsRef(builder.refs(fields));
+
+    FlatBuilder::Table s;
+    s.addRef(1, fieldsRef);
+    const FlatBuilder::Ref schemaRef(builder.table(s));
+
+    detail::encapsulate(
+            out,
+            detail::message(builder, detail::schemaHeader, schemaRef, 0),
+            std::vector<char>());
+}
+
+// A record batch of the interleaved "points", which are transposed into one
+// column per dimension.
+inline void writeBatch(
+        std::vector<char>& out,
+        const entwine::Schema& schema,
+        const std::vector<char>& points)
+{
+    const std::size_t pointSize(schema.pointSize());
+    const std::size_t n(points.size() / pointSize);
+
+    std::vector<char> body;
+    std::vector<char> nodes;
+    std::vector<char> buffers;
+
+    std::size_t dimOffset(0);
+
+    for (const entwine::DimInfo& dim : schema.dims())
+    {
+        const std::size_t size(dim.size());
+        const std::size_t start(body.size());
+
+        body.resize(start + detail::padded(n * size), 0);
+
+        const char* in(points.data() + dimOffset);
+        char* column(body.data() + start);
+
+        for (std::size_t i(0); i < n; ++i)
+        {
+            std::memcpy(column + i * size, in + i * pointSize, size);
+        }
+
+        dimOffset += size;
+
+        // Field node: length and null count.
+        detail::putLE(nodes, n, 8);
+        detail::putLE(nodes, 0, 8);
+
+        // An empty validity buffer, since no values are null, then values.
+        detail::putLE(buffers, start, 8);
+        detail::putLE(buffers, 0, 8);
+        detail::putLE(buffers, start, 8);
+        detail::putLE(buffers, n * size, 8);
+    }
+
+    const std::size_t numDims(schema.dims().size());
+
+    FlatBuilder builder;
+    const FlatBuilder::Ref buffersRef(builder.structs(buffers, numDims * 2));
+    const FlatBuilder::Ref nodesRef(builder.structs(nodes, numDims));
+
+    FlatBuilder::Table b;
+    b.add<int64_t>(0, n);
+    b.addRef(1, nodesRef);
+    b.addRef(2, buffersRef);
+    const FlatBuilder::Ref batchRef(builder.table(b));
+
+    detail::encapsulate(
+            out,
+            detail::message(
+                builder,
+                detail::recordBatchHeader,
+                batchRef,
+                body.size()),
+            body);
+}
+
+inline void writeEnd(std::vector<char>& out)
+{
+    detail::putLE(out, 0xFFFFFFFF, 4);
+    detail::putLE(out, 0, 4);
+}
+
+} // namespace arrow
+
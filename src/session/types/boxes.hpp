@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/types/bounds.hpp>
+#include <entwine/util/json.hpp>
+#include <entwine/util/unique.hpp>
+
+// Helpers for a "bounds" query option that is an array of boxes rather than
+// a single box.  Each box is formatted like a single "bounds" - 6 values, or
+// 4 values to select the full Z range.  Reads traverse the union of the
+// boxes once, with a filter selecting the points within any box, so each
+// chunk is visited once however many boxes overlap it, and each point is
+// returned at most once.  Reads split into cells, like cursors and exports,
+// skip the cells that no box overlaps.
+namespace boxes
+{
+
+inline bool isMulti(const Json::Value& bounds)
+{
+    return bounds.isArray() && bounds.size() && bounds[0].isArray();
+}
+
+inline void validate(const Json::Value& box)
+{
+    if (!box.isArray() || (box.size() != 4 && box.size() != 6))
+    {
+        throw std::runtime_error("Invalid bounds: " + box.toStyledString());
+    }
+}
+
+// Smallest single box containing every box of "bounds", in the same format.
+inline Json::Value unionOf(const Json::Value& bounds)
+{
+    bool is3d(true);
+    for (const Json::Value& box : bounds)
+    {
+        validate(box);
+        if (box.size() == 4) is3d = false;
+    }
+
+    const std::size_t dims(is3d ? 3 : 2);
+    Json::Value result(Json::arrayValue);
+
+    for (std::size_t i(0); i < dims * 2; ++i)
+    {
+        const bool isMin(i < dims);
+        const std::size_t dim(i % dims);
+
+        double v(0);
+        for (Json::ArrayIndex b(0); b < bounds.size(); ++b)
+        {
+            const Json::Value& box(bounds[b]);
+            const std::size_t boxDims(box.size() / 2);
+            const double current(
+                    box[Json::ArrayIndex(isMin ? dim : boxDims + dim)]
+                        .asDouble());
+
+            if (!b) v = current;
+            else v = isMin ? std::min(v, current) : std::max(v, current);
+        }
+
+        result.append(v);
+    }
+
+    return result;
+}
+
+// The filter selecting the points within "box".  Like a single "bounds", it
+// includes its minimum and excludes its maximum.
+inline Json::Value selection(const Json::Value& box)
+{
+    static const char* names[] = { "X", "Y", "Z" };
+
+    validate(box);
+    const std::size_t dims(box.size() / 2);
+
+    Json::Value result(Json::objectValue);
+    for (std::size_t d(0); d < dims; ++d)
+    {
+        Json::Value& range(result[names[d]]);
+        range["$gte"] = box[Json::ArrayIndex(d)];
+        range["$lt"] = box[Json::ArrayIndex(dims + d)];
+    }
+
+    return result;
+}
+
+// Both "a" and "b", either of which may be null.
+inline Json::Value both(const Json::Value& a, const Json::Value& b)
+{
+    if (a.isNull()) return b;
+    if (b.isNull()) return a;
+
+    Json::Value result(Json::objectValue);
+    result["$and"].append(a);
+    result["$and"].append(b);
+    return result;
+}
+
+// The filter selecting points within any box of "bounds", combined with the
+// user-supplied "filter", if any.
+inline Json::Value filter(const Json::Value& bounds, const Json::Value& filter)
+{
+    Json::Value any(Json::objectValue);
+    Json::Value& list(any["$or"]);
+    for (const Json::Value& box : bounds) list.append(selection(box));
+
+    return both(filter, any);
+}
+
+// Parse a "bounds" option of either form into a single box containing it.
+inline std::unique_ptr<entwine::Bounds> create(const Json::Value& bounds)
+{
+    if (isMulti(bounds))
+    {
+        return entwine::makeUnique<entwine::Bounds>(unionOf(bounds));
+    }
+
+    return entwine::maybeCreate<entwine::Bounds>(bounds);
+}
+
+// Combine a "filter" option with the filter implied by "bounds", which is
+// only necessary if it contains multiple boxes traversed as their union.
+inline Json::Value combine(const Json::Value& bounds, const Json::Value& f)
+{
+    return isMulti(bounds) ? filter(bounds, f) : f;
+}
+
+// Drops the cells which no box of a multiple "bounds" overlaps.
+inline void prune(
+        std::vector<entwine::Bounds>& cells,
+        const Json::Value& bounds)
+{
+    if (!isMulti(bounds)) return;
+
+    std::vector<entwine::Bounds> list;
+    for (const Json::Value& box : bounds) list.emplace_back(box);
+
+    cells.erase(
+            std::remove_if(
+                cells.begin(),
+                cells.end(),
+                [&list](const entwine::Bounds& cell)
+                {
+                    return std::none_of(
+                            list.begin(),
+                            list.end(),
+                            [&cell](const entwine::Bounds& box)
+                            {
+                                return box.overlaps(cell);
+                            });
+                }),
+            cells.end());
+}
+
+// Overlap of two boxes, which must intersect.
+inline entwine::Bounds intersect(
+        const entwine::Bounds& a,
+        const entwine::Bounds& b)
+{
+    return entwine::Bounds(
+            entwine::Point(
+                std::max(a.min().x, b.min().x),
+                std::max(a.min().y, b.min().y),
+                std::max(a.min().z, b.min().z)),
+            entwine::Point(
+                std::min(a.max().x, b.max().x),
+                std::min(a.max().y, b.max().y),
+                std::min(a.max().z, b.max().z)));
+}
+
+} // namespace boxes
+
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cassert>
+#include <chrono>
 #include <condition_variable>
 #include <iostream>
 #include <set>
@@ -111,5 +112,55 @@ public:
         static BufferPool bufferPool(512);
         return bufferPool;
     }
+
+    // Looping reads gather their chunks into sends of about this size.
+    static constexpr std::size_t sendSize = 1024 * 512;
+
+    // Calls "next", which appends a chunk to "buffer" and returns false once
+    // nothing more is to be read, until the buffer holds a full send.  Sparse
+    // reads return many small chunks, each of which would cost a round trip
+    // through JS, so they are gathered, but a slow read still sends what it
+    // has once the latency bound passes.
+    template<typename F>
+    static void gather(const std::vector<char>& buffer, F next)
+    {
+        const auto deadline(std::chrono::steady_clock::now() + sendLatency());
+
+        while (buffer.size() < sendSize && next())
+        {
+            if (
+                    !buffer.empty() &&
+                    std::chrono::steady_clock::now() >= deadline)
+            {
+                return;
+            }
+        }
+    }
+
+private:
+    // The longest that a chunk is held back while gathering a send.
+    static std::chrono::milliseconds sendLatency()
+    {
+        return std::chrono::milliseconds(50);
+    }
 };
 
+// A buffer of the read pool, held for the life of a query as scratch space
+// which is refilled for every chunk.  Pooled buffers already have room for a
+// chunk, and are returned in one step when the query finishes, so scratch
+// space is neither grown per chunk nor allocated per query.
+class PooledBuffer
+{
+public:
+    PooledBuffer() : m_buffer(ReadPool::get().acquire()) { }
+    ~PooledBuffer() { ReadPool::get().release(m_buffer); }
+
+    std::vector<char>& operator*() { return m_buffer; }
+    std::vector<char>* operator->() { return &m_buffer; }
+
+private:
+    std::vector<char>& m_buffer;
+
+    PooledBuffer(const PooledBuffer&);
+    PooledBuffer& operator=(const PooledBuffer&);
+};
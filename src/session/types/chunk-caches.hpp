@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <json/json.h>
+
+#include <entwine/reader/cache.hpp>
+
+// Hands out the chunk cache shared by all readers.  Cached chunks are keyed
+// only by index path and chunk id, so once an index is rewritten in place,
+// chunks cached for its previous version would be served to readers of the
+// new one.  A reader of a version other than the one last seen at its path
+// therefore starts a new generation of the cache, and the previous one is
+// freed along with the last of the readers holding it.
+class ChunkCaches
+{
+public:
+    ChunkCaches(std::size_t maxBytes)
+        : m_maxBytes(maxBytes)
+        , m_cache(std::make_shared<entwine::Cache>(maxBytes))
+    { }
+
+    std::shared_ptr<entwine::Cache> get(
+            const std::string& path,
+            const std::string& version)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it(m_versions.find(path));
+
+        if (it != m_versions.end() && it->second != version)
+        {
+            m_cache = std::make_shared<entwine::Cache>(m_maxBytes);
+            m_versions.clear();
+            ++m_generations;
+        }
+
+        m_versions[path] = version;
+        return m_cache;
+    }
+
+    Json::Value stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Json::Value json;
+        json["maxBytes"] = static_cast<Json::UInt64>(m_maxBytes);
+        json["generations"] = static_cast<Json::UInt64>(m_generations);
+        return json;
+    }
+
+private:
+    const std::size_t m_maxBytes;
+    std::size_t m_generations = 1;
+
+    std::shared_ptr<entwine::Cache> m_cache;
+    std::map<std::string, std::string> m_versions;
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// A LazPerf output stream which appends to a buffer supplied for each write,
+// so that compressed bytes go straight into pooled storage rather than into
+// a stream-owned allocation that is then swapped into the pool.  Bytes
+// flushed with no buffer set, as when an abandoned query is destroyed, are
+// discarded.
+class CompressionSink
+{
+public:
+    void target(std::vector<char>* buffer) { m_buffer = buffer; }
+
+    void putBytes(const unsigned char* bytes, std::size_t size)
+    {
+        if (m_buffer) m_buffer->insert(m_buffer->end(), bytes, bytes + size);
+    }
+
+    void putByte(unsigned char byte)
+    {
+        if (m_buffer) m_buffer->push_back(byte);
+    }
+
+private:
+    std::vector<char>* m_buffer = nullptr;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/types/bounds.hpp>
+
+#include "types/boxes.hpp"
+#include "types/hash.hpp"
+#include "types/key.hpp"
+
+// A resumable read is split into a fixed sequence of cells of the tree, each
+// read over the full depth range of the query.  The cells partition space,
+// so together they return each point of the read exactly once.  A cursor is
+// a range [begin, end) of that sequence, bound to the query and index
+// version it was created for, and is handed to clients as an opaque token.
+class Cursor
+{
+public:
+    Cursor(uint64_t fingerprint, std::size_t begin, std::size_t end)
+        : fingerprint(fingerprint)
+        , begin(begin)
+        , end(end)
+    { }
+
+    static Cursor parse(const std::string& token, uint64_t fingerprint)
+    {
+        std::istringstream ss(token);
+        uint64_t f(0);
+        std::size_t b(0), e(0);
+        char sep0(0), sep1(0);
+
+        if (
+                !(ss >> std::hex >> f >> sep0 >> std::dec >> b >> sep1 >> e) ||
+                sep0 != '.' || sep1 != '.' || b > e)
+        {
+            throw std::runtime_error("Invalid cursor");
+        }
+
+        if (f != fingerprint)
+        {
+            throw std::runtime_error("Cursor does not match this query");
+        }
+
+        return Cursor(f, b, e);
+    }
+
+    std::string toString() const
+    {
+        std::ostringstream ss;
+        ss << toHex(fingerprint) << '.' << begin << '.' << end;
+        return ss.str();
+    }
+
+    // Identifies the results of "query", less its cursor options, against
+    // an index version.
+    static uint64_t fingerprintOf(
+            const Json::Value& query,
+            const std::string& version)
+    {
+        Json::Value q(query);
+        q.removeMember("cursor");
+        q.removeMember("split");
+        return fnv1a(version + Json::FastWriter().write(q));
+    }
+
+    // The cells of a read of "bounds", in Morton order, bisected from the
+    // cubic bounds of the index a fixed number of times.
+    static std::vector<entwine::Bounds> cells(
+            const entwine::Bounds& cubic,
+            const entwine::Bounds& bounds,
+            std::size_t baseDepth,
+            bool is3d)
+    {
+        std::vector<Key> keys(1, Key(baseDepth, 0, 0, 0));
+
+        for (std::size_t level(0); level < (is3d ? 2 : 3); ++level)
+        {
+            std::vector<Key> next;
+            for (const Key& key : keys)
+            {
+                for (unsigned int c(0); c < (is3d ? 8u : 4u); ++c)
+                {
+                    next.push_back(key.child(c));
+                }
+            }
+            keys.swap(next);
+        }
+
+        std::vector<entwine::Bounds> out;
+        for (const Key& key : keys)
+        {
+            const entwine::Bounds cell(key.bounds(cubic, baseDepth, is3d));
+            if (cell.overlaps(bounds))
+            {
+                out.push_back(boxes::intersect(cell, bounds));
+            }
+        }
+
+        return out;
+    }
+
+    uint64_t fingerprint;
+    std::size_t begin;
+    std::size_t end;
+};
+
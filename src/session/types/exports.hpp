@@ -0,0 +1,573 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+#include <unistd.h>
+
+#include <json/json.h>
+
+#include <entwine/types/bounds.hpp>
+#include <entwine/types/schema.hpp>
+#include <entwine/util/unique.hpp>
+
+#include "session.hpp"
+#include "read-queries/base.hpp"
+#include "types/boxes.hpp"
+#include "types/cursor.hpp"
+#include "types/hash.hpp"
+#include "types/las.hpp"
+#include "types/thread-pool.hpp"
+
+// A background job of a resource, made up of tasks that may be run in
+// parallel, each of which may write one file.  The first error fails the job
+// and stops its remaining tasks.  A job has settled once all of its tasks
+// have returned, after which it writes nothing more.
+class Job
+{
+public:
+    Job(const std::string& id, std::shared_ptr<Session> session)
+        : m_id(id)
+        , m_session(session)
+        , m_cancelled(false)
+        , m_settled(std::chrono::steady_clock::now())
+    { }
+
+    virtual ~Job() { }
+
+    // Splits the job into tasks.  This opens the index, so it must not be
+    // called from the main loop.
+    virtual void plan() = 0;
+
+    virtual std::size_t tasks() const = 0;
+
+    void run(std::size_t index)
+    {
+        if (!m_cancelled)
+        {
+            try
+            {
+                work(index);
+            }
+            catch (std::exception& e)
+            {
+                fail(e.what());
+            }
+            catch (...)
+            {
+                fail("Unknown error");
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (++m_ended == tasks()) m_settled = std::chrono::steady_clock::now();
+    }
+
+    void cancel() { m_cancelled = true; }
+
+    // True if the job has settled, in which case "since" is set to the time
+    // at which it did.
+    bool settled(std::chrono::steady_clock::time_point& since) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        since = m_settled;
+        return m_ended == tasks();
+    }
+
+    // Removes the files written by the job, once it has settled.  Files that
+    // outlive their job, like static tiles, are left in place.
+    virtual void clean() { }
+
+    const std::string& resource() const { return m_session->name(); }
+
+    Json::Value status() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Json::Value json;
+        json["id"] = m_id;
+        json["path"] = path();
+        json["tiles"] = static_cast<Json::UInt64>(tasks());
+        json["tilesDone"] = static_cast<Json::UInt64>(m_tasksDone);
+        json["points"] = static_cast<Json::UInt64>(m_points);
+        json["bytes"] = static_cast<Json::UInt64>(m_bytes);
+        json["files"] = m_files;
+
+        if (!m_error.empty())
+        {
+            json["state"] = "failed";
+            json["error"] = m_error;
+        }
+        else if (m_cancelled) json["state"] = "cancelled";
+        else if (m_tasksDone == tasks()) json["state"] = "done";
+        else json["state"] = "running";
+
+        return json;
+    }
+
+protected:
+    virtual void work(std::size_t index) = 0;
+
+    // The directory to which files are written.
+    virtual std::string path() const = 0;
+
+    // Called once, after every task has completed successfully.
+    virtual void complete() { }
+
+    // Writes the response of "query" to "path", through a temporary file so
+    // that a partial file is never visible.  Returns the number of bytes
+    // written, or zero if the job was cancelled or there were no points, in
+    // which case no file is written.
+    uint64_t write(ReadQuery& query, const std::string& path)
+    {
+        const std::string temp(path + ".tmp");
+
+        std::ofstream stream(
+                temp,
+                std::ios::out | std::ios::binary | std::ios::trunc);
+
+        std::vector<char> buffer;
+        uint64_t bytes(0);
+
+        while (!query.done() && !m_cancelled && stream.good())
+        {
+            buffer.clear();
+            query.read(buffer);
+            stream.write(buffer.data(), buffer.size());
+            bytes += buffer.size();
+        }
+
+        stream.close();
+
+        if (m_cancelled || !query.numPoints() || !stream)
+        {
+            std::remove(temp.c_str());
+
+            if (!stream) throw std::runtime_error("Could not write " + temp);
+            return 0;
+        }
+
+        if (std::rename(temp.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temp.c_str());
+            throw std::runtime_error("Could not write " + path);
+        }
+
+        return bytes;
+    }
+
+    // Records a completed task, and the file it wrote, if any.
+    void finish(const std::string& name, uint64_t points, uint64_t bytes)
+    {
+        bool last(false);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            last = ++m_tasksDone == tasks();
+            m_points += points;
+            m_bytes += bytes;
+
+            if (bytes)
+            {
+                Json::Value file;
+                file["name"] = name;
+                file["points"] = static_cast<Json::UInt64>(points);
+                file["bytes"] = static_cast<Json::UInt64>(bytes);
+                m_files.append(file);
+            }
+        }
+
+        if (last && !m_cancelled) complete();
+    }
+
+    void fail(const std::string& message)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_error.empty()) m_error = message;
+        m_cancelled = true;
+    }
+
+    const std::string m_id;
+    const std::shared_ptr<Session> m_session;
+    std::atomic<bool> m_cancelled;
+
+private:
+    mutable std::mutex m_mutex;
+    std::size_t m_ended = 0;
+    std::chrono::steady_clock::time_point m_settled;
+    std::size_t m_tasksDone = 0;
+    uint64_t m_points = 0;
+    uint64_t m_bytes = 0;
+    Json::Value m_files = Json::Value(Json::arrayValue);
+    std::string m_error;
+};
+
+// A bulk export of a read to local files, split into the cells of a
+// resumable read so that its tiles may be written in parallel.  Each tile is
+// written to "<index>.<format>" in the directory of the job, and tiles
+// without points are omitted.
+class ExportJob : public Job
+{
+public:
+    ExportJob(
+            const std::string& id,
+            std::shared_ptr<Session> session,
+            const std::string& root,
+            std::unique_ptr<entwine::Bounds> bounds,
+            const Json::Value& boxList,
+            std::unique_ptr<entwine::Scale> scale,
+            std::unique_ptr<entwine::Offset> offset,
+            std::size_t depthBegin,
+            std::size_t depthEnd,
+            std::unique_ptr<entwine::Schema> schema,
+            const Json::Value& filter,
+            ReadFormat format,
+            bool compress)
+        : Job(id, session)
+        , m_dir(root + id + '/')
+        , m_bounds(std::move(bounds))
+        , m_boxes(boxList)
+        , m_scale(std::move(scale))
+        , m_offset(std::move(offset))
+        , m_depthBegin(depthBegin)
+        , m_depthEnd(depthEnd)
+        , m_schema(std::move(schema))
+        , m_filter(filter)
+        , m_format(format)
+        , m_compress(compress)
+    { }
+
+    // Every tile is read from the version of the index in use when the job
+    // is planned, so that the point count of a LAS tile, which is taken by
+    // a pass of its own, matches the points written after it.
+    virtual void plan() override
+    {
+        m_pin = m_session->pin();
+        m_info = m_session->info(*m_pin);
+
+        if (m_format == ReadFormat::Las)
+        {
+            m_las = entwine::makeUnique<las::Header>(
+                    las::prepare(m_info, m_scale, m_offset, m_bounds));
+
+            m_schema = entwine::makeUnique<entwine::Schema>(
+                    las::schema(m_las->rgb));
+        }
+
+        const entwine::Bounds cubic(
+                m_session->bounds(m_scale.get(), m_offset.get(), m_pin.get()));
+
+        m_cells = Cursor::cells(
+                cubic,
+                m_bounds ? *m_bounds : cubic,
+                m_info["baseDepth"].asUInt64(),
+                m_info["type"].asString() == "octree");
+
+        boxes::prune(m_cells, m_boxes);
+
+        if (::mkdir(m_dir.c_str(), 0755) != 0)
+        {
+            throw std::runtime_error("Could not create " + m_dir);
+        }
+    }
+
+    virtual std::size_t tasks() const override { return m_cells.size(); }
+
+    virtual void clean() override
+    {
+        if (DIR* dir = ::opendir(m_dir.c_str()))
+        {
+            while (const dirent* entry = ::readdir(dir))
+            {
+                const std::string name(entry->d_name);
+                if (name != "." && name != "..")
+                {
+                    std::remove((m_dir + name).c_str());
+                }
+            }
+
+            ::closedir(dir);
+        }
+
+        ::rmdir(m_dir.c_str());
+    }
+
+protected:
+    virtual std::string path() const override { return m_dir; }
+
+    virtual void work(std::size_t index) override
+    {
+        const entwine::Bounds& cell(m_cells[index]);
+        std::unique_ptr<las::Header> header;
+
+        if (m_las)
+        {
+            // The header of each tile holds its own bounds and point count.
+            std::unique_ptr<entwine::Bounds> tileBounds(
+                    entwine::makeUnique<entwine::Bounds>(cell));
+
+            header = entwine::makeUnique<las::Header>(
+                    las::prepare(m_info, m_scale, m_offset, tileBounds));
+
+            const entwine::Schema countSchema(las::countSchema());
+            std::unique_ptr<ReadQuery> counter(query(cell, &countSchema));
+
+            std::vector<char> buffer;
+            while (!counter->done() && !m_cancelled)
+            {
+                buffer.clear();
+                counter->read(buffer);
+            }
+
+            if (m_cancelled) return;
+
+            header->numPoints = counter->numPoints();
+            if (!header->numPoints) return finish("", 0, 0);
+        }
+
+        std::unique_ptr<ReadQuery> q(query(cell, m_schema.get()));
+        q->setFormat(m_format);
+        if (header) q->setLas(*header);
+
+        const std::string name(filename(index));
+        const uint64_t bytes(write(*q, m_dir + name));
+
+        if (!m_cancelled) finish(name, bytes ? q->numPoints() : 0, bytes);
+    }
+
+private:
+    std::unique_ptr<ReadQuery> query(
+            const entwine::Bounds& cell,
+            const entwine::Schema* schema) const
+    {
+        return m_session->getQuery(
+                &cell,
+                m_depthBegin,
+                m_depthEnd,
+                m_scale.get(),
+                m_offset.get(),
+                schema,
+                m_filter,
+                m_compress,
+                m_pin.get());
+    }
+
+    std::string filename(std::size_t index) const
+    {
+        switch (m_format)
+        {
+            case ReadFormat::Framed: return std::to_string(index) + ".framed";
+            case ReadFormat::Arrow: return std::to_string(index) + ".arrow";
+            case ReadFormat::Las: return std::to_string(index) + ".las";
+            default: return std::to_string(index) + ".bin";
+        }
+    }
+
+    const std::string m_dir;
+
+    std::unique_ptr<entwine::Bounds> m_bounds;
+    const Json::Value m_boxes;
+    std::unique_ptr<entwine::Scale> m_scale;
+    std::unique_ptr<entwine::Offset> m_offset;
+    const std::size_t m_depthBegin;
+    const std::size_t m_depthEnd;
+    std::unique_ptr<entwine::Schema> m_schema;
+    const Json::Value m_filter;
+    const ReadFormat m_format;
+    const bool m_compress;
+
+    std::shared_ptr<Session::State> m_pin;
+    Json::Value m_info;
+    std::unique_ptr<las::Header> m_las;
+    std::vector<entwine::Bounds> m_cells;
+};
+
+// Runs background jobs on a dedicated pool of threads at a lowered
+// scheduling priority, so that they yield the CPU to interactive reads.  Jobs
+// are retained for a while after they settle, and then forgotten along with
+// their files.
+class Exports
+{
+public:
+    Exports(const Json::Value& config)
+        : m_path(config["path"].asString())
+        , m_nice(config.isMember("nice") ? config["nice"].asInt() : 19)
+        , m_ttl(
+                config.isMember("ttlSeconds") ?
+                    config["ttlSeconds"].asUInt64() : 3600)
+        , m_pool(
+                config.isMember("threads") ?
+                    config["threads"].asUInt64() : 2)
+    {
+        if (m_path.empty()) return;
+        if (m_path.back() != '/') m_path.push_back('/');
+
+        struct stat s;
+        if (::stat(m_path.c_str(), &s) != 0 && ::mkdir(m_path.c_str(), 0755))
+        {
+            throw std::runtime_error("Could not create " + m_path);
+        }
+    }
+
+    // The directory in which export jobs create their own directories.
+    const std::string& path() const
+    {
+        if (m_path.empty())
+        {
+            throw std::runtime_error("Export path must be specified");
+        }
+
+        return m_path;
+    }
+
+    // Plans a job of type T, constructed with a new ID followed by "args",
+    // and queues its tasks, returning its ID.  Planning opens the index, so
+    // this must not be called from the main loop.
+    template<typename T, typename... Args>
+    std::string start(Args&&... args)
+    {
+        sweep();
+
+        const std::string id(nextId());
+        std::shared_ptr<Job> job(
+                std::make_shared<T>(id, std::forward<Args>(args)...));
+
+        job->plan();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs[id] = job;
+        }
+
+        const int nice(m_nice);
+        for (std::size_t i(0); i < job->tasks(); ++i)
+        {
+            m_pool.add([job, i, nice]()
+            {
+                background(nice);
+                job->run(i);
+            });
+        }
+
+        return id;
+    }
+
+    Json::Value status(const std::string& resource, const std::string& id)
+    {
+        sweep();
+        return get(resource, id)->status();
+    }
+
+    void cancel(const std::string& resource, const std::string& id)
+    {
+        sweep();
+        get(resource, id)->cancel();
+    }
+
+    Json::Value stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Json::Value json;
+        json["jobs"] = static_cast<Json::UInt64>(m_jobs.size());
+        json["removed"] = static_cast<Json::UInt64>(m_removed);
+        return json;
+    }
+
+private:
+    // Forgets the jobs that settled more than the TTL ago, and removes their
+    // files.  This is done as jobs are accessed, rather than on a timer, so
+    // it must not be called from the main loop.
+    void sweep()
+    {
+        const auto now(std::chrono::steady_clock::now());
+        std::vector<std::shared_ptr<Job>> expired;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            auto it(m_jobs.begin());
+            while (it != m_jobs.end())
+            {
+                std::chrono::steady_clock::time_point since;
+                if (it->second->settled(since) && now - since >= m_ttl)
+                {
+                    expired.push_back(it->second);
+                    it = m_jobs.erase(it);
+                    ++m_removed;
+                }
+                else ++it;
+            }
+        }
+
+        for (const auto& job : expired) job->clean();
+    }
+
+    // Jobs are only visible through the resource from which they were
+    // started, so that access to them follows access to the resource.  The
+    // job is shared, since a sweep may forget it while it is in use.
+    std::shared_ptr<Job> get(const std::string& resource, const std::string& id)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it(m_jobs.find(id));
+        if (it == m_jobs.end() || it->second->resource() != resource)
+        {
+            throw std::runtime_error("No export " + id);
+        }
+
+        return it->second;
+    }
+
+    std::string nextId()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        const auto now(std::chrono::system_clock::now().time_since_epoch());
+        return toHex(fnv1a(
+                    std::to_string(now.count()) + '-' +
+                    std::to_string(++m_count)));
+    }
+
+    static void background(int nice)
+    {
+#ifdef __linux__
+        // On Linux, priority is per thread.
+        static thread_local bool lowered(false);
+
+        if (!lowered)
+        {
+            ::setpriority(PRIO_PROCESS, ::syscall(SYS_gettid), nice);
+            lowered = true;
+        }
+#endif
+    }
+
+    std::string m_path;
+    const int m_nice;
+    const std::chrono::seconds m_ttl;
+    ThreadPool m_pool;
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<Job>> m_jobs;
+    uint64_t m_count = 0;
+    uint64_t m_removed = 0;
+};
+
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Responses that multiplex several streams are a sequence of frames, each a
+// 12-byte header of little-endian uint32 values - the stream index, flags,
+// and the payload length - followed by the payload.  The payloads of a
+// single stream, concatenated in order, are exactly what that stream would
+// produce on its own.
+namespace frames
+{
+
+// Set on the final frame of a stream.
+const uint32_t last(1);
+
+// Set on a frame whose payload is JSON describing its stream, rather than
+// part of the stream itself.
+const uint32_t meta(2);
+
+const std::size_t headerSize(3 * sizeof(uint32_t));
+
+inline void putUint32(std::vector<char>& out, uint32_t v)
+{
+    for (std::size_t i(0); i < sizeof(uint32_t); ++i)
+    {
+        out.push_back(static_cast<char>((v >> (i * 8)) & 0xFF));
+    }
+}
+
+inline void append(
+        std::vector<char>& out,
+        uint32_t index,
+        uint32_t flags,
+        const std::vector<char>& payload)
+{
+    out.reserve(out.size() + headerSize + payload.size());
+
+    putUint32(out, index);
+    putUint32(out, flags);
+    putUint32(out, static_cast<uint32_t>(payload.size()));
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+} // namespace frames
+
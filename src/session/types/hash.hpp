@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+// A 64-bit FNV-1a hash.  Unlike std::hash, this is stable across platforms
+// and builds, so it may be used for values that are persisted to disk or
+// handed to clients.
+inline uint64_t fnv1a(const char* data, std::size_t size)
+{
+    uint64_t hash(14695981039346656037ULL);
+
+    for (std::size_t i(0); i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+inline uint64_t fnv1a(const std::string& s)
+{
+    return fnv1a(s.data(), s.size());
+}
+
+inline std::string toHex(uint64_t v)
+{
+    std::ostringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << v;
+    return ss.str();
+}
+
+// Resource names may contain slashes, so make them filename-safe and
+// disambiguate any resulting collisions with a hash of the real name.
+inline std::string safeName(const std::string& name)
+{
+    std::string safe(name);
+    for (char& c : safe)
+    {
+        if (!std::isalnum(static_cast<unsigned char>(c)) &&
+                c != '-' && c != '_' && c != '.')
+        {
+            c = '_';
+        }
+    }
+
+    return safe + "-" + toHex(fnv1a(name));
+}
+
+// A temporary name beside "path" that no other thread, in this or any other
+// process sharing the directory, will use while it is being written.
+inline std::string tempName(const std::string& path)
+{
+    std::ostringstream ss;
+    ss << ::getpid() << '-' << std::this_thread::get_id();
+    return path + "." + toHex(fnv1a(ss.str())) + ".tmp";
+}
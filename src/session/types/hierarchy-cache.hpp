@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <json/json.h>
+
+// A byte-bounded LRU of hierarchy query results, shared by all sessions and
+// keyed by the query.  This caches results in front of each reader, which
+// still holds its own hierarchy, so it saves repeated traversals rather than
+// bounding the memory or the opening cost of a resource.
+class HierarchyCache
+{
+public:
+    using Result = std::shared_ptr<const Json::Value>;
+
+    HierarchyCache(std::size_t maxBytes) : m_maxBytes(maxBytes) { }
+
+    Result get(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it(m_map.find(key));
+        if (it == m_map.end())
+        {
+            ++m_misses;
+            return Result();
+        }
+
+        ++m_hits;
+        m_list.splice(m_list.begin(), m_list, it->second);
+        return it->second->result;
+    }
+
+    void set(const std::string& key, Result result, std::size_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Another thread may have computed the same result concurrently.
+        if (m_map.count(key)) return;
+
+        // Never let a single oversized result evict the entire cache.
+        if (size > m_maxBytes / 4) return;
+
+        m_list.emplace_front(key, result, size);
+        m_map[key] = m_list.begin();
+        m_bytes += size;
+
+        while (m_bytes > m_maxBytes && m_list.size() > 1)
+        {
+            const Entry& entry(m_list.back());
+            m_bytes -= entry.size;
+            m_map.erase(entry.key);
+            m_list.pop_back();
+            ++m_evictions;
+        }
+    }
+
+    // Drop every result whose key begins with "prefix".
+    void clear(const std::string& prefix)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it(m_list.begin());
+        while (it != m_list.end())
+        {
+            if (it->key.compare(0, prefix.size(), prefix) == 0)
+            {
+                m_bytes -= it->size;
+                m_map.erase(it->key);
+                it = m_list.erase(it);
+            }
+            else ++it;
+        }
+    }
+
+    std::size_t bytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_bytes;
+    }
+
+    Json::Value stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Json::Value json;
+        json["bytes"] = static_cast<Json::UInt64>(m_bytes);
+        json["maxBytes"] = static_cast<Json::UInt64>(m_maxBytes);
+        json["results"] = static_cast<Json::UInt64>(m_list.size());
+        json["hits"] = static_cast<Json::UInt64>(m_hits);
+        json["misses"] = static_cast<Json::UInt64>(m_misses);
+        json["evictions"] = static_cast<Json::UInt64>(m_evictions);
+        return json;
+    }
+
+private:
+    struct Entry
+    {
+        Entry(const std::string& key, Result result, std::size_t size)
+            : key(key)
+            , result(result)
+            , size(size)
+        { }
+
+        std::string key;
+        Result result;
+        std::size_t size;
+    };
+
+    const std::size_t m_maxBytes;
+
+    std::size_t m_bytes = 0;
+    std::size_t m_hits = 0;
+    std::size_t m_misses = 0;
+    std::size_t m_evictions = 0;
+    std::list<Entry> m_list;
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_map;
+
+    mutable std::mutex m_mutex;
+};
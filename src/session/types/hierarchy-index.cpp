@@ -0,0 +1,458 @@
+#include "types/hierarchy-index.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "types/hash.hpp"
+#include "types/hierarchy.hpp"
+
+namespace
+{
+    const char magic[8] = { 'G', 'H', 'H', 'I', 'D', 'X', '0', '1' };
+
+    uint64_t numWords(uint64_t bits) { return (bits + 63) / 64; }
+
+    std::size_t bitsFor(uint64_t v)
+    {
+        std::size_t bits(1);
+        while (bits < 64 && (v >> bits)) ++bits;
+        return bits;
+    }
+}
+
+struct HierarchyIndex::Header
+{
+    char magic[8];
+    uint64_t version;
+    uint64_t numNodes;
+    uint32_t depthBegin;
+    uint32_t depthEnd;
+    uint32_t countBits;
+    uint32_t is3d;
+};
+
+HierarchyIndex::HierarchyIndex(
+        const char* data,
+        const std::size_t size,
+        const bool mapped)
+    : m_data(data)
+    , m_size(size)
+    , m_mapped(mapped)
+{ }
+
+HierarchyIndex::~HierarchyIndex()
+{
+    if (m_mapped) ::munmap(const_cast<char*>(m_data), m_size);
+}
+
+std::unique_ptr<HierarchyIndex> HierarchyIndex::create(
+        const Json::Value& hierarchy,
+        const std::size_t depthBegin,
+        const std::size_t depthEnd,
+        const bool is3d,
+        const uint64_t version,
+        const std::string& path)
+{
+    std::vector<char> data(
+            build(hierarchy, depthBegin, depthEnd, is3d, version));
+
+    if (path.empty())
+    {
+        std::unique_ptr<HierarchyIndex> index(
+                new HierarchyIndex(nullptr, data.size(), false));
+        index->m_owned.swap(data);
+        index->m_data = index->m_owned.data();
+        index->validate();
+        return index;
+    }
+
+    const std::string temp(tempName(path));
+
+    {
+        std::ofstream stream(
+                temp,
+                std::ios::out | std::ios::binary | std::ios::trunc);
+        stream.write(data.data(), data.size());
+
+        if (!stream.good())
+        {
+            throw std::runtime_error("Could not write " + temp);
+        }
+    }
+
+    if (std::rename(temp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temp.c_str());
+        throw std::runtime_error("Could not write " + path);
+    }
+
+    std::unique_ptr<HierarchyIndex> index(open(path, version));
+    if (!index) throw std::runtime_error("Could not map " + path);
+    return index;
+}
+
+std::unique_ptr<HierarchyIndex> HierarchyIndex::open(
+        const std::string& path,
+        const uint64_t version)
+{
+    std::unique_ptr<HierarchyIndex> index;
+
+    const int fd(::open(path.c_str(), O_RDONLY));
+    if (fd < 0) return index;
+
+    struct stat s;
+    if (::fstat(fd, &s) != 0 || s.st_size < (off_t)sizeof(Header))
+    {
+        ::close(fd);
+        return index;
+    }
+
+    const std::size_t size(s.st_size);
+    void* data(::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
+    ::close(fd);
+
+    if (data == MAP_FAILED) return index;
+
+    index.reset(new HierarchyIndex(static_cast<char*>(data), size, true));
+
+    try
+    {
+        index->validate();
+        if (index->header().version != version) index.reset();
+    }
+    catch (...)
+    {
+        index.reset();
+    }
+
+    return index;
+}
+
+std::vector<char> HierarchyIndex::build(
+        const Json::Value& hierarchy,
+        const std::size_t depthBegin,
+        const std::size_t depthEnd,
+        const bool is3d,
+        const uint64_t version)
+{
+    if (depthEnd <= depthBegin)
+    {
+        throw std::runtime_error("Invalid hierarchy index depths");
+    }
+
+    const std::size_t numLevels(depthEnd - depthBegin);
+    const unsigned int numChildren(is3d ? 8 : 4);
+
+    std::vector<uint8_t> masks;
+    std::vector<uint64_t> counts;
+    uint64_t maxCount(0);
+
+    // Breadth-first, so nodes are appended in level order.
+    std::vector<const Json::Value*> level;
+    std::vector<const Json::Value*> next;
+
+    if (hierarchy.isObject() && hierarchy["n"].asUInt64())
+    {
+        level.push_back(&hierarchy);
+    }
+
+    for (std::size_t l(0); l < numLevels && !level.empty(); ++l)
+    {
+        next.clear();
+
+        for (const Json::Value* node : level)
+        {
+            const uint64_t n((*node)["n"].asUInt64());
+            counts.push_back(n);
+            maxCount = std::max(maxCount, n);
+
+            uint8_t mask(0);
+
+            if (l + 1 < numLevels)
+            {
+                for (unsigned int c(0); c < numChildren; ++c)
+                {
+                    const Json::Value& child(
+                            (*node)[hierarchy::direction(c, is3d)]);
+
+                    if (child.isObject() && child["n"].asUInt64())
+                    {
+                        mask |= 1 << c;
+                        next.push_back(&child);
+                    }
+                }
+            }
+
+            masks.push_back(mask);
+        }
+
+        level.swap(next);
+    }
+
+    const uint64_t numNodes(counts.size());
+    const std::size_t countBits(bitsFor(maxCount));
+    const uint64_t numBlocks(numWords(numNodes * 8));
+    const uint64_t countWords(numWords(numNodes * countBits));
+
+    std::vector<char> data(
+            sizeof(Header) + (numBlocks * 2 + countWords) * sizeof(uint64_t),
+            0);
+
+    Header header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.numNodes = numNodes;
+    header.depthBegin = depthBegin;
+    header.depthEnd = depthEnd;
+    header.countBits = countBits;
+    header.is3d = is3d;
+    std::memcpy(data.data(), &header, sizeof(Header));
+
+    char* pos(data.data() + sizeof(Header));
+    std::memcpy(pos, masks.data(), masks.size());
+
+    // Rank directory: the number of set mask bits preceding each block.
+    uint64_t* ranks(
+            reinterpret_cast<uint64_t*>(pos + numBlocks * sizeof(uint64_t)));
+    const uint64_t* blocks(reinterpret_cast<const uint64_t*>(pos));
+    uint64_t total(0);
+
+    for (uint64_t i(0); i < numBlocks; ++i)
+    {
+        ranks[i] = total;
+        total += __builtin_popcountll(blocks[i]);
+    }
+
+    uint64_t* packed(ranks + numBlocks);
+
+    for (uint64_t i(0); i < numNodes; ++i)
+    {
+        const uint64_t bit(i * countBits);
+        const uint64_t word(bit / 64);
+        const uint64_t shift(bit % 64);
+
+        packed[word] |= counts[i] << shift;
+        if (shift + countBits > 64)
+        {
+            packed[word + 1] |= counts[i] >> (64 - shift);
+        }
+    }
+
+    return data;
+}
+
+void HierarchyIndex::validate() const
+{
+    if (m_size < sizeof(Header))
+    {
+        throw std::runtime_error("Invalid hierarchy index");
+    }
+
+    const Header& h(header());
+
+    if (
+            std::memcmp(h.magic, magic, sizeof(magic)) ||
+            h.depthEnd <= h.depthBegin ||
+            h.countBits < 1 || h.countBits > 64)
+    {
+        throw std::runtime_error("Invalid hierarchy index");
+    }
+
+    const uint64_t numBlocks(numWords(h.numNodes * 8));
+    const uint64_t countWords(numWords(h.numNodes * h.countBits));
+
+    if (
+            m_size !=
+            sizeof(Header) + (numBlocks * 2 + countWords) * sizeof(uint64_t))
+    {
+        throw std::runtime_error("Invalid hierarchy index size");
+    }
+
+    const uint64_t* words(
+            reinterpret_cast<const uint64_t*>(m_data + sizeof(Header)));
+
+    HierarchyIndex& self(const_cast<HierarchyIndex&>(*this));
+    self.m_masks = words;
+    self.m_ranks = words + numBlocks;
+    self.m_counts = words + numBlocks * 2;
+}
+
+const HierarchyIndex::Header& HierarchyIndex::header() const
+{
+    return *reinterpret_cast<const Header*>(m_data);
+}
+
+std::size_t HierarchyIndex::depthBegin() const
+{
+    return header().depthBegin;
+}
+
+std::size_t HierarchyIndex::depthEnd() const
+{
+    return header().depthEnd;
+}
+
+bool HierarchyIndex::is3d() const
+{
+    return header().is3d;
+}
+
+uint64_t HierarchyIndex::numNodes() const
+{
+    return header().numNodes;
+}
+
+uint8_t HierarchyIndex::mask(const uint64_t index) const
+{
+    return reinterpret_cast<const uint8_t*>(m_masks)[index];
+}
+
+uint64_t HierarchyIndex::rank(const uint64_t bit) const
+{
+    const uint64_t block(bit / 64);
+    const uint64_t offset(bit % 64);
+
+    uint64_t result(m_ranks[block]);
+    if (offset)
+    {
+        const uint64_t mask((static_cast<uint64_t>(1) << offset) - 1);
+        result += __builtin_popcountll(m_masks[block] & mask);
+    }
+    return result;
+}
+
+HierarchyIndex::Node HierarchyIndex::root() const
+{
+    return Node(numNodes() ? 0 : Node::invalid, 0);
+}
+
+HierarchyIndex::Node HierarchyIndex::child(
+        const Node& node,
+        const unsigned int c) const
+{
+    if (!node || c >= 8 || !((mask(node.m_index) >> c) & 1))
+    {
+        return Node(Node::invalid, node.m_level + 1);
+    }
+
+    // The root occupies index zero, and every other node is the child of
+    // exactly one preceding node, in order.
+    return Node(1 + rank(node.m_index * 8 + c), node.m_level + 1);
+}
+
+HierarchyIndex::Node HierarchyIndex::find(const Key& key) const
+{
+    if (!contains(key.depth)) return Node(Node::invalid, 0);
+
+    const std::size_t level(key.depth - depthBegin());
+    if (level < 64 && ((key.x | key.y | key.z) >> level))
+    {
+        return Node(Node::invalid, level);
+    }
+
+    Node node(root());
+
+    for (std::size_t i(level); i > 0 && node; --i)
+    {
+        const std::size_t b(i - 1);
+        const unsigned int c(
+                ((key.x >> b) & 1) |
+                (((key.y >> b) & 1) << 1) |
+                (((key.z >> b) & 1) << 2));
+
+        node = child(node, c);
+    }
+
+    return node;
+}
+
+uint64_t HierarchyIndex::count(const Node& node) const
+{
+    if (!node) return 0;
+
+    const uint64_t bits(header().countBits);
+    const uint64_t bit(node.m_index * bits);
+    const uint64_t word(bit / 64);
+    const uint64_t shift(bit % 64);
+
+    uint64_t v(m_counts[word] >> shift);
+    if (shift + bits > 64) v |= m_counts[word + 1] << (64 - shift);
+
+    return bits == 64 ? v : v & ((static_cast<uint64_t>(1) << bits) - 1);
+}
+
+Json::Value HierarchyIndex::hierarchy(
+        const Key& key,
+        const std::size_t depthEnd) const
+{
+    if (!contains(key.depth) || depthEnd > this->depthEnd())
+    {
+        throw std::runtime_error("Hierarchy query outside of index");
+    }
+
+    Json::Value json;
+    const Node node(find(key));
+    if (node && depthEnd > key.depth)
+    {
+        hierarchy(node, depthEnd - key.depth, json);
+    }
+    return json;
+}
+
+void HierarchyIndex::hierarchy(
+        const Node& node,
+        const std::size_t levels,
+        Json::Value& json) const
+{
+    json["n"] = static_cast<Json::UInt64>(count(node));
+    if (levels <= 1) return;
+
+    const unsigned int numChildren(is3d() ? 8 : 4);
+    for (unsigned int c(0); c < numChildren; ++c)
+    {
+        if (const Node next = child(node, c))
+        {
+            hierarchy(next, levels - 1, json[hierarchy::direction(c, is3d())]);
+        }
+    }
+}
+
+Json::Value HierarchyIndex::vertical(
+        const Key& key,
+        const std::size_t depthEnd) const
+{
+    if (!contains(key.depth) || depthEnd > this->depthEnd())
+    {
+        throw std::runtime_error("Hierarchy query outside of index");
+    }
+
+    Json::Value counts(Json::arrayValue);
+    if (depthEnd > key.depth) counts.resize(depthEnd - key.depth);
+    for (auto& c : counts) c = 0;
+
+    vertical(find(key), 0, counts);
+    return counts;
+}
+
+void HierarchyIndex::vertical(
+        const Node& node,
+        const Json::ArrayIndex level,
+        Json::Value& counts) const
+{
+    if (!node || level >= counts.size()) return;
+
+    counts[level] = counts[level].asUInt64() + count(node);
+
+    const unsigned int numChildren(is3d() ? 8 : 4);
+    for (unsigned int c(0); c < numChildren; ++c)
+    {
+        vertical(child(node, c), level + 1, counts);
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include "types/key.hpp"
+
+// Process-wide counts of hierarchy index use, for monitoring.
+struct HierarchyIndexStats
+{
+    // Indexes built from the resource, or mapped from a previous build.
+    std::atomic<uint64_t> built{0};
+    std::atomic<uint64_t> opened{0};
+
+    // Hierarchy queries answered from an index.
+    std::atomic<uint64_t> answered{0};
+
+    Json::Value toJson() const
+    {
+        Json::Value json;
+        json["built"] = static_cast<Json::UInt64>(built);
+        json["opened"] = static_cast<Json::UInt64>(opened);
+        json["answered"] = static_cast<Json::UInt64>(answered);
+        return json;
+    }
+};
+
+// A compact, read-only representation of the full-bounds hierarchy of a
+// resource, for depths [depthBegin, depthEnd), which may be memory-mapped
+// from disk.
+//
+// Nodes are stored in level order.  Each node has an 8-bit child occupancy
+// mask, with the child index formed from the X, Y, and Z halves in the low,
+// middle, and high bits respectively.  A rank directory over the masks gives
+// the level-order index of any child in constant time, and point counts are
+// bit-packed to the width of the largest count.  Walking the tree allocates
+// nothing, so lookups are cheap enough to use on every query.
+class HierarchyIndex
+{
+public:
+    // A position in the tree.  Invalid nodes, which represent empty space,
+    // have a count of zero and no children.
+    class Node
+    {
+        friend class HierarchyIndex;
+
+    public:
+        bool valid() const { return m_index != invalid; }
+        explicit operator bool() const { return valid(); }
+
+    private:
+        Node(uint64_t index, std::size_t level)
+            : m_index(index)
+            , m_level(level)
+        { }
+
+        static constexpr uint64_t invalid = ~static_cast<uint64_t>(0);
+
+        uint64_t m_index;
+        std::size_t m_level;
+    };
+
+    ~HierarchyIndex();
+
+    // Builds an index from a nested full-bounds hierarchy starting at
+    // "depthBegin".  If "path" is non-empty, the index is written there and
+    // then mapped, otherwise it is held in memory.
+    static std::unique_ptr<HierarchyIndex> create(
+            const Json::Value& hierarchy,
+            std::size_t depthBegin,
+            std::size_t depthEnd,
+            bool is3d,
+            uint64_t version,
+            const std::string& path = "");
+
+    // Maps an existing index, returning null if it does not exist or was
+    // built from a different version of the resource.
+    static std::unique_ptr<HierarchyIndex> open(
+            const std::string& path,
+            uint64_t version);
+
+    std::size_t depthBegin() const;
+    std::size_t depthEnd() const;
+    bool is3d() const;
+    uint64_t numNodes() const;
+
+    // Number of bytes occupied by this index.
+    std::size_t size() const { return m_size; }
+
+    bool contains(std::size_t depth) const
+    {
+        return depth >= depthBegin() && depth < depthEnd();
+    }
+
+    Node root() const;
+    Node child(const Node& node, unsigned int c) const;
+    Node find(const Key& key) const;
+
+    uint64_t count(const Node& node) const;
+    uint64_t count(const Key& key) const { return count(find(key)); }
+
+    // Reconstruct the hierarchy query response for the given node, to
+    // "depthEnd", which must be within this index.
+    Json::Value hierarchy(const Key& key, std::size_t depthEnd) const;
+    Json::Value vertical(const Key& key, std::size_t depthEnd) const;
+
+private:
+    struct Header;
+
+    HierarchyIndex(const char* data, std::size_t size, bool mapped);
+
+    static std::vector<char> build(
+            const Json::Value& hierarchy,
+            std::size_t depthBegin,
+            std::size_t depthEnd,
+            bool is3d,
+            uint64_t version);
+
+    void validate() const;
+
+    void hierarchy(
+            const Node& node,
+            std::size_t levels,
+            Json::Value& json) const;
+
+    void vertical(
+            const Node& node,
+            Json::ArrayIndex level,
+            Json::Value& counts) const;
+
+    const Header& header() const;
+    uint64_t rank(uint64_t bit) const;
+    uint8_t mask(uint64_t index) const;
+
+    const char* m_data;
+    std::size_t m_size;
+    bool m_mapped;
+
+    // Only populated if this index is not memory-mapped.
+    std::vector<char> m_owned;
+
+    const uint64_t* m_masks = nullptr;
+    const uint64_t* m_ranks = nullptr;
+    const uint64_t* m_counts = nullptr;
+
+    HierarchyIndex(const HierarchyIndex&);
+    HierarchyIndex& operator=(const HierarchyIndex&);
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/types/bounds.hpp>
+
+// Helpers for the nested hierarchy format returned by entwine.  Each level is
+// an object with a point count "n", and a member for each non-empty bisection
+// of its bounds keyed by direction: north/south (Y), east/west (X), and for
+// octrees, up/down (Z) - for example "nwu".
+namespace hierarchy
+{
+
+inline std::vector<std::string> children(const Json::Value& node)
+{
+    std::vector<std::string> keys(node.getMemberNames());
+    for (std::size_t i(0); i < keys.size(); ++i)
+    {
+        if (keys[i] == "n")
+        {
+            keys.erase(keys.begin() + i);
+            break;
+        }
+    }
+    return keys;
+}
+
+// Direction key for a child index, which has the east, north, and up halves
+// in its low, middle, and high bits respectively.
+inline std::string direction(unsigned int c, bool is3d)
+{
+    std::string dir;
+    dir.push_back(c & 2 ? 'n' : 's');
+    dir.push_back(c & 1 ? 'e' : 'w');
+    if (is3d) dir.push_back(c & 4 ? 'u' : 'd');
+    return dir;
+}
+
+// Bounds of the bisection of "bounds" in the direction "dir".
+inline entwine::Bounds bisect(
+        const entwine::Bounds& bounds,
+        const std::string& dir)
+{
+    if (dir.size() < 2 || dir.size() > 3)
+    {
+        throw std::runtime_error("Invalid hierarchy direction: " + dir);
+    }
+
+    const entwine::Point& min(bounds.min());
+    const entwine::Point& max(bounds.max());
+    const entwine::Point mid(
+            min.x + (max.x - min.x) / 2.0,
+            min.y + (max.y - min.y) / 2.0,
+            min.z + (max.z - min.z) / 2.0);
+
+    entwine::Point lo(min);
+    entwine::Point hi(max);
+
+    if (dir[0] == 'n') lo.y = mid.y; else hi.y = mid.y;
+    if (dir[1] == 'e') lo.x = mid.x; else hi.x = mid.x;
+
+    if (dir.size() == 3)
+    {
+        if (dir[2] == 'u') lo.z = mid.z; else hi.z = mid.z;
+    }
+
+    return entwine::Bounds(lo, hi);
+}
+
+// Copy the top "levels" levels of a hierarchy.
+inline Json::Value prune(const Json::Value& in, std::size_t levels)
+{
+    Json::Value out;
+    out["n"] = in["n"];
+
+    if (levels > 1)
+    {
+        for (const std::string& key : children(in))
+        {
+            out[key] = prune(in[key], levels - 1);
+        }
+    }
+
+    return out;
+}
+
+// Sum the counts at each level of a hierarchy into "out", which must already
+// be sized to the number of levels of interest.
+inline void flatten(
+        const Json::Value& in,
+        Json::Value& out,
+        Json::ArrayIndex level = 0)
+{
+    if (level >= out.size()) return;
+
+    out[level] = out[level].asUInt64() + in["n"].asUInt64();
+
+    for (const std::string& key : children(in))
+    {
+        flatten(in[key], out, level + 1);
+    }
+}
+
+// Collect the non-empty nodes "levels" levels below the root of a hierarchy
+// of "bounds", with their point counts.
+inline void leaves(
+        const Json::Value& in,
+        const entwine::Bounds& bounds,
+        std::size_t levels,
+        std::vector<std::pair<uint64_t, entwine::Bounds>>& out)
+{
+    if (!in.isObject()) return;
+
+    if (!levels)
+    {
+        const uint64_t n(in["n"].asUInt64());
+        if (n) out.emplace_back(n, bounds);
+        return;
+    }
+
+    for (const std::string& key : children(in))
+    {
+        leaves(in[key], bisect(bounds, key), levels - 1, out);
+    }
+}
+
+inline std::size_t numNodes(const Json::Value& in)
+{
+    std::size_t n(1);
+    for (const std::string& key : children(in)) n += numNodes(in[key]);
+    return n;
+}
+
+// Rough in-memory footprint of a hierarchy, for cache accounting.
+inline std::size_t estimateSize(const Json::Value& in)
+{
+    return numNodes(in) * 160;
+}
+
+} // namespace hierarchy
@@ -0,0 +1,957 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include <json/json.h>
+
+#include <entwine/types/bounds.hpp>
+#include <entwine/types/point.hpp>
+#include <entwine/types/schema.hpp>
+#include <entwine/util/unique.hpp>
+
+#include "session.hpp"
+#include "read-queries/base.hpp"
+#include "types/boxes.hpp"
+#include "types/buffer-pool.hpp"
+#include "types/key.hpp"
+#include "types/thread-pool.hpp"
+#include "types/tiles.hpp"
+
+// A minimal HTTP/1.1 server, for the data plane only: binary reads and node
+// reads.  Chunks go from the query to the socket on the thread that produced
+// them, without crossing into JS, and a slow client blocks its own query
+// rather than buffering its response.
+namespace http
+{
+
+using Headers = std::vector<std::pair<std::string, std::string>>;
+
+class Error : public std::runtime_error
+{
+public:
+    Error(int code, const std::string& message)
+        : std::runtime_error(message)
+        , code(code)
+    { }
+
+    const int code;
+};
+
+struct Request
+{
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> query;
+
+    // Header names are lowercased.
+    std::map<std::string, std::string> headers;
+    bool keepAlive = false;
+
+    std::string header(const std::string& name) const
+    {
+        const auto it(headers.find(name));
+        return it != headers.end() ? it->second : std::string();
+    }
+};
+
+inline std::string decode(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size());
+
+    for (std::size_t i(0); i < s.size(); ++i)
+    {
+        if (s[i] == '+') out.push_back(' ');
+        else if (s[i] == '%' && i + 2 < s.size() &&
+                std::isxdigit(static_cast<unsigned char>(s[i + 1])) &&
+                std::isxdigit(static_cast<unsigned char>(s[i + 2])))
+        {
+            out.push_back(static_cast<char>(
+                        std::stoi(s.substr(i + 1, 2), nullptr, 16)));
+            i += 2;
+        }
+        else out.push_back(s[i]);
+    }
+
+    return out;
+}
+
+inline std::string lower(std::string s)
+{
+    for (char& c : s) c = std::tolower(static_cast<unsigned char>(c));
+    return s;
+}
+
+inline Request parse(const std::string& head)
+{
+    Request req;
+    std::istringstream lines(head);
+    std::string line;
+
+    std::getline(lines, line);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+
+    std::istringstream first(line);
+    std::string target, version;
+    if (!(first >> req.method >> target >> version))
+    {
+        throw Error(400, "Invalid request line");
+    }
+
+    const std::size_t q(target.find('?'));
+    req.path = decode(target.substr(0, q));
+
+    if (q != std::string::npos)
+    {
+        std::istringstream params(target.substr(q + 1));
+        std::string param;
+
+        while (std::getline(params, param, '&'))
+        {
+            if (param.empty()) continue;
+
+            const std::size_t eq(param.find('='));
+            req.query[decode(param.substr(0, eq))] =
+                eq != std::string::npos ? decode(param.substr(eq + 1)) : "";
+        }
+    }
+
+    while (std::getline(lines, line))
+    {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+
+        const std::size_t colon(line.find(':'));
+        if (colon == std::string::npos) continue;
+
+        std::string value(line.substr(colon + 1));
+        value.erase(0, value.find_first_not_of(" \t"));
+        req.headers[lower(line.substr(0, colon))] = value;
+    }
+
+    const std::string connection(lower(req.header("connection")));
+    req.keepAlive = version == "HTTP/1.1" ?
+        connection != "close" :
+        connection == "keep-alive";
+
+    return req;
+}
+
+// Query parameters are interpreted as by the JS interface: "true" and
+// "false", quoted or not, are booleans, others are JSON, and a value which
+// is not valid JSON is taken as a plain string.
+inline Json::Value toJson(const std::map<std::string, std::string>& query)
+{
+    Json::Value json(Json::objectValue);
+    Json::Reader reader;
+
+    for (const auto& p : query)
+    {
+        Json::Value v;
+        if (p.second == "true" || p.second == "false")
+        {
+            v = p.second == "true";
+        }
+        else if (!reader.parse(p.second, v, false)) v = p.second;
+        else if (v == "true" || v == "false") v = v == "true";
+
+        json[p.first] = v;
+    }
+
+    return json;
+}
+
+inline const char* reason(int code)
+{
+    switch (code)
+    {
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 503: return "Service Unavailable";
+        default: return "Internal Server Error";
+    }
+}
+
+// A blocking connection.  Writes block while the client's receive window is
+// full, which is the backpressure on the query feeding it.
+class Socket
+{
+public:
+    Socket(int fd) : m_fd(fd), m_started(false) { }
+    ~Socket() { ::close(m_fd); }
+
+    // Reads the head of the next request into "head", returning false if the
+    // connection was closed or timed out.
+    bool readHead(std::string& head)
+    {
+        static constexpr std::size_t maxHead = 16384;
+
+        std::size_t end;
+        char data[4096];
+
+        while ((end = m_pending.find("\r\n\r\n")) == std::string::npos)
+        {
+            if (m_pending.size() > maxHead) return false;
+
+            const ssize_t n(::recv(m_fd, data, sizeof(data), 0));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+
+            m_pending.append(data, n);
+        }
+
+        head = m_pending.substr(0, end);
+        m_pending.erase(0, end + 4);
+        m_started = false;
+        return true;
+    }
+
+    // Waits up to "timeout" seconds for the next request to begin, returning
+    // false if it does not, or if "yield" returns true first.  That is
+    // checked every tenth of a second.
+    bool await(std::size_t timeout, const std::function<bool()>& yield)
+    {
+        if (!m_pending.empty()) return true;
+
+        pollfd p;
+        p.fd = m_fd;
+        p.events = POLLIN;
+
+        for (std::size_t i(0); i < timeout * 10; ++i)
+        {
+            p.revents = 0;
+
+            const int n(::poll(&p, 1, 100));
+            if (n > 0) return true;
+            if (n < 0 && errno != EINTR) return false;
+            if (yield()) return false;
+        }
+
+        return false;
+    }
+
+    void head(int code, const Headers& headers)
+    {
+        std::ostringstream ss;
+        ss << "HTTP/1.1 " << code << ' ' << reason(code) << "\r\n";
+        for (const auto& h : headers)
+        {
+            ss << h.first << ": " << h.second << "\r\n";
+        }
+        ss << "\r\n";
+
+        const std::string s(ss.str());
+        write(s.data(), s.size());
+        m_started = true;
+    }
+
+    // Writes "data" as one chunk of a chunked response, or the terminating
+    // chunk if "data" is empty.
+    void chunk(const char* data, std::size_t size)
+    {
+        char prefix[24];
+        const int n(std::snprintf(prefix, sizeof(prefix), "%zx\r\n", size));
+        static const char crlf[] = "\r\n";
+
+        iovec iov[3];
+        iov[0].iov_base = prefix;
+        iov[0].iov_len = n;
+        iov[1].iov_base = const_cast<char*>(data);
+        iov[1].iov_len = size;
+        iov[2].iov_base = const_cast<char*>(crlf);
+        iov[2].iov_len = 2;
+
+        writev(iov, 3);
+    }
+
+    void write(const char* data, std::size_t size)
+    {
+        iovec iov;
+        iov.iov_base = const_cast<char*>(data);
+        iov.iov_len = size;
+        writev(&iov, 1);
+    }
+
+    void sendFile(int in, std::size_t size)
+    {
+        off_t offset(0);
+
+        while (static_cast<std::size_t>(offset) < size)
+        {
+#ifdef __linux__
+            const ssize_t n(::sendfile(m_fd, in, &offset, size - offset));
+#else
+            char data[65536];
+            ssize_t n(::pread(in, data, sizeof(data), offset));
+            if (n > 0)
+            {
+                write(data, n);
+                offset += n;
+            }
+#endif
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("Could not send file");
+        }
+    }
+
+    // True once the head of the current response has been sent, after which
+    // an error can only be reported by dropping the connection.
+    bool started() const { return m_started; }
+
+private:
+    void writev(iovec* iov, int count)
+    {
+        while (count)
+        {
+            const ssize_t n(::writev(m_fd, iov, count));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) throw std::runtime_error("Connection lost");
+
+            std::size_t done(n);
+            while (count && done >= iov->iov_len)
+            {
+                done -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+
+            if (count)
+            {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+                iov->iov_len -= done;
+            }
+        }
+    }
+
+    const int m_fd;
+    std::string m_pending;
+    bool m_started;
+};
+
+} // namespace http
+
+// Serves "/resource/<name>/read" and "/resource/<name>/node/<key>" on its own
+// port, with one thread per open connection, so that the JS server handles
+// only the control plane.  Sessions are shared with the JS interface.
+//
+// Connections beyond the number of threads wait in a bounded queue, and
+// those beyond that are refused with a 503.  While any are queued, a
+// keep-alive connection gives up its thread once its response is sent.
+class HttpServer
+{
+public:
+    // Returns the initialized session of a resource, or null if it does not
+    // exist.
+    using Sessions =
+        std::function<std::shared_ptr<Session>(const std::string&)>;
+
+    HttpServer(
+            const Json::Value& config,
+            Sessions sessions,
+            const TileStore* tiles)
+        : m_sessions(sessions)
+        , m_tiles(tiles)
+        , m_headers(config["headers"])
+        , m_schemas(config["schemas"])
+        , m_nodeMaxAge(option(config, "nodeMaxAge", 86400))
+        , m_timeout(option(config, "timeout", 30))
+        , m_threads(std::max<std::size_t>(option(config, "threads", 16), 1))
+        , m_queue(option(config, "queue", m_threads))
+        , m_notFoundTtl(option(config, "notFoundSeconds", 10))
+        , m_fd(::socket(AF_INET, SOCK_STREAM, 0))
+        , m_stop(false)
+        , m_connections(0)
+        , m_rejected(0)
+        , m_yielded(0)
+        , m_notFoundHits(0)
+        , m_pool(m_threads)
+    {
+        if (m_fd < 0) throw std::runtime_error("Could not create socket");
+
+        const int on(1);
+        ::setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(config["port"].asUInt());
+
+        if (
+                ::bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))
+                    != 0 ||
+                ::listen(m_fd, 128) != 0)
+        {
+            ::close(m_fd);
+            throw std::runtime_error(
+                    "Could not listen on port " + config["port"].asString());
+        }
+
+        m_thread = std::thread([this]() { accept(); });
+    }
+
+    ~HttpServer()
+    {
+        m_stop = true;
+        ::shutdown(m_fd, SHUT_RDWR);
+        m_thread.join();
+        ::close(m_fd);
+    }
+
+    Json::Value stats() const
+    {
+        Json::Value json;
+        json["connections"] = static_cast<Json::UInt64>(m_connections);
+        json["rejected"] = static_cast<Json::UInt64>(m_rejected);
+        json["yielded"] = static_cast<Json::UInt64>(m_yielded);
+        json["notFoundHits"] = static_cast<Json::UInt64>(m_notFoundHits);
+
+        std::lock_guard<std::mutex> lock(m_notFoundMutex);
+        json["notFound"] = static_cast<Json::UInt64>(m_notFound.size());
+        return json;
+    }
+
+private:
+    // Options left unset by the JS config arrive as null.
+    static uint64_t option(
+            const Json::Value& config,
+            const std::string& name,
+            uint64_t fallback)
+    {
+        const Json::Value& v(config[name]);
+        return v.isNull() ? fallback : v.asUInt64();
+    }
+
+    void accept()
+    {
+        while (!m_stop)
+        {
+            const int fd(::accept(m_fd, nullptr, nullptr));
+            if (fd < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return;
+            }
+
+            // Idle and stalled connections are dropped after the timeout, so
+            // they do not hold a thread indefinitely.
+            timeval tv;
+            tv.tv_sec = m_timeout;
+            tv.tv_usec = 0;
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+            const int on(1);
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+            if (m_connections >= m_threads + m_queue)
+            {
+                reject(fd);
+                continue;
+            }
+
+            ++m_connections;
+            m_pool.add([this, fd]()
+            {
+                serve(fd);
+                --m_connections;
+            });
+        }
+    }
+
+    // True if a connection is queued, waiting for a thread.
+    bool waiting() const { return m_connections > m_threads; }
+
+    void serve(int fd)
+    {
+        http::Socket socket(fd);
+        std::string head;
+        bool yielded(false);
+
+        const auto yield([this, &yielded]()
+        {
+            return m_stop || (yielded = waiting());
+        });
+
+        try
+        {
+            while (!m_stop && socket.readHead(head))
+            {
+                const http::Request req(http::parse(head));
+                if (!respond(socket, req) || !req.keepAlive) return;
+
+                if (!socket.await(m_timeout, yield))
+                {
+                    if (yielded) ++m_yielded;
+                    return;
+                }
+            }
+        }
+        catch (...)
+        {
+            // The connection was lost, or could not be parsed.
+        }
+    }
+
+    // Refuses a connection for which there is no room in the queue.  This
+    // runs on the accept thread, whose writes are bounded by the timeout.
+    void reject(int fd)
+    {
+        ++m_rejected;
+
+        http::Socket socket(fd);
+
+        http::Headers headers(common());
+        headers.emplace_back("Content-Length", "0");
+        headers.emplace_back("Retry-After", "1");
+        headers.emplace_back("Connection", "close");
+
+        try { socket.head(503, headers); }
+        catch (...) { }
+    }
+
+    // Returns false if the connection must be closed.
+    bool respond(http::Socket& socket, const http::Request& req)
+    {
+        try
+        {
+            route(socket, req);
+            return true;
+        }
+        catch (http::Error& e)
+        {
+            return fail(socket, e.code, e.what());
+        }
+        catch (std::exception& e)
+        {
+            return fail(socket, 400, e.what());
+        }
+    }
+
+    bool fail(http::Socket& socket, int code, const std::string& message)
+    {
+        if (socket.started()) return false;
+
+        const std::string body(
+                Json::FastWriter().write(Json::Value(message)));
+
+        http::Headers headers(common());
+        headers.emplace_back("Content-Type", "application/json");
+        headers.emplace_back("Content-Length", std::to_string(body.size()));
+        headers.emplace_back("Cache-Control", "public, max-age=10");
+
+        socket.head(code, headers);
+        socket.write(body.data(), body.size());
+        return true;
+    }
+
+    void route(http::Socket& socket, const http::Request& req)
+    {
+        static const std::string prefix("/resource/");
+        static const std::string read("/read");
+        static const std::string node("/node/");
+
+        if (req.method != "GET") throw http::Error(405, "Only GET is served");
+
+        const std::string& path(req.path);
+        if (path.compare(0, prefix.size(), prefix) != 0)
+        {
+            throw http::Error(404, "Not found");
+        }
+
+        const std::string rest(path.substr(prefix.size()));
+        const std::size_t n(rest.rfind(node));
+
+        if (
+                rest.size() > read.size() &&
+                rest.compare(rest.size() - read.size(), read.size(), read)
+                    == 0)
+        {
+            const std::string name(rest.substr(0, rest.size() - read.size()));
+            readQuery(socket, *session(name), http::toJson(req.query));
+        }
+        else if (n != std::string::npos && n)
+        {
+            nodeQuery(
+                    socket,
+                    *session(rest.substr(0, n)),
+                    Key::parse(rest.substr(n + node.size())),
+                    req);
+        }
+        else throw http::Error(404, "Not found");
+    }
+
+    // Names which could not be resolved are remembered for a while, so that
+    // repeated requests for them don't each search every path.
+    std::shared_ptr<Session> session(const std::string& name)
+    {
+        if (notFound(name)) throw http::Error(404, "Not found");
+
+        std::shared_ptr<Session> s(m_sessions(name));
+        if (!s)
+        {
+            rememberNotFound(name);
+            throw http::Error(404, "Not found");
+        }
+
+        return s;
+    }
+
+    bool notFound(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(m_notFoundMutex);
+
+        const auto it(m_notFound.find(name));
+        if (it == m_notFound.end()) return false;
+
+        if (std::chrono::steady_clock::now() < it->second)
+        {
+            ++m_notFoundHits;
+            return true;
+        }
+
+        m_notFound.erase(it);
+        return false;
+    }
+
+    void rememberNotFound(const std::string& name)
+    {
+        static constexpr std::size_t maxNotFound = 4096;
+
+        if (!m_notFoundTtl.count()) return;
+
+        const auto now(std::chrono::steady_clock::now());
+        std::lock_guard<std::mutex> lock(m_notFoundMutex);
+
+        // Names are chosen by clients, so the set is bounded.
+        if (m_notFound.size() >= maxNotFound)
+        {
+            auto it(m_notFound.begin());
+            while (it != m_notFound.end())
+            {
+                if (it->second <= now) it = m_notFound.erase(it);
+                else ++it;
+            }
+
+            if (m_notFound.size() >= maxNotFound) m_notFound.clear();
+        }
+
+        m_notFound[name] = now + m_notFoundTtl;
+    }
+
+    void readQuery(
+            http::Socket& socket,
+            Session& session,
+            const Json::Value& q) const
+    {
+        // Options that need more than a single streamed query are left to
+        // the JS interface.
+        static const std::vector<std::string> supported {
+            "bounds", "depth", "depthBegin", "depthEnd", "scale", "offset",
+            "schema", "filter", "compress", "format"
+        };
+
+        for (const std::string& name : q.getMemberNames())
+        {
+            if (std::find(supported.begin(), supported.end(), name) ==
+                    supported.end())
+            {
+                throw http::Error(400, "Not supported natively: " + name);
+            }
+        }
+
+        if (q.isMember("depth") &&
+                (q.isMember("depthBegin") || q.isMember("depthEnd")))
+        {
+            throw std::runtime_error("Invalid depth specification");
+        }
+
+        const std::size_t depthBegin(
+                q.isMember("depth") ?
+                    q["depth"].asUInt64() : q["depthBegin"].asUInt64());
+        const std::size_t depthEnd(
+                q.isMember("depth") ?
+                    q["depth"].asUInt64() + 1 : q["depthEnd"].asUInt64());
+
+        const ReadFormat format(parseReadFormat(q["format"]));
+        if (format == ReadFormat::Las)
+        {
+            throw http::Error(400, "Not supported natively: las");
+        }
+
+        std::unique_ptr<entwine::Bounds> bounds(boxes::create(q["bounds"]));
+        std::unique_ptr<entwine::Scale> scale(
+                entwine::maybeCreate<entwine::Scale>(q["scale"]));
+        std::unique_ptr<entwine::Offset> offset(
+                entwine::maybeCreate<entwine::Offset>(q["offset"]));
+        std::unique_ptr<entwine::Schema> schema(
+                entwine::maybeCreate<entwine::Schema>(q["schema"]));
+
+        std::unique_ptr<ReadQuery> query(
+                session.getQuery(
+                    bounds.get(),
+                    depthBegin,
+                    depthEnd,
+                    scale.get(),
+                    offset.get(),
+                    schema.get(),
+                    boxes::combine(q["bounds"], q["filter"]),
+                    q["compress"].asBool()));
+
+        query->setFormat(format);
+
+        http::Headers headers(common());
+        headers.emplace_back("Content-Type", contentType(format));
+        stream(socket, *query, headers);
+    }
+
+    // Answers a node read as the JS interface does, with the same ETag, from
+    // its static tile if one has been rendered.
+    void nodeQuery(
+            http::Socket& socket,
+            Session& session,
+            const Key& key,
+            const http::Request& req) const
+    {
+        Json::Value q;
+        q["node"] = key.toString();
+
+        const auto preset(req.query.find("schema"));
+        if (preset != req.query.end() && preset->second != "native")
+        {
+            if (!m_schemas.isMember(preset->second))
+            {
+                throw http::Error(
+                        400, "Unknown schema preset: " + preset->second);
+            }
+
+            q["schema"] = m_schemas[preset->second];
+        }
+
+        const auto compress(req.query.find("compress"));
+        if (compress != req.query.end())
+        {
+            q["compress"] = compress->second == "true";
+        }
+
+        const auto format(req.query.find("format"));
+        if (format != req.query.end()) q["format"] = format->second;
+
+        const std::string version(session.version());
+        const std::string etag(nodeEtag(version, q));
+
+        http::Headers headers(common());
+        headers.emplace_back("ETag", '"' + etag + '"');
+        headers.emplace_back(
+                "Cache-Control",
+                "public, max-age=" + std::to_string(m_nodeMaxAge));
+
+        std::string held(req.header("if-none-match"));
+        held = held.substr(0, held.find(','));
+        held.erase(0, held.find_first_not_of(" \t"));
+        if (held.compare(0, 2, "W/") == 0) held.erase(0, 2);
+        held.erase(std::remove(held.begin(), held.end(), '"'), held.end());
+
+        if (held == etag)
+        {
+            headers.emplace_back("Content-Length", "0");
+            socket.head(304, headers);
+            return;
+        }
+
+        const ReadFormat readFormat(parseReadFormat(q["format"]));
+        headers.emplace_back("Content-Type", contentType(readFormat));
+
+        if (m_tiles)
+        {
+            const std::string path(
+                    m_tiles->find(session.name(), version, key, q));
+
+            if (!path.empty() && sendFile(socket, path, headers)) return;
+        }
+
+        if (readFormat == ReadFormat::Las)
+        {
+            throw http::Error(400, "Not supported natively: las");
+        }
+
+        const Json::Value info(session.info());
+        const std::size_t baseDepth(info["baseDepth"].asUInt64());
+        const bool is3d(info["type"].asString() == "octree");
+        key.validate(baseDepth, is3d);
+
+        const entwine::Bounds bounds(
+                key.bounds(session.bounds(nullptr, nullptr), baseDepth, is3d));
+
+        std::unique_ptr<entwine::Schema> schema(
+                entwine::maybeCreate<entwine::Schema>(q["schema"]));
+
+        std::unique_ptr<ReadQuery> query(
+                session.getQuery(
+                    &bounds,
+                    key.depth,
+                    key.depth + 1,
+                    nullptr,
+                    nullptr,
+                    schema.get(),
+                    Json::nullValue,
+                    q["compress"].asBool()));
+
+        query->setFormat(readFormat);
+        stream(socket, *query, headers);
+    }
+
+    // Returns false if the file could not be opened, for example if it was
+    // replaced by a new render.
+    bool sendFile(
+            http::Socket& socket,
+            const std::string& path,
+            http::Headers headers) const
+    {
+        const int fd(::open(path.c_str(), O_RDONLY));
+        if (fd < 0) return false;
+
+        struct stat s;
+        if (::fstat(fd, &s) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        try
+        {
+            headers.emplace_back("Content-Length", std::to_string(s.st_size));
+            socket.head(200, headers);
+            socket.sendFile(fd, s.st_size);
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+
+        ::close(fd);
+        return true;
+    }
+
+    void stream(
+            http::Socket& socket,
+            ReadQuery& query,
+            http::Headers headers) const
+    {
+        headers.emplace_back("Transfer-Encoding", "chunked");
+
+        BufferPool& pool(ReadPool::get());
+        std::vector<char>& buffer(pool.acquire());
+
+        try
+        {
+            // Read the first chunk before committing to a response, so that
+            // an invalid query is still reported with its status.
+            query.read(buffer);
+            socket.head(200, headers);
+
+            while (true)
+            {
+                if (!buffer.empty()) socket.chunk(buffer.data(), buffer.size());
+                if (query.done()) break;
+
+                buffer.clear();
+                query.read(buffer);
+            }
+
+            socket.chunk(nullptr, 0);
+        }
+        catch (...)
+        {
+            pool.release(buffer);
+            throw;
+        }
+
+        pool.release(buffer);
+    }
+
+    // The configured headers for all responses, as for the JS interface.
+    http::Headers common() const
+    {
+        http::Headers headers;
+        for (const std::string& name : m_headers.getMemberNames())
+        {
+            headers.emplace_back(name, m_headers[name].asString());
+        }
+        headers.emplace_back("X-powered-by", "Hobu, Inc.");
+        return headers;
+    }
+
+    static std::string contentType(ReadFormat format)
+    {
+        switch (format)
+        {
+            case ReadFormat::Framed:
+                return "application/vnd.greyhound.framed";
+            case ReadFormat::Arrow:
+                return "application/vnd.apache.arrow.stream";
+            case ReadFormat::Las:
+                return "application/vnd.las";
+            default:
+                return "application/octet-stream";
+        }
+    }
+
+    const Sessions m_sessions;
+    const TileStore* const m_tiles;
+    const Json::Value m_headers;
+    const Json::Value m_schemas;
+    const std::size_t m_nodeMaxAge;
+    const std::size_t m_timeout;
+    const std::size_t m_threads;
+    const std::size_t m_queue;
+    const std::chrono::seconds m_notFoundTtl;
+
+    const int m_fd;
+    std::atomic<bool> m_stop;
+
+    // Connections which are being served, or are queued for a thread.
+    std::atomic<std::size_t> m_connections;
+    std::atomic<uint64_t> m_rejected;
+    std::atomic<uint64_t> m_yielded;
+    std::atomic<uint64_t> m_notFoundHits;
+
+    mutable std::mutex m_notFoundMutex;
+    std::map<std::string, std::chrono::steady_clock::time_point> m_notFound;
+
+    ThreadPool m_pool;
+    std::thread m_thread;
+};
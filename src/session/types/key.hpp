@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <entwine/types/bounds.hpp>
+#include <entwine/util/unique.hpp>
+
+// Addresses a node of a resource's hierarchy, formatted as "D-X-Y-Z".  This
+// is the set of points at tree depth D within the cell (X, Y, Z) of the cubic
+// bounds bisected (D - baseDepth) times - the same relation between depth and
+// bisection that a full-bounds hierarchy query starting at the base depth
+// returns.  For quadtrees, Z is always zero and cells span the full Z range.
+class Key
+{
+public:
+    Key(std::size_t depth, uint64_t x, uint64_t y, uint64_t z)
+        : depth(depth)
+        , x(x)
+        , y(y)
+        , z(z)
+    { }
+
+    static Key parse(const std::string& s)
+    {
+        std::istringstream ss(s);
+        uint64_t v[4];
+        char sep;
+
+        for (std::size_t i(0); i < 4; ++i)
+        {
+            if (i && (!(ss >> sep) || sep != '-'))
+            {
+                throw std::runtime_error("Invalid node key: " + s);
+            }
+
+            if (!(ss >> v[i]))
+            {
+                throw std::runtime_error("Invalid node key: " + s);
+            }
+        }
+
+        if (ss.peek() != std::char_traits<char>::eof())
+        {
+            throw std::runtime_error("Invalid node key: " + s);
+        }
+
+        return Key(v[0], v[1], v[2], v[3]);
+    }
+
+    std::string toString() const
+    {
+        std::ostringstream ss;
+        ss << depth << '-' << x << '-' << y << '-' << z;
+        return ss.str();
+    }
+
+    // Number of bisections of the cubic bounds for this key.
+    std::size_t level(std::size_t baseDepth) const
+    {
+        if (depth < baseDepth)
+        {
+            throw std::runtime_error("Node key is above the base depth");
+        }
+
+        return depth - baseDepth;
+    }
+
+    // Child index as used by HierarchyIndex: X in the low bit, then Y, then Z.
+    Key child(unsigned int c) const
+    {
+        return Key(
+                depth + 1,
+                x * 2 + (c & 1),
+                y * 2 + ((c >> 1) & 1),
+                z * 2 + ((c >> 2) & 1));
+    }
+
+    // Throws unless this key addresses a cell of a tree with the given base
+    // depth.
+    void validate(std::size_t baseDepth, bool is3d) const
+    {
+        const uint64_t cells(
+                uint64_t(1) << std::min<std::size_t>(level(baseDepth), 63));
+
+        if (x >= cells || y >= cells || z >= (is3d ? cells : 1))
+        {
+            throw std::runtime_error("Invalid node key: " + toString());
+        }
+    }
+
+    entwine::Bounds bounds(
+            const entwine::Bounds& cubic,
+            std::size_t baseDepth,
+            bool is3d) const
+    {
+        const double cells(std::ldexp(1.0, level(baseDepth)));
+        const entwine::Point& min(cubic.min());
+        const entwine::Point& max(cubic.max());
+
+        const double w((max.x - min.x) / cells);
+        const double h((max.y - min.y) / cells);
+        const double d((max.z - min.z) / cells);
+
+        if (!is3d && z) throw std::runtime_error("Invalid quadtree key");
+
+        return entwine::Bounds(
+                entwine::Point(
+                    min.x + w * x,
+                    min.y + h * y,
+                    is3d ? min.z + d * z : min.z),
+                entwine::Point(
+                    min.x + w * (x + 1),
+                    min.y + h * (y + 1),
+                    is3d ? min.z + d * (z + 1) : max.z));
+    }
+
+    // Returns the key whose bounds at "depth" match "bounds", or null if
+    // "bounds" is not exactly a cell of the tree.
+    static std::unique_ptr<Key> fromBounds(
+            const entwine::Bounds& cubic,
+            const entwine::Bounds& bounds,
+            std::size_t depth,
+            std::size_t baseDepth,
+            bool is3d)
+    {
+        const double epsilon(1e-6);
+
+        std::unique_ptr<Key> key;
+        if (depth < baseDepth || depth - baseDepth > 62) return key;
+
+        const double cells(std::ldexp(1.0, depth - baseDepth));
+        uint64_t v[3];
+
+        for (std::size_t i(0); i < (is3d ? 3u : 2u); ++i)
+        {
+            const double min(get(cubic.min(), i));
+            const double max(get(cubic.max(), i));
+            const double size((max - min) / cells);
+
+            const double pos((get(bounds.min(), i) - min) / size);
+            const double end((get(bounds.max(), i) - min) / size);
+            const double cell(std::round(pos));
+
+            if (
+                    cell < 0 || cell >= cells ||
+                    std::abs(pos - cell) > epsilon ||
+                    std::abs(end - cell - 1) > epsilon)
+            {
+                return key;
+            }
+
+            v[i] = static_cast<uint64_t>(cell);
+        }
+
+        key = entwine::makeUnique<Key>(depth, v[0], v[1], is3d ? v[2] : 0);
+
+        if (!is3d)
+        {
+            // A quadtree cell spans the full Z range.
+            const auto full(key->bounds(cubic, baseDepth, false));
+            const double height(cubic.max().z - cubic.min().z);
+
+            if (
+                    std::abs(bounds.min().z - full.min().z) >
+                        height * epsilon ||
+                    std::abs(bounds.max().z - full.max().z) >
+                        height * epsilon)
+            {
+                key.reset();
+            }
+        }
+
+        return key;
+    }
+
+    std::size_t depth;
+    uint64_t x;
+    uint64_t y;
+    uint64_t z;
+
+private:
+    static double get(const entwine::Point& p, std::size_t i)
+    {
+        return i == 0 ? p.x : i == 1 ? p.y : p.z;
+    }
+};
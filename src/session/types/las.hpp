@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/types/bounds.hpp>
+#include <entwine/types/delta.hpp>
+#include <entwine/types/dim-info.hpp>
+#include <entwine/types/schema.hpp>
+#include <entwine/util/unique.hpp>
+
+#include "types/boxes.hpp"
+
+// Writes reads as a LAS 1.4 file, with point data record format 6, or 7 if
+// the resource has color.  Points are queried with a fixed schema matching
+// the fields of those records, with X, Y, and Z as integers already scaled
+// and offset by the query, and then packed into records.
+namespace las
+{
+
+struct Header
+{
+    Header()
+        : scale{ 0.01, 0.01, 0.01 }
+        , offset{ 0, 0, 0 }
+        , min{ 0, 0, 0 }
+        , max{ 0, 0, 0 }
+        , numPoints(0)
+        , rgb(false)
+    { }
+
+    double scale[3];
+    double offset[3];
+    double min[3];
+    double max[3];
+    uint64_t numPoints;
+    bool rgb;
+    std::string wkt;
+};
+
+const std::size_t headerSize(375);
+const std::size_t vlrHeaderSize(54);
+
+inline std::size_t recordSize(bool rgb) { return rgb ? 36 : 30; }
+
+// The schema with which points are queried.
+inline entwine::Schema schema(bool rgb)
+{
+    entwine::DimList dims {
+        entwine::DimInfo("X", "signed", 4),
+        entwine::DimInfo("Y", "signed", 4),
+        entwine::DimInfo("Z", "signed", 4),
+        entwine::DimInfo("Intensity", "unsigned", 2),
+        entwine::DimInfo("ReturnNumber", "unsigned", 1),
+        entwine::DimInfo("NumberOfReturns", "unsigned", 1),
+        entwine::DimInfo("ScanDirectionFlag", "unsigned", 1),
+        entwine::DimInfo("EdgeOfFlightLine", "unsigned", 1),
+        entwine::DimInfo("Classification", "unsigned", 1),
+        entwine::DimInfo("UserData", "unsigned", 1),
+        entwine::DimInfo("ScanAngleRank", "floating", 4),
+        entwine::DimInfo("PointSourceId", "unsigned", 2),
+        entwine::DimInfo("GpsTime", "floating", 8)
+    };
+
+    if (rgb)
+    {
+        dims.emplace_back("Red", "unsigned", 2);
+        dims.emplace_back("Green", "unsigned", 2);
+        dims.emplace_back("Blue", "unsigned", 2);
+    }
+
+    return entwine::Schema(dims);
+}
+
+// A minimal schema with which to count the points of a read.
+inline entwine::Schema countSchema()
+{
+    return entwine::Schema(
+            entwine::DimList { entwine::DimInfo("X", "signed", 4) });
+}
+
+namespace detail
+{
+
+template<typename T>
+void put(std::vector<char>& out, T v)
+{
+    const char* pos(reinterpret_cast<const char*>(&v));
+    out.insert(out.end(), pos, pos + sizeof(T));
+}
+
+// Writes "s" as a field of "n" bytes, truncated or null padded.
+inline void putString(
+        std::vector<char>& out,
+        const std::string& s,
+        std::size_t n)
+{
+    const std::size_t size(std::min(s.size(), n));
+    out.insert(out.end(), s.begin(), s.begin() + size);
+    out.insert(out.end(), n - size, 0);
+}
+
+template<typename T>
+T get(const char*& pos)
+{
+    T v;
+    std::memcpy(&v, pos, sizeof(T));
+    pos += sizeof(T);
+    return v;
+}
+
+} // namespace detail
+
+inline void writeHeader(std::vector<char>& out, const Header& h)
+{
+    using namespace detail;
+
+    const bool hasWkt(!h.wkt.empty());
+    const std::size_t wktSize(hasWkt ? h.wkt.size() + 1 : 0);
+    const std::size_t vlrSize(hasWkt ? vlrHeaderSize + wktSize : 0);
+
+    out.reserve(out.size() + headerSize + vlrSize);
+
+    putString(out, "LASF", 4);
+    put<uint16_t>(out, 0);              // File source ID.
+    put<uint16_t>(out, hasWkt ? 16 : 0);// Global encoding: WKT.
+    out.insert(out.end(), 16, 0);       // Project ID.
+    put<uint8_t>(out, 1);
+    put<uint8_t>(out, 4);
+    putString(out, "Greyhound", 32);    // System identifier.
+    putString(out, "Greyhound", 32);    // Generating software.
+    put<uint16_t>(out, 0);              // Creation day of year.
+    put<uint16_t>(out, 0);              // Creation year.
+    put<uint16_t>(out, headerSize);
+    put<uint32_t>(out, headerSize + vlrSize);
+    put<uint32_t>(out, hasWkt ? 1 : 0);
+    put<uint8_t>(out, h.rgb ? 7 : 6);
+    put<uint16_t>(out, recordSize(h.rgb));
+
+    // Legacy point counts, which must be zero for these formats.
+    out.insert(out.end(), 4 + 5 * 4, 0);
+
+    for (std::size_t i(0); i < 3; ++i) put<double>(out, h.scale[i]);
+    for (std::size_t i(0); i < 3; ++i) put<double>(out, h.offset[i]);
+
+    for (std::size_t i(0); i < 3; ++i)
+    {
+        put<double>(out, h.max[i]);
+        put<double>(out, h.min[i]);
+    }
+
+    put<uint64_t>(out, 0);              // Start of waveform data.
+    put<uint64_t>(out, 0);              // Start of first EVLR.
+    put<uint32_t>(out, 0);              // Number of EVLRs.
+    put<uint64_t>(out, h.numPoints);
+
+    // Counts by return are unknown.
+    out.insert(out.end(), 15 * 8, 0);
+
+    if (hasWkt)
+    {
+        put<uint16_t>(out, 0);
+        putString(out, "LASF_Projection", 16);
+        put<uint16_t>(out, 2112);
+        put<uint16_t>(out, wktSize);
+        putString(out, "OGC WKT", 32);
+        putString(out, h.wkt, wktSize);
+    }
+}
+
+// Packs points of the query "schema" into records.
+inline void pack(
+        const std::vector<char>& points,
+        bool rgb,
+        std::vector<char>& out)
+{
+    using namespace detail;
+
+    const std::size_t pointSize(schema(rgb).pointSize());
+    const std::size_t n(points.size() / pointSize);
+
+    out.reserve(out.size() + n * recordSize(rgb));
+
+    for (std::size_t i(0); i < n; ++i)
+    {
+        const char* pos(points.data() + i * pointSize);
+
+        const int32_t x(get<int32_t>(pos));
+        const int32_t y(get<int32_t>(pos));
+        const int32_t z(get<int32_t>(pos));
+        const uint16_t intensity(get<uint16_t>(pos));
+        const uint8_t returnNumber(get<uint8_t>(pos));
+        const uint8_t numberOfReturns(get<uint8_t>(pos));
+        const uint8_t scanDirection(get<uint8_t>(pos));
+        const uint8_t edge(get<uint8_t>(pos));
+        const uint8_t classification(get<uint8_t>(pos));
+        const uint8_t userData(get<uint8_t>(pos));
+        const float scanAngle(get<float>(pos));
+        const uint16_t pointSourceId(get<uint16_t>(pos));
+        const double gpsTime(get<double>(pos));
+
+        put<int32_t>(out, x);
+        put<int32_t>(out, y);
+        put<int32_t>(out, z);
+        put<uint16_t>(out, intensity);
+        put<uint8_t>(out, (returnNumber & 0x0F) | (numberOfReturns << 4));
+        put<uint8_t>(out, ((scanDirection & 1) << 6) | ((edge & 1) << 7));
+        put<uint8_t>(out, classification);
+        put<uint8_t>(out, userData);
+        put<int16_t>(out, std::lround(scanAngle / 0.006));
+        put<uint16_t>(out, pointSourceId);
+        put<double>(out, gpsTime);
+
+        if (rgb)
+        {
+            put<uint16_t>(out, get<uint16_t>(pos));
+            put<uint16_t>(out, get<uint16_t>(pos));
+            put<uint16_t>(out, get<uint16_t>(pos));
+        }
+    }
+}
+
+// Returns the header, less its point count, of a read of "bounds" from a
+// resource with the given "info".  Points are written as scaled integers, so
+// without a scale or offset in the query, those of the index are used if it
+// has them, and "bounds" are transformed from native coordinates to match.
+// The bounds of the header are those of the read, limited to the conforming
+// bounds of the resource.
+inline Header prepare(
+        const Json::Value& info,
+        std::unique_ptr<entwine::Scale>& scale,
+        std::unique_ptr<entwine::Offset>& offset,
+        std::unique_ptr<entwine::Bounds>& bounds)
+{
+    Header header;
+
+    std::size_t colors(0);
+    for (const Json::Value& dim : info["schema"])
+    {
+        const std::string name(dim["name"].asString());
+        if (name == "Red" || name == "Green" || name == "Blue") ++colors;
+    }
+
+    header.rgb = colors == 3;
+    header.wkt = info["srs"].asString();
+
+    const entwine::Bounds conforming(info["boundsConforming"]);
+
+    if (!scale && !offset)
+    {
+        const entwine::Point mid(conforming.mid());
+
+        scale = info.isMember("scale") ?
+            entwine::makeUnique<entwine::Scale>(info["scale"]) :
+            entwine::makeUnique<entwine::Scale>(0.01);
+
+        offset = info.isMember("offset") ?
+            entwine::makeUnique<entwine::Offset>(info["offset"]) :
+            entwine::makeUnique<entwine::Offset>(
+                    std::round(mid.x),
+                    std::round(mid.y),
+                    std::round(mid.z));
+
+        if (bounds)
+        {
+            bounds = entwine::makeUnique<entwine::Bounds>(
+                    bounds->deltify(
+                        entwine::Delta(scale.get(), offset.get())));
+        }
+    }
+
+    const entwine::Delta delta(scale.get(), offset.get());
+    const entwine::Bounds native(
+            bounds ? bounds->undeltify(delta) : conforming);
+    const entwine::Bounds extents(
+            native.overlaps(conforming) ?
+                boxes::intersect(native, conforming) : native);
+
+    const entwine::Point* points[] = {
+        &delta.scale(), &delta.offset(), &extents.min(), &extents.max()
+    };
+    double* fields[] = {
+        header.scale, header.offset, header.min, header.max
+    };
+
+    for (std::size_t i(0); i < 4; ++i)
+    {
+        fields[i][0] = points[i]->x;
+        fields[i][1] = points[i]->y;
+        fields[i][2] = points[i]->z;
+    }
+
+    return header;
+}
+
+} // namespace las
+
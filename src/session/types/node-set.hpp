@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/util/unique.hpp>
+
+#include "types/hash.hpp"
+#include "types/key.hpp"
+
+// A set of node keys held by a client, which a read may skip.  This is given
+// either as an array of "D-X-Y-Z" keys, or for large sets, as a Bloom filter:
+//
+//      { "bits": <base64>, "size": <number of bits>, "hashes": <count> }
+//
+// where bit i is (byte[i / 8] >> (i % 8)) & 1, and a key is a member if the
+// bits (h1 + j * h2) % size are set for each j in [0, hashes), with h1 and h2
+// the low and high 32 bits of the FNV-1a hash of the key string.  False
+// positives from a Bloom filter skip nodes the client does not hold, so its
+// size should be chosen accordingly.
+class NodeSet
+{
+public:
+    virtual ~NodeSet() { }
+
+    virtual bool contains(const Key& key) const = 0;
+
+    // Returns null if "json" is null.
+    static std::unique_ptr<NodeSet> create(const Json::Value& json);
+};
+
+class KeySet : public NodeSet
+{
+public:
+    KeySet(const Json::Value& json)
+    {
+        for (const Json::Value& v : json)
+        {
+            // Normalize the formatting of the key.
+            m_keys.insert(Key::parse(v.asString()).toString());
+        }
+    }
+
+    virtual bool contains(const Key& key) const override
+    {
+        return m_keys.count(key.toString());
+    }
+
+private:
+    std::unordered_set<std::string> m_keys;
+};
+
+class BloomFilter : public NodeSet
+{
+public:
+    BloomFilter(const Json::Value& json)
+        : m_bits(decode(json["bits"].asString()))
+        , m_size(json["size"].asUInt64())
+        , m_hashes(json["hashes"].asUInt64())
+    {
+        if (!m_size || m_size > m_bits.size() * 8 || !m_hashes)
+        {
+            throw std::runtime_error("Invalid Bloom filter");
+        }
+    }
+
+    virtual bool contains(const Key& key) const override
+    {
+        const uint64_t hash(fnv1a(key.toString()));
+        const uint64_t h1(hash & 0xFFFFFFFF);
+        const uint64_t h2(hash >> 32);
+
+        for (uint64_t j(0); j < m_hashes; ++j)
+        {
+            const uint64_t bit((h1 + j * h2) % m_size);
+            if (!((m_bits[bit / 8] >> (bit % 8)) & 1)) return false;
+        }
+
+        return true;
+    }
+
+private:
+    static std::vector<unsigned char> decode(const std::string& s)
+    {
+        std::vector<unsigned char> out;
+        out.reserve(s.size() * 3 / 4);
+
+        uint32_t acc(0);
+        int bits(0);
+
+        for (const char c : s)
+        {
+            int v(-1);
+            if (c >= 'A' && c <= 'Z') v = c - 'A';
+            else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+            else if (c >= '0' && c <= '9') v = c - '0' + 52;
+            else if (c == '+' || c == '-') v = 62;
+            else if (c == '/' || c == '_') v = 63;
+            else if (c == '=') break;
+            else throw std::runtime_error("Invalid base64 in Bloom filter");
+
+            acc = (acc << 6) | v;
+            bits += 6;
+
+            if (bits >= 8)
+            {
+                bits -= 8;
+                out.push_back(static_cast<unsigned char>((acc >> bits) & 0xFF));
+            }
+        }
+
+        return out;
+    }
+
+    const std::vector<unsigned char> m_bits;
+    const uint64_t m_size;
+    const uint64_t m_hashes;
+};
+
+inline std::unique_ptr<NodeSet> NodeSet::create(const Json::Value& json)
+{
+    std::unique_ptr<NodeSet> set;
+
+    if (json.isArray()) set = entwine::makeUnique<KeySet>(json);
+    else if (json.isObject()) set = entwine::makeUnique<BloomFilter>(json);
+    else if (!json.isNull()) throw std::runtime_error("Invalid exclude set");
+
+    return set;
+}
+
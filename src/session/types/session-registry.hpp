@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+
+#include <json/json.h>
+
+#include "session.hpp"
+
+// Tracks recently used sessions, and once the estimated memory held by their
+// open indexes exceeds a budget, releases the least recently used idle ones.
+// A released session stays usable and reopens its index on demand, so this
+// bounds memory deterministically rather than waiting on the garbage
+// collection of session wrappers.
+class SessionRegistry
+{
+public:
+    // A budget of zero disables eviction.
+    SessionRegistry(std::size_t maxBytes) : m_maxBytes(maxBytes) { }
+
+    void touch(const std::shared_ptr<Session>& session)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        remove(session.get());
+        m_list.push_front(session);
+
+        if (m_maxBytes) evict();
+    }
+
+    void release(Session& session)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        remove(&session);
+        session.release();
+    }
+
+    // The sessions holding open indexes, with their estimated sizes.
+    Json::Value stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Json::Value json;
+        json["maxBytes"] = static_cast<Json::UInt64>(m_maxBytes);
+        json["evictions"] = static_cast<Json::UInt64>(m_evictions);
+
+        Json::Value& resident(json["resident"] = Json::objectValue);
+
+        for (const auto& entry : m_list)
+        {
+            const std::shared_ptr<Session> s(entry.lock());
+            const std::size_t bytes(s ? s->residentBytes() : 0);
+            if (bytes) resident[s->name()] = static_cast<Json::UInt64>(bytes);
+        }
+
+        return json;
+    }
+
+private:
+    void remove(const Session* session)
+    {
+        m_list.remove_if([session](const std::weak_ptr<Session>& entry)
+        {
+            const std::shared_ptr<Session> s(entry.lock());
+            return !s || s.get() == session;
+        });
+    }
+
+    // The most recently used session is never evicted, even if it alone
+    // exceeds the budget.
+    void evict()
+    {
+        std::size_t bytes(0);
+        for (const auto& entry : m_list)
+        {
+            if (const auto s = entry.lock()) bytes += s->residentBytes();
+        }
+
+        if (bytes <= m_maxBytes) return;
+
+        auto it(m_list.end());
+        while (bytes > m_maxBytes && --it != m_list.begin())
+        {
+            const std::shared_ptr<Session> s(it->lock());
+            if (!s || !s->idle()) continue;
+
+            const std::size_t resident(s->residentBytes());
+            if (!resident) continue;
+
+            std::cout << "Evicting " << s->name() << " (" << resident <<
+                " bytes)" << std::endl;
+
+            s->release();
+            bytes -= std::min(bytes, resident);
+            it = m_list.erase(it);
+            ++m_evictions;
+        }
+    }
+
+    const std::size_t m_maxBytes;
+    std::size_t m_evictions = 0;
+
+    std::list<std::weak_ptr<Session>> m_list;
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <sys/stat.h>
+
+#include <json/json.h>
+
+#include <entwine/util/unique.hpp>
+
+#include "types/hash.hpp"
+
+// Persists the computed metadata of a session to local disk, so that a
+// restarted server can bring up a resource without opening its remote index.
+// A snapshot is only valid for the version of the remote metadata from which
+// it was computed - see Session::initialize.
+class SnapshotStore
+{
+public:
+    SnapshotStore(const Json::Value& config)
+        : m_path(config["path"].asString())
+        , m_hierarchyDepth(
+                config.isMember("hierarchyDepth") ?
+                    config["hierarchyDepth"].asUInt64() : 4)
+    {
+        if (m_path.empty())
+        {
+            throw std::runtime_error("Snapshot path must be specified");
+        }
+
+        if (m_path.back() != '/') m_path.push_back('/');
+
+        struct stat s;
+        if (::stat(m_path.c_str(), &s) != 0 && ::mkdir(m_path.c_str(), 0755))
+        {
+            throw std::runtime_error("Could not create " + m_path);
+        }
+    }
+
+    // Number of hierarchy depths, starting at the base depth of a resource,
+    // to store for its full bounds.
+    std::size_t hierarchyDepth() const { return m_hierarchyDepth; }
+
+    // Location of the memory-mapped hierarchy index for a resource.
+    std::string indexPath(const std::string& name) const
+    {
+        return filename(name) + ".hierarchy";
+    }
+
+    std::unique_ptr<Json::Value> load(const std::string& name) const
+    {
+        std::unique_ptr<Json::Value> snapshot;
+
+        std::ifstream stream(
+                filename(name) + ".json",
+                std::ios::in | std::ios::binary);
+        if (!stream.good()) return snapshot;
+
+        Json::Reader reader;
+        Json::Value json;
+
+        // A truncated or hand-edited snapshot is treated as missing.
+        if (
+                reader.parse(stream, json, false) &&
+                json.isObject() &&
+                json["name"] == name &&
+                json["info"].isObject() &&
+                json["hierarchy"].isObject())
+        {
+            snapshot = entwine::makeUnique<Json::Value>(json);
+        }
+
+        return snapshot;
+    }
+
+    void save(const std::string& name, const Json::Value& snapshot) const
+    {
+        const std::string path(filename(name) + ".json");
+
+        // Write to a temporary and rename, so a concurrent load never sees a
+        // partially written snapshot.
+        const std::string temp(tempName(path));
+
+        {
+            std::ofstream stream(
+                    temp,
+                    std::ios::out | std::ios::binary | std::ios::trunc);
+
+            Json::FastWriter writer;
+            stream << writer.write(snapshot);
+
+            if (!stream.good())
+            {
+                throw std::runtime_error("Could not write " + temp);
+            }
+        }
+
+        if (std::rename(temp.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temp.c_str());
+            throw std::runtime_error("Could not write " + path);
+        }
+    }
+
+private:
+    // This is the extensionless base path for all files of a resource.
+    std::string filename(const std::string& name) const
+    {
+        return m_path + safeName(name);
+    }
+
+    std::string m_path;
+    const std::size_t m_hierarchyDepth;
+};
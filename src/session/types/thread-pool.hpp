@@ -0,0 +1,140 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for splitting a single command's work.  The
+// libuv pool can only be fed from the main loop, so work that fans out from
+// within a running command is queued here instead.  Tasks run here must not
+// themselves wait on this pool.
+class ThreadPool
+{
+public:
+    ThreadPool(std::size_t threads)
+    {
+        if (!threads) threads = 1;
+
+        for (std::size_t i(0); i < threads; ++i)
+        {
+            m_threads.emplace_back([this]() { work(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_cv.notify_all();
+        for (auto& t : m_threads) t.join();
+    }
+
+    std::size_t size() const { return m_threads.size(); }
+
+    void add(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push(std::move(task));
+        }
+
+        m_cv.notify_one();
+    }
+
+private:
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [this]()
+                {
+                    return m_stop || !m_tasks.empty();
+                });
+
+                if (m_tasks.empty()) return;
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop();
+            }
+
+            task();
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::queue<std::function<void()>> m_tasks;
+    bool m_stop = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+};
+
+// A set of tasks run on a ThreadPool which may be waited upon together.  The
+// first error thrown by any task is rethrown from wait().
+class TaskGroup
+{
+public:
+    TaskGroup(ThreadPool& pool) : m_pool(pool) { }
+
+    ~TaskGroup()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return !m_outstanding; });
+    }
+
+    void add(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_outstanding;
+        }
+
+        m_pool.add([this, task]()
+        {
+            std::exception_ptr error;
+
+            try { task(); }
+            catch (...) { error = std::current_exception(); }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (error && !m_error) m_error = error;
+            --m_outstanding;
+            m_cv.notify_all();
+        });
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return !m_outstanding; });
+
+        if (m_error) std::rethrow_exception(m_error);
+    }
+
+private:
+    ThreadPool& m_pool;
+
+    std::size_t m_outstanding = 0;
+    std::exception_ptr m_error;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+};
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <json/json.h>
+
+#include <entwine/types/bounds.hpp>
+#include <entwine/types/schema.hpp>
+#include <entwine/util/unique.hpp>
+
+#include "session.hpp"
+#include "types/exports.hpp"
+#include "types/hash.hpp"
+#include "types/hierarchy.hpp"
+#include "types/key.hpp"
+
+// The ETag of the response to the node read "query", which is identified by
+// the index version and the options of the read.  Static tiles carry the
+// ETag of the live read that they replace.
+inline std::string nodeEtag(const std::string& version, Json::Value query)
+{
+    query.removeMember("ifNoneMatch");
+    return toHex(fnv1a(version + '\0' + Json::FastWriter().write(query)));
+}
+
+// Static node responses, pre-rendered for the shallowest depths of a resource
+// in each of a fixed set of presets, so that the hottest nodes are served
+// from local files without any point work.  Files are laid out as
+// "<path>/<resource>/<version>/<preset>/<key>", so a new version of an index
+// never sees the tiles of an older one.
+class TileStore
+{
+public:
+    TileStore(const Json::Value& config)
+        : m_path(config["path"].asString())
+        , m_depths(
+                config.isMember("depths") ? config["depths"].asUInt64() : 4)
+        , m_presets(config["presets"])
+    {
+        if (m_path.empty())
+        {
+            throw std::runtime_error("Tile path must be specified");
+        }
+
+        if (m_path.back() != '/') m_path.push_back('/');
+
+        if (!m_presets.isArray() || m_presets.empty())
+        {
+            throw std::runtime_error("Tile presets must be specified");
+        }
+
+        for (const Json::Value& preset : m_presets)
+        {
+            if (preset["name"].asString().empty())
+            {
+                throw std::runtime_error("Tile presets must be named");
+            }
+        }
+
+        makeDir(m_path);
+    }
+
+    // The number of depths, beginning at the base depth, that are rendered.
+    std::size_t depths() const { return m_depths; }
+
+    // Each preset has a "name", and the "schema" and "compress" options of
+    // the node reads that it answers.
+    const Json::Value& presets() const { return m_presets; }
+
+    std::string resourceDir(const std::string& resource) const
+    {
+        return m_path + safeName(resource) + '/';
+    }
+
+    // The directory of the tiles of a version of a resource.  Versions are
+    // opaque strings, so they are hashed.
+    std::string dir(const std::string& resource, const std::string& version)
+        const
+    {
+        return resourceDir(resource) + toHex(fnv1a(version)) + '/';
+    }
+
+    // Returns the path of the tile which answers the node read "query" of
+    // "key", or an empty string if the query does not match a preset or the
+    // tile has not been rendered.
+    std::string find(
+            const std::string& resource,
+            const std::string& version,
+            const Key& key,
+            const Json::Value& query) const
+    {
+        const Json::Value options(normalize(query));
+
+        for (const Json::Value& preset : m_presets)
+        {
+            if (normalize(preset) != options) continue;
+
+            const std::string path(
+                    dir(resource, version) + preset["name"].asString() + '/' +
+                    key.toString());
+
+            struct stat s;
+            if (::stat(path.c_str(), &s) == 0) return path;
+            return std::string();
+        }
+
+        return std::string();
+    }
+
+    static void makeDir(const std::string& path)
+    {
+        struct stat s;
+        if (::stat(path.c_str(), &s) != 0 && ::mkdir(path.c_str(), 0755))
+        {
+            throw std::runtime_error("Could not create " + path);
+        }
+    }
+
+private:
+    // The options of a read which determine its response, with defaults
+    // removed, so that equivalent reads compare equal.
+    static Json::Value normalize(const Json::Value& query)
+    {
+        Json::Value options(Json::objectValue);
+
+        for (const std::string& name : query.getMemberNames())
+        {
+            const Json::Value& v(query[name]);
+
+            if (name == "name" || name == "node" || name == "ifNoneMatch")
+            {
+                continue;
+            }
+
+            if (name == "schema" && v.isNull()) continue;
+            if (name == "compress" && !v.asBool()) continue;
+            if (name == "format" && v.asString() == "legacy") continue;
+
+            options[name] = v;
+        }
+
+        return options;
+    }
+
+    std::string m_path;
+    const std::size_t m_depths;
+    const Json::Value m_presets;
+};
+
+// Renders the tiles of every populated node of a resource within the depths
+// of the tile store, for each preset.  Each tile holds exactly the response
+// of the live node read that it replaces.  When all tiles are written, an
+// "index.json" listing them is written alongside.
+class MaterializeJob : public Job
+{
+public:
+    MaterializeJob(
+            const std::string& id,
+            std::shared_ptr<Session> session,
+            const TileStore& store)
+        : Job(id, session)
+        , m_store(store)
+        , m_baseDepth(0)
+        , m_is3d(false)
+    { }
+
+    virtual void plan() override
+    {
+        const Json::Value info(m_session->info());
+        m_baseDepth = info["baseDepth"].asUInt64();
+        m_is3d = info["type"].asString() == "octree";
+        m_version = m_session->version();
+        m_dir = m_store.dir(resource(), m_version);
+
+        const Json::Value h(
+                m_session->hierarchy(
+                    nullptr,
+                    m_baseDepth,
+                    m_baseDepth + m_store.depths(),
+                    false,
+                    nullptr,
+                    nullptr));
+
+        collect(h, Key(m_baseDepth, 0, 0, 0));
+
+        TileStore::makeDir(m_store.resourceDir(resource()));
+        TileStore::makeDir(m_dir);
+
+        for (const Json::Value& preset : m_store.presets())
+        {
+            TileStore::makeDir(m_dir + preset["name"].asString());
+        }
+
+        if (m_nodes.empty()) complete();
+    }
+
+    virtual std::size_t tasks() const override
+    {
+        return m_nodes.size() * m_store.presets().size();
+    }
+
+protected:
+    virtual std::string path() const override { return m_dir; }
+
+    virtual void work(std::size_t index) override
+    {
+        const Json::Value& preset(
+                m_store.presets()[Json::ArrayIndex(index / m_nodes.size())]);
+        const Key& key(m_nodes[index % m_nodes.size()].first);
+
+        const entwine::Bounds bounds(
+                key.bounds(
+                    m_session->bounds(nullptr, nullptr),
+                    m_baseDepth,
+                    m_is3d));
+
+        std::unique_ptr<entwine::Schema> schema(
+                entwine::maybeCreate<entwine::Schema>(preset["schema"]));
+
+        std::unique_ptr<ReadQuery> q(
+                m_session->getQuery(
+                    &bounds,
+                    key.depth,
+                    key.depth + 1,
+                    nullptr,
+                    nullptr,
+                    schema.get(),
+                    Json::nullValue,
+                    preset["compress"].asBool()));
+
+        const std::string name(
+                preset["name"].asString() + '/' + key.toString());
+        const uint64_t bytes(write(*q, m_dir + name));
+
+        if (!m_cancelled) finish(name, bytes ? q->numPoints() : 0, bytes);
+    }
+
+    virtual void complete() override
+    {
+        Json::Value index;
+        index["version"] = m_version;
+        index["depthBegin"] = static_cast<Json::UInt64>(m_baseDepth);
+        index["depthEnd"] =
+            static_cast<Json::UInt64>(m_baseDepth + m_store.depths());
+
+        for (const Json::Value& preset : m_store.presets())
+        {
+            index["presets"].append(preset["name"]);
+        }
+
+        for (const auto& node : m_nodes)
+        {
+            index["nodes"][node.first.toString()] =
+                static_cast<Json::UInt64>(node.second);
+        }
+
+        const std::string path(m_dir + "index.json");
+        const std::string temp(path + ".tmp");
+
+        {
+            std::ofstream stream(temp, std::ios::out | std::ios::trunc);
+            stream << index;
+        }
+
+        if (std::rename(temp.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temp.c_str());
+            fail("Could not write " + path);
+        }
+    }
+
+private:
+    // Collects the populated nodes of a hierarchy, keyed by direction from
+    // the node at "key".
+    void collect(const Json::Value& node, const Key& key)
+    {
+        const uint64_t n(node["n"].asUInt64());
+        if (n) m_nodes.emplace_back(key, n);
+
+        for (unsigned int c(0); c < (m_is3d ? 8u : 4u); ++c)
+        {
+            const std::string dir(hierarchy::direction(c, m_is3d));
+            if (node.isMember(dir)) collect(node[dir], key.child(c));
+        }
+    }
+
+    const TileStore& m_store;
+
+    std::size_t m_baseDepth;
+    bool m_is3d;
+    std::string m_version;
+    std::string m_dir;
+    std::vector<std::pair<Key, uint64_t>> m_nodes;
+};
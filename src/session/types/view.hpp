@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <json/json.h>
+
+#include <entwine/types/bounds.hpp>
+#include <entwine/types/point.hpp>
+
+// A camera against which the importance of tree nodes is judged, in the same
+// coordinate system as the query bounds.  A node's geometric error is
+// estimated from its hierarchy count as the spacing of its points, and its
+// screen-space error is that spacing projected to pixels at the node's
+// distance from the eye.
+class View
+{
+public:
+    // Expects an object like:
+    //      {
+    //          "eye": [x, y, z],
+    //          "height": <viewport height in pixels>,
+    //          "fov": <vertical field of view in degrees, default 60>,
+    //          "planes": [[a, b, c, d], ...],
+    //          "maxError": <target screen-space error in pixels, default 1>
+    //      }
+    // where a point is within a plane when ax + by + cz + d >= 0.  Planes are
+    // optional, and without them nothing is culled.
+    View(const Json::Value& json)
+        : m_eye(json["eye"])
+        , m_factor(0)
+        , m_maxError(
+                json.isMember("maxError") ? json["maxError"].asDouble() : 1)
+    {
+        if (!json["eye"].isArray() || json["eye"].size() != 3)
+        {
+            throw std::runtime_error("View requires an \"eye\" position");
+        }
+
+        const double height(json["height"].asDouble());
+        const double fov(
+                (json.isMember("fov") ? json["fov"].asDouble() : 60) *
+                pi / 180.0);
+
+        if (height <= 0 || fov <= 0 || fov >= pi)
+        {
+            throw std::runtime_error("Invalid view height or fov");
+        }
+
+        if (m_maxError <= 0) throw std::runtime_error("Invalid maxError");
+
+        m_factor = height / (2.0 * std::tan(fov / 2.0));
+
+        for (const Json::Value& p : json["planes"])
+        {
+            if (!p.isArray() || p.size() != 4)
+            {
+                throw std::runtime_error("Invalid view plane");
+            }
+
+            m_planes.push_back(
+                    {{
+                        p[0].asDouble(),
+                        p[1].asDouble(),
+                        p[2].asDouble(),
+                        p[3].asDouble()
+                    }});
+        }
+    }
+
+    // False if "bounds" lies entirely outside any plane.
+    bool visible(const entwine::Bounds& bounds) const
+    {
+        const entwine::Point& min(bounds.min());
+        const entwine::Point& max(bounds.max());
+
+        for (const auto& p : m_planes)
+        {
+            // The corner furthest along the plane normal.
+            const double x(p[0] >= 0 ? max.x : min.x);
+            const double y(p[1] >= 0 ? max.y : min.y);
+            const double z(p[2] >= 0 ? max.z : min.z);
+
+            if (p[0] * x + p[1] * y + p[2] * z + p[3] < 0) return false;
+        }
+
+        return true;
+    }
+
+    // Screen-space error, in pixels, of a node of "bounds" holding "n"
+    // points.  Nodes containing the eye have unbounded error.
+    double error(const entwine::Bounds& bounds, uint64_t n) const
+    {
+        if (!n) return 0;
+
+        const entwine::Point& min(bounds.min());
+        const entwine::Point& max(bounds.max());
+
+        const double width(
+                std::max(
+                    max.x - min.x,
+                    std::max(max.y - min.y, max.z - min.z)));
+        const double spacing(width / std::sqrt(static_cast<double>(n)));
+
+        const double dx(outside(m_eye.x, min.x, max.x));
+        const double dy(outside(m_eye.y, min.y, max.y));
+        const double dz(outside(m_eye.z, min.z, max.z));
+        const double distance(std::sqrt(dx * dx + dy * dy + dz * dz));
+
+        if (!distance) return std::numeric_limits<double>::max();
+        return spacing * m_factor / distance;
+    }
+
+    double maxError() const { return m_maxError; }
+
+private:
+    static constexpr double pi = 3.14159265358979323846;
+
+    static double outside(double v, double min, double max)
+    {
+        return v < min ? min - v : v > max ? v - max : 0;
+    }
+
+    entwine::Point m_eye;
+    std::vector<std::array<double, 4>> m_planes;
+
+    // Pixels per unit of size at unit distance.
+    double m_factor;
+    double m_maxError;
+};
+
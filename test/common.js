@@ -1,5 +1,14 @@
+var path = require('path');
+
 module.exports = {
     server: 'http://localhost:8080',
-    resource: '/resource/ellipsoid'
-};
+    ws: 'ws://localhost:8082',
+    nativeHttp: { host: 'localhost', port: 8084 },
+    resource: '/resource/ellipsoid',
 
+    // These match the paths of test/config.json.
+    data: path.join(__dirname, '..', 'data'),
+    snapshots: path.join(__dirname, '..', 'data', 'snapshots'),
+    exports: path.join(__dirname, '..', 'data', 'exports'),
+    tiles: path.join(__dirname, '..', 'data', 'tiles')
+};
@@ -0,0 +1,94 @@
+var common = require('./common');
+var server = common.server;
+var resource = common.resource;
+var util = require('./util');
+
+var fs = require('fs');
+var path = require('path');
+var request = require('sync-request');
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+var expect = chai.expect;
+chai.use(chaiHttp);
+
+var info = util.httpSync('/info');
+
+// The test config keeps settled jobs for two seconds.
+describe('export', () => {
+    var start = () => new Promise((resolve) => {
+        chai.request(server).post(resource + '/export')
+        .send({ schema: util.xyz })
+        .end((err, res) => {
+            res.should.have.status(202);
+            resolve(res.body);
+        });
+    });
+
+    // The status of a job, or null once it has been forgotten.
+    var status = (id) => {
+        var res = request('GET', server + resource + '/export/' + id);
+        return res.statusCode == 200 ? JSON.parse(res.getBody()) : null;
+    };
+
+    var dirOf = (id) => path.join(common.exports, id);
+
+    it('writes tiles in the background', () => {
+        return start()
+        .then((job) => {
+            expect(job.tiles).to.be.above(0);
+            expect(['running', 'done']).to.include(job.state);
+
+            return util.waitFor(() => status(job.id).state == 'done')
+            .then(() => status(job.id));
+        })
+        .then((s) => {
+            expect(s.tilesDone).to.equal(s.tiles);
+            expect(s.points).to.equal(info.numPoints);
+            expect(s.files).to.not.be.empty;
+
+            s.files.forEach((f) => {
+                var stat = fs.statSync(path.join(dirOf(s.id), f.name));
+                expect(stat.size).to.equal(f.bytes);
+            });
+        });
+    });
+
+    it('cancels a job', (done) => {
+        start()
+        .then((job) => {
+            chai.request(server).delete(resource + '/export/' + job.id)
+            .end((err, res) => {
+                res.should.have.status(200);
+                expect(res.body.state).to.equal('cancelled');
+                expect(status(job.id).state).to.equal('cancelled');
+
+                // Tiles in progress are finished or removed.
+                var dir = dirOf(job.id);
+                util.waitFor(() => !fs.existsSync(dir) || fs.readdirSync(dir)
+                        .every((name) => !name.endsWith('.tmp')))
+                .then(() => done());
+            });
+        });
+    });
+
+    it('forgets settled jobs along with their files', () => {
+        var removed = util.stats().exports.removed;
+        var id;
+
+        return start()
+        .then((job) => {
+            id = job.id;
+            return util.waitFor(() => status(id).state == 'done');
+        })
+        .then(() => {
+            expect(fs.existsSync(dirOf(id))).to.equal(true);
+            return util.waitFor(() => status(id) === null);
+        })
+        .then(() => {
+            expect(fs.existsSync(dirOf(id))).to.equal(false);
+            expect(util.stats().exports.removed).to.be.above(removed);
+        });
+    });
+});
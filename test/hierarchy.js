@@ -0,0 +1,272 @@
+var common = require('./common');
+var util = require('./util');
+
+var fs = require('fs');
+var path = require('path');
+
+var chai = require('chai');
+var should = chai.should();
+var expect = chai.expect;
+
+var info = util.httpSync('/info');
+
+describe('hierarchy', () => {
+    describe('result cache', () => {
+        var depth = info.baseDepth;
+        var cache = () => util.stats().hierarchyCache;
+
+        // Distinct bounds which are not cells of the tree, so that each
+        // single-depth query has its own small result.
+        var slice = (i) => {
+            var b = info.bounds.slice();
+            b[3] -= (b[3] - b[0]) * (i + 1) / 1000;
+            return b;
+        };
+
+        var query = (i) => util.httpSync(
+                '/hierarchy?depthBegin=' + depth +
+                '&depthEnd=' + (depth + 1) +
+                '&bounds=' + JSON.stringify(slice(i)));
+
+        it('answers repeated queries from the cache', () => {
+            var before = cache();
+            var first = query(0);
+            var second = query(0);
+            var after = cache();
+
+            expect(second).to.deep.equal(first);
+            expect(after.misses - before.misses).to.equal(1);
+            expect(after.hits - before.hits).to.equal(1);
+        });
+
+        it('evicts the least recently used results', () => {
+            var before = cache();
+            var first = query(1);
+
+            // Every result cached before the first query, and then its own,
+            // must be evicted before it.
+            var i = 2;
+            while (cache().evictions - before.evictions <= before.results) {
+                query(i++);
+                expect(i).to.be.below(1000);
+            }
+
+            var after = cache();
+            expect(after.bytes).to.be.at.most(after.maxBytes);
+
+            // The most recent result is still cached.
+            query(i - 1);
+            expect(cache().hits).to.equal(after.hits + 1);
+
+            // The least recent one is recomputed, with the same result.
+            var misses = cache().misses;
+            expect(query(1)).to.deep.equal(first);
+            expect(cache().misses).to.equal(misses + 1);
+        });
+    });
+
+    describe('index', () => {
+        var names = ['index-built', 'index-opened', 'index-stale'];
+        var stats = () => util.stats().hierarchyIndex;
+
+        var indexFile = (name) => path.join(
+                common.snapshots,
+                util.safeName(name) + '.hierarchy');
+
+        // The first child cell of the full bounds, for depths within the
+        // configured index.
+        var b = info.bounds;
+        var cell = [
+            b[0], b[1], b[2],
+            (b[0] + b[3]) / 2, (b[1] + b[4]) / 2, (b[2] + b[5]) / 2
+        ];
+
+        var query = (name) => util.getSync(
+                '/resource/' + name + '/hierarchy' +
+                '?depthBegin=' + (info.baseDepth + 1) +
+                '&depthEnd=' + (info.baseDepth + 3) +
+                '&bounds=' + JSON.stringify(cell));
+
+        // Queries the cell, resolving to its hierarchy once it is answered
+        // from the index.
+        var indexed = (name) => {
+            var result;
+
+            return util.waitFor(() => {
+                var answered = stats().answered;
+                result = query(name);
+                return stats().answered > answered;
+            })
+            .then(() => result);
+        };
+
+        var expected;
+
+        before(() => names.forEach((name) => {
+            if (fs.existsSync(indexFile(name))) fs.unlinkSync(indexFile(name));
+            util.copyResource(name);
+        }));
+
+        after(() => names.forEach(util.removeResource));
+
+        it('is built in the background', () => {
+            var before = stats();
+
+            // The first query is answered without waiting for the index.
+            expected = query('index-built');
+            expect(stats().answered).to.equal(before.answered);
+
+            return indexed('index-built').then((result) => {
+                expect(result).to.deep.equal(expected);
+                expect(stats().built).to.be.above(before.built);
+                expect(fs.existsSync(indexFile('index-built'))).to.equal(true);
+            });
+        });
+
+        it('is mapped from a previous build', () => {
+            fs.writeFileSync(
+                    indexFile('index-opened'),
+                    fs.readFileSync(indexFile('index-built')));
+
+            var before = stats();
+
+            return indexed('index-opened').then((result) => {
+                expect(result).to.deep.equal(expected);
+                expect(stats().opened).to.be.above(before.opened);
+            });
+        });
+
+        it('is rebuilt if stored for another version', () => {
+            var built = fs.readFileSync(indexFile('index-built'));
+
+            // The version follows the 8-byte magic of the header.
+            var stale = Buffer.from(built);
+            stale.fill(0, 8, 16);
+            fs.writeFileSync(indexFile('index-stale'), stale);
+
+            var before = stats();
+
+            return indexed('index-stale').then((result) => {
+                expect(result).to.deep.equal(expected);
+                expect(stats().built).to.be.above(before.built);
+
+                var rebuilt = fs.readFileSync(indexFile('index-stale'));
+                expect(rebuilt.slice(8, 16).equals(built.slice(8, 16)))
+                    .to.equal(true);
+            });
+        });
+    });
+
+    describe('parallel queries', () => {
+        // Below the depths of the snapshot and the index, so that these are
+        // computed from the resource.  Queries spanning the parallelDepth of
+        // the test config are split by subtree, and shallower ones are not.
+        var depth = info.baseDepth + 4;
+
+        var query = (bounds, begin, end, vertical) => util.httpSync(
+                '/hierarchy?depthBegin=' + begin + '&depthEnd=' + end +
+                '&bounds=' + JSON.stringify(bounds) +
+                (vertical ? '&vertical=true' : ''));
+
+        var bisect = (b, dir) => {
+            var mid = [0, 1, 2].map((i) => b[i] + (b[i + 3] - b[i]) / 2);
+            var r = b.slice();
+
+            if (dir[0] == 'n') r[1] = mid[1]; else r[4] = mid[1];
+            if (dir[1] == 'e') r[0] = mid[0]; else r[3] = mid[0];
+            if (dir[2] == 'u') r[2] = mid[2]; else r[5] = mid[2];
+
+            return r;
+        };
+
+        var prune = (tree, levels) => Object.keys(tree).reduce((p, k) => {
+            if (k == 'n') p.n = tree.n;
+            else if (levels > 1) p[k] = prune(tree[k], levels - 1);
+            return p;
+        }, { });
+
+        it('count the same points as serial queries', () => {
+            var parallel = query(info.bounds, depth, depth + 4, true);
+            var serial = [0, 1, 2, 3].map((i) =>
+                    query(info.bounds, depth + i, depth + i + 1, true)[0]);
+
+            expect(serial[0]).to.be.above(0);
+            expect(parallel).to.deep.equal(serial);
+        });
+
+        it('return the same tree as serial queries', () => {
+            var tree = query(info.bounds, depth, depth + 3);
+            expect(tree.n).to.be.above(0);
+
+            expect(prune(tree, 2)).to.deep.equal(
+                    query(info.bounds, depth, depth + 2));
+
+            Object.keys(tree).filter((k) => k != 'n').forEach((dir) => {
+                expect(tree[dir]).to.deep.equal(
+                        query(bisect(info.bounds, dir), depth + 1, depth + 3));
+            });
+        });
+    });
+
+    describe('batch', () => {
+        var base = info.baseDepth;
+        var depths = 3;
+
+        var keyBounds = (key) => {
+            var k = key.split('-').map(Number);
+            var cells = Math.pow(2, k[0] - base);
+            var b = info.bounds;
+            var at = (i, n) => b[i] + (b[i + 3] - b[i]) / cells * n;
+
+            return [
+                at(0, k[1]), at(1, k[2]), at(2, k[3]),
+                at(0, k[1] + 1), at(1, k[2] + 1), at(2, k[3] + 1)
+            ];
+        };
+
+        var slice = info.bounds.slice();
+        slice[3] -= (slice[3] - slice[0]) / 3;
+
+        // Sibling keys, which are answered together, a lone root key, and
+        // bounds queries, one of which is not a cell.
+        var queries = [
+            (base + 1) + '-0-0-0',
+            (base + 1) + '-1-0-0',
+            (base + 1) + '-1-1-1',
+            base + '-0-0-0',
+            { bounds: keyBounds((base + 2) + '-1-2-3'), depth: base + 2 },
+            { bounds: slice, depthBegin: base, depthEnd: base + 2 }
+        ];
+
+        var single = (q, vertical) => {
+            var options = typeof q == 'string' ? {
+                bounds: keyBounds(q),
+                depthBegin: Number(q.split('-')[0]),
+                depthEnd: Number(q.split('-')[0]) + depths
+            } : q;
+
+            if (vertical) options.vertical = true;
+
+            return util.httpSync('/hierarchy?' + Object.keys(options)
+                    .map((k) => k + '=' + JSON.stringify(options[k]))
+                    .join('&'));
+        };
+
+        var batch = (vertical) => util.httpSync(
+                '/hierarchyBatch?depths=' + depths +
+                '&vertical=' + vertical +
+                '&queries=' + encodeURIComponent(JSON.stringify(queries)));
+
+        [false, true].forEach((vertical) => {
+            it('matches single ' + (vertical ? 'vertical ' : '') +
+                    'queries', () => {
+                var results = batch(vertical);
+                expect(results).to.have.lengthOf(queries.length);
+
+                queries.forEach((q, i) => {
+                    expect(results[i]).to.deep.equal(single(q, vertical));
+                });
+            });
+        });
+    });
+});
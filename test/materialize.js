@@ -0,0 +1,148 @@
+var common = require('./common');
+var server = common.server;
+var util = require('./util');
+
+var fs = require('fs');
+var path = require('path');
+var request = require('sync-request');
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+var expect = chai.expect;
+chai.use(chaiHttp);
+
+var info = util.httpSync('/info');
+
+// The test config renders two depths of tiles, in the native schema and in
+// the "xyz" preset.
+describe('materialize', () => {
+    var name = 'materialize-test';
+    var resource = '/resource/' + name;
+    var depths = 2;
+
+    var node = (key, query) => new Promise((resolve) => {
+        chai.request(server).get(resource + '/node/' + key + (query || ''))
+        .buffer()
+        .parse((res, cb) => {
+            var chunks = [];
+            res.on('data', (c) => chunks.push(c));
+            res.on('end', () => cb(null, Buffer.concat(chunks)));
+        })
+        .end((err, res) => resolve(res));
+    });
+
+    // The first populated node at "depth", found by descending the
+    // hierarchy through the first populated child of each node.
+    var populated = (depth) => {
+        var tree = util.getSync(resource + '/hierarchy' +
+                '?depthBegin=' + info.baseDepth + '&depthEnd=' + (depth + 1));
+        var key = [info.baseDepth, 0, 0, 0];
+
+        while (key[0] < depth) {
+            var dir = Object.keys(tree).filter((k) => k != 'n')[0];
+            tree = tree[dir];
+            key = [
+                key[0] + 1,
+                key[1] * 2 + (dir[1] == 'e' ? 1 : 0),
+                key[2] * 2 + (dir[0] == 'n' ? 1 : 0),
+                key[3] * 2 + (dir[2] == 'u' ? 1 : 0)
+            ];
+        }
+
+        return key.join('-');
+    };
+
+    var rendered, deeper;
+
+    // Rendered tiles are sent as files, which support ranges, while live
+    // reads are streamed.
+    var fromFile = (res) => res.header['accept-ranges'] == 'bytes';
+
+    var tiles = path.join(common.tiles, util.safeName(name));
+    var live = { };
+
+    before(() => {
+        util.copyResource(name);
+        util.removeDir(tiles);
+
+        rendered = populated(info.baseDepth + depths - 1);
+        deeper = populated(info.baseDepth + depths);
+
+        var reads = [
+            [rendered, ''],
+            [rendered, '?schema=xyz'],
+            [deeper, '']
+        ];
+
+        return Promise.all(reads.map((r) => node(r[0], r[1])))
+        .then((results) => {
+            results.forEach((res, i) => {
+                res.should.have.status(200);
+                expect(fromFile(res)).to.equal(false);
+                live[reads[i].join('')] = res;
+            });
+        });
+    });
+
+    after(() => {
+        util.removeResource(name);
+        util.removeDir(tiles);
+    });
+
+    it('renders tiles in the background', () => {
+        return new Promise((resolve) => {
+            chai.request(server).post(resource + '/materialize')
+            .end((err, res) => {
+                res.should.have.status(202);
+                resolve(res.body);
+            });
+        })
+        .then((job) => {
+            expect(job.tiles).to.be.above(0);
+
+            var status = () => JSON.parse(request('GET',
+                        server + resource + '/export/' + job.id).getBody());
+
+            return util.waitFor(() => status().state == 'done');
+        })
+        .then(() => {
+            var versions = fs.readdirSync(tiles);
+            expect(versions).to.have.lengthOf(1);
+
+            var index = JSON.parse(fs.readFileSync(
+                        path.join(tiles, versions[0], 'index.json')));
+            expect(index.nodes).to.have.property(rendered);
+            expect(index.nodes).to.not.have.property(deeper);
+        });
+    });
+
+    it('serves rendered nodes as the live read would', () => {
+        return Promise.all([node(rendered, ''), node(rendered, '?schema=xyz')])
+        .then((results) => {
+            [[results[0], rendered], [results[1], rendered + '?schema=xyz']]
+            .forEach((pair) => {
+                var res = pair[0];
+                var before = live[pair[1]];
+
+                res.should.have.status(200);
+                expect(fromFile(res)).to.equal(true);
+                expect(res.header['etag']).to.equal(before.header['etag']);
+                expect(res.header['content-type'])
+                    .to.equal(before.header['content-type']);
+                expect(res.body.equals(before.body)).to.equal(true);
+            });
+        });
+    });
+
+    it('reads deeper nodes live', () => {
+        return node(deeper, '').then((res) => {
+            var before = live[deeper];
+
+            res.should.have.status(200);
+            expect(fromFile(res)).to.equal(false);
+            expect(res.header['etag']).to.equal(before.header['etag']);
+            expect(res.body.equals(before.body)).to.equal(true);
+        });
+    });
+});
@@ -0,0 +1,181 @@
+var common = require('./common');
+var resource = common.resource;
+var util = require('./util');
+
+var http = require('http');
+var net = require('net');
+
+var chai = require('chai');
+var should = chai.should();
+var expect = chai.expect;
+
+var info = util.httpSync('/info');
+
+// The test config serves two connections at once on the native port, with
+// room for one more to wait.
+describe('native http', () => {
+    var nativeStats = () => util.stats().nativeHttp;
+
+    // A request on its own connection, which is closed after the response.
+    var get = (path, headers) => new Promise((resolve, reject) => {
+        http.get({
+            host: common.nativeHttp.host,
+            port: common.nativeHttp.port,
+            path: path,
+            headers: headers || { },
+            agent: false
+        }, (res) => {
+            var chunks = [];
+            res.on('data', (c) => chunks.push(c));
+            res.on('end', () => {
+                res.body = Buffer.concat(chunks);
+                resolve(res);
+            });
+        })
+        .on('error', reject);
+    });
+
+    var query = (q) => '?' + Object.keys(q).map((k) => {
+        return k + '=' + encodeURIComponent(JSON.stringify(q[k]));
+    }).join('&');
+
+    // A raw connection, which resolves once connected.  Received data
+    // accumulates in "received".
+    var connect = () => new Promise((resolve, reject) => {
+        var socket = net.connect(common.nativeHttp, () => resolve(socket));
+        socket.received = '';
+        socket.closed = false;
+        socket.on('data', (d) => socket.received += d.toString('binary'));
+        socket.on('close', () => socket.closed = true);
+        socket.on('error', () => { });
+        socket.once('error', reject);
+    });
+
+    var missing = '/resource/native-missing/read';
+    var request = 'GET ' + missing + ' HTTP/1.1\r\nHost: localhost\r\n\r\n';
+
+    var idle = () => util.waitFor(() => nativeStats().connections == 0);
+
+    it('reads as the JS server does', () => {
+        var q = { schema: util.xyz, depth: info.baseDepth };
+
+        return Promise.all([get(resource + '/read' + query(q)), util.read(q)])
+        .then((results) => {
+            results[0].statusCode.should.equal(200);
+            expect(results[0].body.equals(Buffer.from(results[1].body)))
+                .to.equal(true);
+        });
+    });
+
+    it('answers a held node with a 304', () => {
+        var key = info.baseDepth + '-0-0-0';
+        var path = resource + '/node/' + key;
+
+        return Promise.all([get(path), util.node(key)])
+        .then((results) => {
+            var res = results[0];
+            res.statusCode.should.equal(200);
+
+            var etag = res.headers['etag'];
+            expect(etag).to.equal(results[1].header['etag']);
+
+            return get(path, { 'If-None-Match': etag });
+        })
+        .then((res) => {
+            res.statusCode.should.equal(304);
+            expect(res.body.length).to.equal(0);
+        });
+    });
+
+    it('shares the ETag of a key however it is written', () => {
+        var key = info.baseDepth + '-0-0-0';
+        var spelled = '0' + info.baseDepth + '-00-0-0';
+
+        return Promise.all([
+            get(resource + '/node/' + spelled),
+            util.node(key),
+            util.node(spelled)
+        ])
+        .then((results) => {
+            results[0].statusCode.should.equal(200);
+
+            var etag = results[1].header['etag'];
+            expect(results[0].headers['etag']).to.equal(etag);
+            expect(results[2].header['etag']).to.equal(etag);
+        });
+    });
+
+    it('remembers names that are not found', () => {
+        var hits = nativeStats().notFoundHits;
+
+        return get(missing)
+        .then((res) => {
+            res.statusCode.should.equal(404);
+            return get(missing);
+        })
+        .then((res) => {
+            res.statusCode.should.equal(404);
+            expect(nativeStats().notFoundHits).to.be.above(hits);
+        });
+    });
+
+    it('closes idle keep-alive connections for waiting ones', () => {
+        var yielded, held, waiting;
+
+        return idle()
+        .then(() => {
+            yielded = nativeStats().yielded;
+            return Promise.all([connect(), connect()]);
+        })
+        .then((sockets) => {
+            // Each takes a thread, and keeps it after its response.
+            held = sockets;
+            held.forEach((s) => s.write(request));
+            return util.waitFor(() => held.every((s) => s.received.length));
+        })
+        .then(() => connect())
+        .then((socket) => {
+            waiting = socket;
+            waiting.write(request);
+
+            // This is answered long before the idle timeout.
+            return util.waitFor(() => waiting.received.length);
+        })
+        .then(() => {
+            expect(waiting.received).to.match(/^HTTP\/1.1 404/);
+            return util.waitFor(() => held.every((s) => s.closed));
+        })
+        .then(() => {
+            expect(nativeStats().yielded).to.be.at.least(yielded + 2);
+            waiting.destroy();
+        });
+    });
+
+    it('refuses connections beyond the queue', () => {
+        var sockets;
+        var rejected;
+
+        return idle()
+        .then(() => {
+            rejected = nativeStats().rejected;
+
+            // Two connections which have yet to send a request take the
+            // threads, and a third waits.
+            return Promise.all([connect(), connect(), connect()]);
+        })
+        .then((s) => {
+            sockets = s;
+            return util.waitFor(() => nativeStats().connections == 3);
+        })
+        .then(() => connect())
+        .then((socket) => {
+            sockets.push(socket);
+            return util.waitFor(() => socket.closed);
+        })
+        .then(() => {
+            expect(sockets[3].received).to.match(/^HTTP\/1.1 503/);
+            expect(nativeStats().rejected).to.equal(rejected + 1);
+            sockets.forEach((s) => s.destroy());
+        });
+    });
+});
@@ -167,6 +167,419 @@ describe('read', () => {
         .then(() => done());
     });
 
+    it('batches split bounds into one framed response', (done) => {
+        var schema = util.xyz;
+        var depth = 8;
+        var splits = util.split(info.bounds);
+        var queries = splits.map((b) => ({ bounds: b, depth: depth }));
+
+        var singles = queries.map((q) => util.read({
+            schema: schema,
+            bounds: q.bounds,
+            depth: q.depth
+        }));
+
+        Promise.all([
+            util.readBatch({ schema: schema, queries: queries }),
+            Promise.all(singles)
+        ])
+        .then((results) => {
+            var batch = results[0];
+            batch.should.have.status(200);
+
+            var payloads = util.parseFrames(batch.body);
+            expect(payloads.length).to.equal(queries.length);
+
+            payloads.forEach((payload, i) => {
+                expect(util.numPointsFrom(payload, schema)).to.equal(
+                    util.numPointsFrom(results[1][i].body, schema));
+            });
+
+            done();
+        });
+    });
+
+    it('selects depths within a point budget', (done) => {
+        var schema = util.xyz;
+        var budget = 50000;
+
+        util.read({ schema: schema, depthBegin: 0, pointBudget: budget })
+        .then((res) => {
+            res.should.have.status(200);
+
+            var n = util.numPointsFrom(res.body, schema);
+            expect(n).to.be.above(0);
+            expect(n).to.be.at.most(budget);
+            expect(n).to.equal(+res.header['x-greyhound-points']);
+
+            var end = +res.header['x-greyhound-depth-end'];
+            return util.read({ schema: schema, depthBegin: 0, depthEnd: end })
+            .then((full) => {
+                expect(util.numPointsFrom(full.body, schema))
+                    .to.be.at.most(n);
+                done();
+            });
+        });
+    });
+
+    it('streams view nodes most important first', (done) => {
+        var schema = util.xyz;
+        var b = info.bounds;
+        var eye = [b[0], b[1], b[5] + (b[5] - b[2])];
+        var budget = 200000;
+
+        util.readView({
+            schema: schema,
+            pointBudget: budget,
+            view: { eye: eye, height: 1000, maxError: 4 }
+        })
+        .then((res) => {
+            res.should.have.status(200);
+
+            var payloads = util.parseFrames(res.body);
+            var meta = payloads.meta;
+            expect(payloads.length).to.be.above(0);
+            expect(meta.length).to.equal(payloads.length);
+
+            var total = 0;
+            payloads.forEach((payload, i) => {
+                var n = util.numPointsFrom(payload, schema);
+                expect(n).to.equal(meta[i].points);
+                total += n;
+            });
+
+            expect(total).to.be.at.most(budget);
+            done();
+        });
+    });
+
+    it('skips excluded nodes', (done) => {
+        var schema = util.xyz;
+        var base = info.baseDepth;
+        var query = { schema: schema, depthBegin: base, depthEnd: base + 2 };
+
+        Promise.all([
+            util.read(query),
+            util.read({ schema: schema, depth: base }),
+            util.read(Object.assign({ exclude: [base + '-0-0-0'] }, query))
+        ])
+        .then((results) => {
+            results.forEach((res) => res.should.have.status(200));
+
+            var n = results.map((r) => util.numPointsFrom(r.body, schema));
+            expect(n[2]).to.equal(n[0] - n[1]);
+            done();
+        });
+    });
+
+    it('streams depths in order', (done) => {
+        var schema = util.xyz;
+        var begin = info.baseDepth;
+        var end = begin + 3;
+
+        var singles = [];
+        for (var d = begin; d < end; ++d) {
+            singles.push(util.read({ schema: schema, depth: d }));
+        }
+
+        Promise.all([
+            util.read({
+                schema: schema,
+                depthBegin: begin,
+                depthEnd: end,
+                depthOrdered: true
+            }),
+            Promise.all(singles)
+        ])
+        .then((results) => {
+            results[0].should.have.status(200);
+
+            var view = new DataView(results[0].body);
+            var offset = 0, prev = 0;
+            while (offset < view.byteLength) {
+                var depth = view.getUint32(offset, true);
+                expect(depth).to.be.at.least(prev);
+                prev = depth;
+                offset += 12 + view.getUint32(offset + 8, true);
+            }
+
+            var payloads = util.parseFrames(results[0].body).slice(begin);
+            expect(payloads.length).to.equal(end - begin);
+
+            payloads.forEach((payload, i) => {
+                expect(util.numPointsFrom(payload, schema)).to.equal(
+                    util.numPointsFrom(results[1][i].body, schema));
+            });
+
+            done();
+        });
+    });
+
+    it('splits reads into resumable cursors', (done) => {
+        var schema = util.xyz;
+        var query = { schema: schema, depthEnd: info.baseDepth + 3 };
+        var cursors = util.httpSync('/split' +
+                '?schema=' + JSON.stringify(schema) +
+                '&depthEnd=' + query.depthEnd + '&split=3');
+
+        expect(cursors.length).to.equal(3);
+
+        var parts = cursors.map((c) =>
+                util.read(Object.assign({ cursor: c }, query)));
+
+        Promise.all([util.read(query), Promise.all(parts)])
+        .then((results) => {
+            var expected = util.numPointsFrom(results[0].body, schema);
+
+            var total = results[1].reduce((p, res) => {
+                res.should.have.status(200);
+                var payloads = util.parseFrames(res.body);
+                expect(payloads.meta[payloads.meta.length - 1].cursor)
+                    .to.equal(null);
+
+                return payloads.reduce((n, payload) =>
+                        n + util.numPointsFrom(payload, schema), p);
+            }, 0);
+
+            expect(total).to.equal(expected);
+            done();
+        });
+    });
+
+    it('reads in the framed format', (done) => {
+        var schema = util.xyz;
+        var pointSize = util.pointSizeFrom(schema);
+        var query = { schema: schema, depthEnd: info.baseDepth + 2 };
+
+        Promise.all([
+            util.read(query),
+            util.read(Object.assign({ format: 'framed' }, query))
+        ])
+        .then((results) => {
+            results[1].should.have.status(200);
+
+            var framed = util.parseFramed(results[1].body);
+            expect(framed.flags).to.equal(0);
+            expect(framed.numPoints).to.equal(
+                    util.numPointsFrom(results[0].body, schema));
+
+            framed.chunks.forEach((chunk) => {
+                expect(chunk.length % pointSize).to.equal(0);
+            });
+
+            done();
+        });
+    });
+
+    it('compresses reads which decompress to the plain read', () => {
+        var schema = util.xyz;
+        var query = { schema: schema, depthEnd: info.baseDepth + 2 };
+
+        return Promise.all([
+            util.read(query),
+            util.read(Object.assign({ compress: true }, query))
+        ])
+        .then((results) => {
+            results[1].should.have.status(200);
+
+            var plain = results[0].body;
+            var compressed = results[1].body;
+            var numPoints = util.numPointsFrom(plain, schema);
+            expect(numPoints).to.be.above(0);
+
+            // Both end with the point count, after the compressed stream.
+            var end = compressed.byteLength - 4;
+            expect(new DataView(compressed).getUint32(end, true))
+                .to.equal(numPoints);
+
+            return util.decompress(compressed.slice(0, end), schema, numPoints)
+            .then((points) => {
+                var expected = Buffer.from(plain, 0, plain.byteLength - 4);
+                expect(points.equals(expected)).to.equal(true);
+            });
+        });
+    });
+
+    it('reads in the arrow format', (done) => {
+        var schema = util.xyz;
+        var pointSize = util.pointSizeFrom(schema);
+        var query = { schema: schema, depth: info.baseDepth };
+
+        Promise.all([
+            util.read(query),
+            util.read(Object.assign({ format: 'arrow' }, query))
+        ])
+        .then((results) => {
+            var res = results[1];
+            res.should.have.status(200);
+            res.header['content-type'].should.contain('arrow');
+
+            // Streams begin with a message and end with an end-of-stream
+            // marker, both led by a continuation marker.
+            var view = new DataView(res.body);
+            var end = res.body.byteLength - 8;
+            expect(view.getUint32(0, true)).to.equal(0xFFFFFFFF);
+            expect(view.getUint32(end, true)).to.equal(0xFFFFFFFF);
+            expect(view.getUint32(end + 4, true)).to.equal(0);
+            expect(res.body.byteLength % 8).to.equal(0);
+
+            var plain = new Uint8Array(results[0].body);
+            var numPoints = util.numPointsFrom(results[0].body, schema);
+            expect(numPoints).to.be.above(0);
+
+            var arrow = util.parseArrow(res.body);
+            expect(arrow.fields).to.deep.equal(schema.map((d) => d.name));
+
+            // Each column of each batch holds the values of its dimension
+            // from the points of the plain read, in order.
+            var point = 0;
+            arrow.batches.forEach((batch) => {
+                expect(batch.nodes).to.deep.equal(
+                        schema.map(() => batch.length));
+                expect(batch.columns).to.have.lengthOf(schema.length);
+
+                schema.forEach((d, c) => {
+                    var column = batch.columns[c];
+                    var offset = util.getOffset(d.name, schema);
+                    expect(column.length).to.equal(batch.length * d.size);
+
+                    for (var i = 0; i < batch.length; ++i) {
+                        var p = (point + i) * pointSize + offset;
+                        for (var b = 0; b < d.size; ++b) {
+                            if (column[i * d.size + b] != plain[p + b]) {
+                                throw new Error('Mismatched ' + d.name);
+                            }
+                        }
+                    }
+                });
+
+                point += batch.length;
+            });
+
+            expect(point).to.equal(numPoints);
+            done();
+        });
+    });
+
+    it('reads in the las format', (done) => {
+        util.read({ depth: info.baseDepth, format: 'las' })
+        .then((res) => {
+            res.should.have.status(200);
+            res.header['content-type'].should.contain('las');
+
+            var view = new DataView(res.body);
+            var magic = String.fromCharCode.apply(
+                    null, new Uint8Array(res.body, 0, 4));
+            expect(magic).to.equal('LASF');
+
+            // The header gives the offset, record length, and count of the
+            // points that follow it.
+            var offset = view.getUint32(96, true);
+            var recordLength = view.getUint16(105, true);
+            var numPoints = view.getUint32(247, true);
+            expect(numPoints).to.be.above(0);
+            expect(res.body.byteLength).to.equal(
+                    offset + numPoints * recordLength);
+            done();
+        });
+    });
+
+    it('reads several boxes, each point once', (done) => {
+        var schema = util.xyz;
+        var xmid = (bounds.xmin + bounds.xmax) / 2;
+        var ymid = (bounds.ymin + bounds.ymax) / 2;
+
+        var low = [bounds.xmin, bounds.ymin, xmid, ymid];
+        var high = [xmid, ymid, bounds.xmax, bounds.ymax];
+        var left = [bounds.xmin, bounds.ymin, xmid, bounds.ymax];
+
+        var count = (query) => {
+            query.schema = schema;
+            return util.read(query).then((res) => {
+                res.should.have.status(200);
+                return util.numPointsFrom(res.body, schema);
+            });
+        };
+
+        Promise.all([
+            count({ bounds: low }),
+            count({ bounds: high }),
+            count({ bounds: left }),
+            count({ bounds: [low, high] }),
+            count({ bounds: [low, left] }),
+            count({ bounds: [low, high, low] })
+        ])
+        .then((counts) => {
+            expect(counts[0]).to.be.above(0);
+            expect(counts[1]).to.be.above(0);
+
+            // Disjoint boxes select the points of each, however often
+            // either is repeated.
+            expect(counts[3]).to.equal(counts[0] + counts[1]);
+            expect(counts[5]).to.equal(counts[3]);
+
+            // The first box lies within the second, so their points are
+            // those of the second alone.
+            expect(counts[4]).to.equal(counts[2]);
+            done();
+        });
+    });
+
+    it('reads a node by its key, with an ETag', (done) => {
+        var key = info.baseDepth + '-0-0-0';
+
+        Promise.all([
+            util.read({ depth: info.baseDepth }),
+            util.node(key)
+        ])
+        .then((results) => {
+            results[1].should.have.status(200);
+            expect(results[1].body.byteLength).to.equal(
+                    results[0].body.byteLength);
+
+            var etag = results[1].header['etag'];
+            should.exist(etag);
+
+            return util.node(key, { 'If-None-Match': etag });
+        })
+        .then((res) => {
+            res.should.have.status(304);
+            done();
+        });
+    });
+
+    it('reads a node with a named schema preset', (done) => {
+        // The "xyz" preset of the test config matches util.xyz.
+        var key = info.baseDepth + '-0-0-0';
+        var schema = util.xyz;
+
+        Promise.all([
+            util.read({ depth: info.baseDepth, schema: schema }),
+            util.node(key),
+            util.node(key + '?schema=xyz'),
+            util.node(key + '?schema=nonexistent')
+        ])
+        .then((results) => {
+            var preset = results[2];
+            preset.should.have.status(200);
+            expect(Buffer.from(preset.body).equals(
+                    Buffer.from(results[0].body))).to.equal(true);
+
+            expect(preset.header['etag']).to.not.equal(
+                    results[1].header['etag']);
+
+            results[3].should.have.status(400);
+
+            return util.node(
+                    key + '?schema=xyz',
+                    { 'If-None-Match': preset.header['etag'] });
+        })
+        .then((res) => {
+            res.should.have.status(304);
+            done();
+        });
+    });
+
     it('errors gracefully for out-of-range values', (done) => {
         // This dataset has intensity values of 255, which won't fit into a
         // signed byte.
@@ -0,0 +1,147 @@
+var common = require('./common');
+var server = common.server;
+var util = require('./util');
+
+var fs = require('fs');
+var path = require('path');
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+var expect = chai.expect;
+chai.use(chaiHttp);
+
+var info = util.httpSync('/info');
+
+describe('reload', () => {
+    var name = 'reload-test';
+    var resource = '/resource/' + name;
+    var key = info.baseDepth + '-0-0-0';
+
+    var reload = () => new Promise((resolve) => {
+        chai.request(server).post(resource + '/reload')
+        .end((err, res) => {
+            res.should.have.status(200);
+            resolve(res.body);
+        });
+    });
+
+    var node = () => new Promise((resolve) => {
+        chai.request(server).get(resource + '/node/' + key)
+        .end((err, res) => {
+            res.should.have.status(200);
+            resolve(res.header['etag']);
+        });
+    });
+
+    before(() => util.copyResource(name));
+    after(() => util.removeResource(name));
+
+    it('swaps in a new version while reads finish on the old one', () => {
+        var socket;
+        var version;
+        var etag;
+
+        // Frames of the paused read, which is only acknowledged, and so
+        // resumed, after the reload.
+        var received = [];
+        var acking = false;
+        var finished;
+
+        var ack = (bytes) => socket.send({ id: 1, ack: bytes });
+
+        return reload()
+        .then((result) => {
+            expect(result.reloaded).to.equal(false);
+            version = result.version;
+            return node();
+        })
+        .then((e) => {
+            etag = e;
+            return util.wsConnect();
+        })
+        .then((s) => {
+            socket = s;
+
+            return new Promise((resolve) => {
+                finished = new Promise((done) => {
+                    socket.on(1, (m) => {
+                        if (!m.data) return;
+                        received.push(m.data);
+                        if (received.length == 1) resolve();
+                        if (m.last) done();
+                        else if (acking) ack(m.data.length);
+                    });
+                });
+
+                socket.send({
+                    id: 1,
+                    call: 'read',
+                    resource: name,
+                    query: { }
+                });
+            });
+        })
+        .then(() => {
+            // Any change to the index metadata is a new version.
+            var metadata = path.join(common.data, name, 'entwine');
+            fs.appendFileSync(metadata, '\n');
+            return reload();
+        })
+        .then((result) => {
+            expect(result.reloaded).to.equal(true);
+            expect(result.version).to.not.equal(version);
+            return node();
+        })
+        .then((e) => {
+            expect(e).to.not.equal(etag);
+
+            // Acknowledge everything so far, and then every frame as it
+            // comes, so the paused read runs to completion.
+            acking = true;
+            ack(received.reduce((p, c) => p + c.length, 0));
+            return finished;
+        })
+        .then(() => {
+            var data = Buffer.concat(received);
+            var numPoints = data.readUInt32LE(data.length - 4);
+            expect(numPoints).to.equal(info.numPoints);
+            socket.close();
+        });
+    });
+
+    it('reads chunks rewritten in place after a reload', () => {
+        // The appended index is the half index with the rest of the data
+        // added, which rewrites its chunks at the same paths.
+        var half = util.getSync('/resource/ellipsoid-half/info');
+        var appended = '/resource/ellipsoid-appended';
+        var readXyz = (r) => util.readFrom(r, { schema: util.xyz });
+
+        util.copyResource(name, 'ellipsoid-half');
+
+        return reload()
+        .then((result) => {
+            expect(result.reloaded).to.equal(true);
+            return readXyz(resource);
+        })
+        .then((res) => {
+            // Now the chunks of the half index are cached.
+            var numPoints = util.numPointsFrom(res.body, util.xyz);
+            expect(numPoints).to.equal(half.numPoints);
+
+            util.copyResource(name, 'ellipsoid-appended');
+            return reload();
+        })
+        .then((result) => {
+            expect(result.reloaded).to.equal(true);
+            return Promise.all([readXyz(resource), readXyz(appended)]);
+        })
+        .then((res) => {
+            var data = Buffer.from(res[0].body);
+            var expected = Buffer.from(res[1].body);
+            expect(util.numPointsFrom(res[0].body, util.xyz))
+                .to.be.above(half.numPoints);
+            expect(data.equals(expected)).to.equal(true);
+        });
+    });
+});
@@ -0,0 +1,82 @@
+var common = require('./common');
+var util = require('./util');
+
+var chai = require('chai');
+var should = chai.should();
+var expect = chai.expect;
+
+var info = util.httpSync('/info');
+
+// The test config sets a session memory budget smaller than any index, so
+// that each command releases every other idle session.
+describe('session memory', () => {
+    var names = ['registry-a', 'registry-b'];
+    var resident = () => util.stats().sessions.resident;
+
+    var read = (name) => util.readFrom(
+            '/resource/' + name,
+            { depth: info.baseDepth })
+    .then((res) => res.should.have.status(200));
+
+    before(() => names.forEach(util.copyResource));
+    after(() => names.forEach(util.removeResource));
+
+    it('releases the least recently used idle sessions', () => {
+        var evictions = util.stats().sessions.evictions;
+
+        return read('registry-a')
+        .then(() => {
+            expect(resident()).to.have.property('registry-a');
+            return read('registry-b');
+        })
+        .then(() => {
+            var r = resident();
+            expect(r).to.have.property('registry-b');
+            expect(r).to.not.have.property('registry-a');
+            expect(util.stats().sessions.evictions).to.be.above(evictions);
+        });
+    });
+
+    it('keeps sessions with reads in flight', () => {
+        var socket;
+
+        // Begin with the session in use as the most recent.
+        return read('registry-a')
+        .then(() => util.wsConnect())
+        .then((s) => {
+            socket = s;
+
+            // A full read exceeds the window of the test config, so without
+            // acknowledgements it stays paused after its first frames.
+            return new Promise((resolve) => {
+                socket.on(1, (m) => { if (m.data) resolve(); });
+                socket.send({
+                    id: 1,
+                    call: 'read',
+                    resource: 'registry-a',
+                    query: { }
+                });
+            });
+        })
+        .then(() => read('registry-b'))
+        .then(() => {
+            var r = resident();
+            expect(r).to.have.property('registry-a');
+            expect(r).to.have.property('registry-b');
+
+            return new Promise((resolve) => {
+                socket.on(1, (m) => { if (m.cancelled) resolve(); });
+                socket.send({ id: 1, cancel: true });
+            });
+        })
+        .then(() => {
+            // Once the cancelled read has finished, its session is idle and
+            // released by the next command of another session.
+            return util.waitFor(() => {
+                util.getSync('/resource/registry-b/info');
+                return !resident()['registry-a'];
+            });
+        })
+        .then(() => socket.close());
+    });
+});
@@ -0,0 +1,125 @@
+var common = require('./common');
+var server = common.server;
+var util = require('./util');
+
+var fs = require('fs');
+var path = require('path');
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+var expect = chai.expect;
+chai.use(chaiHttp);
+
+var info = util.httpSync('/info');
+
+// Each case uses its own copy of the test index, so that the server brings
+// it up for the first time, from whatever snapshot the case has written.
+var names = [
+    'snap-saved', 'snap-loaded', 'snap-stale', 'snap-corrupt', 'snap-malformed'
+];
+
+var snapshotFile = (name) =>
+    path.join(common.snapshots, util.safeName(name) + '.json');
+
+var readSnapshot = (name) =>
+    JSON.parse(fs.readFileSync(snapshotFile(name), { encoding: 'utf8' }));
+
+var writeSnapshot = (name, data) =>
+    fs.writeFileSync(
+            snapshotFile(name),
+            typeof data == 'string' ? data : JSON.stringify(data));
+
+var getInfo = (name) => new Promise((resolve) => {
+    chai.request(server).get(util.copyResource(name) + '/info')
+    .end((err, res) => resolve(res));
+});
+
+describe('snapshot', () => {
+    var saved;
+
+    before((done) => {
+        names.forEach((name) => {
+            if (fs.existsSync(snapshotFile(name))) {
+                fs.unlinkSync(snapshotFile(name));
+            }
+        });
+
+        getInfo('snap-saved').then((res) => {
+            res.should.have.status(200);
+            saved = readSnapshot('snap-saved');
+            done();
+        });
+    });
+
+    after(() => names.forEach(util.removeResource));
+
+    it('saves the metadata of a new resource', () => {
+        expect(saved.name).to.equal('snap-saved');
+        expect(saved.version).to.match(/^[0-9a-f]{16}$/);
+        expect(saved.info).to.deep.equal(info);
+
+        var h = saved.hierarchy;
+        expect(h.depthBegin).to.equal(info.baseDepth);
+        expect(h.depthEnd).to.be.above(h.depthBegin);
+        expect(h.tree.n).to.be.above(0);
+    });
+
+    it('brings up a resource from its snapshot', (done) => {
+        // A marker that can only have come from the snapshot.
+        var snapshot = JSON.parse(JSON.stringify(saved));
+        snapshot.name = 'snap-loaded';
+        snapshot.info.srs = 'from-snapshot';
+        writeSnapshot('snap-loaded', snapshot);
+
+        getInfo('snap-loaded').then((res) => {
+            res.should.have.status(200);
+            expect(res.body.srs).to.equal('from-snapshot');
+            done();
+        });
+    });
+
+    it('ignores a snapshot of another version', (done) => {
+        var snapshot = JSON.parse(JSON.stringify(saved));
+        snapshot.name = 'snap-stale';
+        snapshot.version = '0000000000000000';
+        snapshot.info.srs = 'from-snapshot';
+        writeSnapshot('snap-stale', snapshot);
+
+        getInfo('snap-stale').then((res) => {
+            res.should.have.status(200);
+            expect(res.body).to.deep.equal(info);
+
+            // The stale snapshot is replaced with the current version.
+            var replaced = readSnapshot('snap-stale');
+            expect(replaced.version).to.equal(saved.version);
+            expect(replaced.info).to.deep.equal(info);
+            done();
+        });
+    });
+
+    it('ignores a corrupt snapshot', (done) => {
+        writeSnapshot('snap-corrupt', '{ "name": "snap-corrupt", "ver');
+
+        getInfo('snap-corrupt').then((res) => {
+            res.should.have.status(200);
+            expect(res.body).to.deep.equal(info);
+            expect(readSnapshot('snap-corrupt').version)
+                .to.equal(saved.version);
+            done();
+        });
+    });
+
+    it('ignores a snapshot of the wrong shape', (done) => {
+        var snapshot = JSON.parse(JSON.stringify(saved));
+        snapshot.name = 'snap-malformed';
+        snapshot.hierarchy = 5;
+        writeSnapshot('snap-malformed', snapshot);
+
+        getInfo('snap-malformed').then((res) => {
+            res.should.have.status(200);
+            expect(res.body).to.deep.equal(info);
+            done();
+        });
+    });
+});
@@ -2,6 +2,10 @@ var common = require('./common');
 var server = common.server;
 var resource = common.resource;
 
+var fs = require('fs');
+var path = require('path');
+var WebSocket = require('ws');
+
 var chai = require('chai');
 var chaiHttp = require('chai-http');
 var should = chai.should();
@@ -63,8 +67,22 @@ var split = (b, randomize) => {
 };
 
 var request = require('sync-request');
-var httpSync = (path) =>
-    JSON.parse(request('GET', server + resource + path).getBody());
+var getSync = (path) => JSON.parse(request('GET', server + path).getBody());
+var httpSync = (path) => getSync(resource + path);
+
+var stats = () => getSync('/stats');
+
+// Resolves once "predicate" holds, polling for changes made in the background
+// by the server.
+var waitFor = (predicate) => new Promise((resolve, reject) => {
+    var start = Date.now();
+    var check = () => {
+        if (predicate()) resolve();
+        else if (Date.now() - start > 30000) reject(new Error('Timed out'));
+        else setTimeout(check, 100);
+    };
+    check();
+});
 
 var xyz = [
     { name: 'X', type: 'floating', size: 4 },
@@ -72,7 +90,7 @@ var xyz = [
     { name: 'Z', type: 'floating', size: 4 }
 ];
 
-var read = (query) => {
+var readFrom = (resource, query) => {
     if (!query) query = { };
     var path = resource + '/read' + Object.keys(query).reduce((p, c) => {
         return p + (p.length ? '&' : '?') + c + '=' + JSON.stringify(query[c]);
@@ -86,6 +104,299 @@ var read = (query) => {
     });
 };
 
+var read = (query) => readFrom(resource, query);
+
+var node = (key, headers) => {
+    return new Promise((resolve, reject) => {
+        var req = chai.request(server).get(resource + '/node/' + key);
+        Object.keys(headers || { }).forEach((k) => req.set(k, headers[k]));
+        req.buffer()
+        .parse(parseBinary)
+        .end((err, res) => resolve(res));
+    });
+};
+
+var readBatch = (query) => {
+    return new Promise((resolve, reject) => {
+        chai.request(server).post(resource + '/readBatch')
+        .send(query)
+        .buffer()
+        .parse(parseBinary)
+        .end((err, res) => resolve(res));
+    });
+};
+
+// Split a framed response into the concatenated payloads for each index,
+// with the parsed meta frame of each index, if any, as "meta".
+var parseFrames = (buffer) => {
+    var view = new DataView(buffer);
+    var payloads = [];
+    var meta = [];
+    var offset = 0;
+
+    while (offset < buffer.byteLength) {
+        var index = view.getUint32(offset, true);
+        var flags = view.getUint32(offset + 4, true);
+        var length = view.getUint32(offset + 8, true);
+        offset += 12;
+
+        var payload = new Uint8Array(buffer, offset, length);
+        offset += length;
+
+        if (flags & 2) {
+            meta[index] = JSON.parse(String.fromCharCode.apply(null, payload));
+            continue;
+        }
+
+        var prev = payloads[index] || { data: new Uint8Array(0) };
+        var data = new Uint8Array(prev.data.length + length);
+        data.set(prev.data);
+        data.set(payload, prev.data.length);
+
+        payloads[index] = { data: data, last: !!(flags & 1) };
+    }
+
+    var result = payloads.map((p) => {
+        expect(p.last).to.equal(true);
+        return p.data.buffer;
+    });
+    result.meta = meta;
+    return result;
+};
+
+var readView = (query) => {
+    return new Promise((resolve, reject) => {
+        chai.request(server).post(resource + '/readView')
+        .send(query)
+        .buffer()
+        .parse(parseBinary)
+        .end((err, res) => resolve(res));
+    });
+};
+
+// Parse a response in the framed read format into its header fields and the
+// concatenated points of its frames.
+var parseFramed = (buffer) => {
+    var view = new DataView(buffer);
+    expect(toString(buffer.slice(0, 4))).to.equal('GHFR');
+
+    var flags = view.getUint32(8, true);
+    var schemaLength = view.getUint32(12, true);
+    var schema = JSON.parse(toString(buffer.slice(16, 16 + schemaLength)));
+    var offset = 16 + schemaLength;
+
+    var chunks = [];
+    var numPoints = 0;
+
+    while (true) {
+        var points = view.getUint32(offset, true);
+        var length = view.getUint32(offset + 4, true);
+        offset += 8;
+        if (!points && !length) break;
+
+        chunks.push(new Uint8Array(buffer, offset, length));
+        numPoints += points;
+        offset += length;
+    }
+
+    var total = view.getUint32(offset, true) +
+        view.getUint32(offset + 4, true) * 4294967296;
+    expect(offset + 8).to.equal(buffer.byteLength);
+    expect(total).to.equal(numPoints);
+
+    return {
+        flags: flags,
+        schema: schema,
+        numPoints: numPoints,
+        chunks: chunks
+    };
+};
+
+// Reads the flatbuffer tables of Arrow message metadata.  A table is given
+// by its position in "view", and its fields by their index.
+var flatTable = (view, pos) => {
+    var vtable = pos - view.getInt32(pos, true);
+    var field = (i) => {
+        var o = 4 + 2 * i;
+        return o < view.getUint16(vtable, true) ?
+            view.getUint16(vtable + o, true) : 0;
+    };
+    var ref = (i) => {
+        var p = pos + field(i);
+        return p + view.getUint32(p, true);
+    };
+    var int64 = (p) => view.getUint32(p, true) +
+        view.getUint32(p + 4, true) * 4294967296;
+
+    return {
+        uint8: (i) => field(i) ? view.getUint8(pos + field(i)) : 0,
+        int64: (i) => field(i) ? int64(pos + field(i)) : 0,
+        table: (i) => flatTable(view, ref(i)),
+        string: (i) => {
+            var p = ref(i);
+            return toString(view.buffer.slice(
+                        view.byteOffset + p + 4,
+                        view.byteOffset + p + 4 + view.getUint32(p, true)));
+        },
+        tables: (i) => {
+            var p = ref(i);
+            var tables = [];
+            for (var j = 0; j < view.getUint32(p, true); ++j) {
+                var e = p + 4 + 4 * j;
+                tables.push(flatTable(view, e + view.getUint32(e, true)));
+            }
+            return tables;
+        },
+        // A vector of structs of two int64 values.
+        pairs: (i) => {
+            var p = ref(i);
+            var pairs = [];
+            for (var j = 0; j < view.getUint32(p, true); ++j) {
+                var e = p + 4 + 16 * j;
+                pairs.push([int64(e), int64(e + 8)]);
+            }
+            return pairs;
+        }
+    };
+};
+
+// Parse an Arrow IPC stream into the names of its schema's fields and its
+// record batches, each with its length, the lengths of its field nodes, and
+// the values of each column.
+var parseArrow = (buffer) => {
+    var view = new DataView(buffer);
+    var offset = 0;
+    var fields = null;
+    var batches = [];
+
+    while (true) {
+        expect(view.getUint32(offset, true)).to.equal(0xFFFFFFFF);
+        var length = view.getUint32(offset + 4, true);
+        offset += 8;
+        if (!length) break;
+
+        var meta = new DataView(buffer, offset, length);
+        var message = flatTable(meta, meta.getUint32(0, true));
+        var header = message.table(2);
+        var body = offset + length;
+        offset = body + message.int64(3);
+
+        if (message.uint8(1) == 1) {
+            fields = header.tables(1).map((f) => f.string(0));
+            continue;
+        }
+
+        expect(message.uint8(1)).to.equal(3);
+        var buffers = header.pairs(2);
+
+        batches.push({
+            length: header.int64(0),
+            nodes: header.pairs(1).map((n) => n[0]),
+            columns: buffers.filter((b, i) => i % 2).map((b) => {
+                return new Uint8Array(buffer, body + b[0], b[1]);
+            })
+        });
+    }
+
+    expect(offset).to.equal(buffer.byteLength);
+    return { fields: fields, batches: batches };
+};
+
+// Connects to the WebSocket interface.  Messages are passed to the handler
+// registered for their query id: JSON messages as objects, and binary frames
+// as { id, last, data }.
+var wsConnect = () => new Promise((resolve, reject) => {
+    var socket = new WebSocket(common.ws);
+    var handlers = { };
+
+    socket.on('message', (message) => {
+        var m = typeof message == 'string' ? JSON.parse(message) : {
+            id: message.readUInt32LE(0),
+            last: !!(message.readUInt32LE(4) & 1),
+            data: message.slice(12)
+        };
+
+        if (handlers[m.id]) handlers[m.id](m);
+    });
+
+    socket.on('error', reject);
+    socket.on('open', () => resolve({
+        send: (m) => socket.send(JSON.stringify(m)),
+        on: (id, handler) => handlers[id] = handler,
+        close: () => socket.close()
+    }));
+});
+
+// The 64-bit FNV-1a hash of a string as 16 hex digits, like toHex(fnv1a())
+// in the native code.  JS numbers can't hold 64-bit products, so the hash is
+// kept in 16-bit limbs, least significant first.
+var fnv1a = (s) => {
+    var bytes = Buffer.from(s, 'utf8');
+    var h = [0x2325, 0x8422, 0x9ce4, 0xcbf2];
+
+    for (var i = 0; i < bytes.length; ++i) {
+        h[0] ^= bytes[i];
+
+        // Multiply by the FNV prime, 2^40 + 0x1b3.
+        var r = [0, 0, 0, 0];
+        var carry = 0;
+        for (var j = 0; j < 4; ++j) {
+            var t = h[j] * 0x1b3 + carry;
+            r[j] = t & 0xffff;
+            carry = Math.floor(t / 0x10000);
+        }
+
+        r[2] += (h[0] << 8) & 0xffff;
+        r[3] += (((h[1] << 8) | (h[0] >>> 8)) & 0xffff) + (r[2] >>> 16);
+        r[2] &= 0xffff;
+        r[3] &= 0xffff;
+        h = r;
+    }
+
+    return h.reverse().map((v) => ('000' + v.toString(16)).slice(-4)).join('');
+};
+
+// The name under which the server stores files for a resource, like
+// safeName() in the native code.
+var safeName = (name) =>
+    name.replace(/[^A-Za-z0-9\-_.]/g, '_') + '-' + fnv1a(name);
+
+var removeDir = (dir) => {
+    if (!fs.existsSync(dir)) return;
+
+    fs.readdirSync(dir).forEach((f) => {
+        var p = path.join(dir, f);
+        if (fs.statSync(p).isDirectory()) removeDir(p);
+        else fs.unlinkSync(p);
+    });
+
+    fs.rmdirSync(dir);
+};
+
+var copyDir = (src, dst) => {
+    fs.mkdirSync(dst);
+
+    fs.readdirSync(src).forEach((f) => {
+        var s = path.join(src, f);
+        var d = path.join(dst, f);
+        if (fs.statSync(s).isDirectory()) copyDir(s, d);
+        else fs.writeFileSync(d, fs.readFileSync(s));
+    });
+};
+
+// Copies the test index to a new resource, which the server has not yet
+// seen, and returns its resource path.
+// Copies the index of "from", by default the main test index, to "name",
+// replacing anything already there.
+var copyResource = (name, from) => {
+    var dst = path.join(common.data, name);
+    removeDir(dst);
+    copyDir(path.join(common.data, from || 'ellipsoid'), dst);
+    return '/resource/' + name;
+};
+
+var removeResource = (name) => removeDir(path.join(common.data, name));
+
 var getOffset = (name, schema) => {
     var offset = 0;
     for (var i = 0; i < schema.length; ++i) {
@@ -95,6 +406,46 @@ var getOffset = (name, schema) => {
     throw new Error('No offset found for ' + name);
 };
 
+// Resolves to the laz-perf module.  Some of its builds are ready once
+// loaded, and others must be created by a factory.
+var lazPerf = () => {
+    var m = require('laz-perf');
+    if (m.DynamicLASZip) return Promise.resolve(m);
+    return Promise.resolve((m.createLazPerf || m)());
+};
+
+// Decompresses "numPoints" points of "schema" from a laz-perf stream, as a
+// compressed read is encoded, into a buffer of uncompressed points.
+var decompress = (buffer, schema, numPoints) => lazPerf().then((m) => {
+    var bytes = new Uint8Array(buffer);
+    var input = m._malloc(bytes.length);
+    m.HEAPU8.set(bytes, input);
+
+    var decoder = new m.DynamicLASZip();
+    decoder.open(input, bytes.length);
+
+    schema.forEach((d) => {
+        if (d.type == 'floating') decoder.addFieldFloating(d.size);
+        else if (d.type == 'signed') decoder.addFieldSigned(d.size);
+        else decoder.addFieldUnsigned(d.size);
+    });
+
+    var pointSize = pointSizeFrom(schema);
+    var point = m._malloc(pointSize);
+    var out = Buffer.alloc(numPoints * pointSize);
+
+    for (var i = 0; i < numPoints; ++i) {
+        decoder.getPoint(point);
+        Buffer.from(m.HEAPU8.buffer, point, pointSize)
+            .copy(out, i * pointSize);
+    }
+
+    m._free(point);
+    m._free(input);
+    if (decoder.delete) decoder.delete();
+    return out;
+});
+
 var getSize = (name, schema) => {
     var d = schema.find((v) => v.name == name);
     if (d) return d.size;
@@ -107,10 +458,27 @@ module.exports = {
     pointSizeFrom: pointSizeFrom,
     numPointsFrom: numPointsFrom,
     split: split,
+    getSync: getSync,
     httpSync: httpSync,
+    stats: stats,
+    waitFor: waitFor,
+    wsConnect: wsConnect,
     xyz: xyz,
     read: read,
+    readFrom: readFrom,
+    node: node,
+    readBatch: readBatch,
+    readView: readView,
+    parseFrames: parseFrames,
+    parseFramed: parseFramed,
+    parseArrow: parseArrow,
     getOffset: getOffset,
-    getSize: getSize
+    getSize: getSize,
+    decompress: decompress,
+    fnv1a: fnv1a,
+    safeName: safeName,
+    removeDir: removeDir,
+    copyResource: copyResource,
+    removeResource: removeResource
 };
 
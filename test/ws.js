@@ -0,0 +1,190 @@
+var common = require('./common');
+var util = require('./util');
+
+var chai = require('chai');
+var should = chai.should();
+var expect = chai.expect;
+
+var info = util.httpSync('/info');
+
+// The test config sets a window of 64 KiB, and the minimum of four threads
+// for the libuv pool.
+describe('ws', () => {
+    var window = 65536;
+    var schema = util.xyz;
+
+    var httpRead = (query) => util.read(query).then((res) => {
+        res.should.have.status(200);
+        return Buffer.from(res.body);
+    });
+
+    // Runs a read on "socket", acknowledging each frame as it arrives, and
+    // resolves to the concatenated data.
+    var wsRead = (socket, id, query) => new Promise((resolve, reject) => {
+        var chunks = [];
+
+        socket.on(id, (m) => {
+            if (m.error) return reject(new Error(m.error));
+            if (!m.data) return;
+
+            chunks.push(m.data);
+            if (m.last) resolve(Buffer.concat(chunks));
+            else socket.send({ id: id, ack: m.data.length });
+        });
+
+        socket.send({
+            id: id,
+            call: 'read',
+            resource: 'ellipsoid',
+            query: query
+        });
+    });
+
+    // Starts a read on "socket" without acknowledging anything.  Resolves,
+    // once the read has exceeded the window, to the state of the read.
+    var pausedRead = (socket, id) => new Promise((resolve) => {
+        var state = { bytes: 0, last: false, frames: 0 };
+
+        socket.on(id, (m) => {
+            if (!m.data) return;
+
+            state.bytes += m.data.length;
+            state.last = m.last;
+            ++state.frames;
+
+            if (state.bytes >= window || m.last) resolve(state);
+        });
+
+        socket.send({
+            id: id,
+            call: 'read',
+            resource: 'ellipsoid',
+            query: { schema: schema }
+        });
+    });
+
+    var wait = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+    it('multiplexes reads over one connection', () => {
+        var queries = [
+            { schema: schema },
+            { schema: schema, depth: info.baseDepth },
+            { schema: schema, depthBegin: info.baseDepth + 1 }
+        ];
+        var socket;
+
+        return util.wsConnect()
+        .then((s) => {
+            socket = s;
+            return Promise.all(queries.map((q, i) => wsRead(socket, i + 1, q))
+                .concat(queries.map(httpRead)));
+        })
+        .then((results) => {
+            queries.forEach((q, i) => {
+                var ws = results[i];
+                var http = results[i + queries.length];
+                expect(ws.equals(http)).to.equal(true);
+            });
+
+            socket.close();
+        });
+    });
+
+    it('pauses a read that exceeds the window until it is acknowledged', () => {
+        var socket, state;
+
+        return util.wsConnect()
+        .then((s) => {
+            socket = s;
+            return pausedRead(socket, 1);
+        })
+        .then((s) => {
+            state = s;
+            expect(state.last).to.equal(false);
+
+            // Nothing more arrives while the window is full.
+            var frames = state.frames;
+            return wait(500).then(() => {
+                expect(state.frames).to.equal(frames);
+            });
+        })
+        .then(() => new Promise((resolve) => {
+            // Acknowledge everything, from now on.
+            socket.on(1, (m) => {
+                if (!m.data) return;
+                state.bytes += m.data.length;
+                if (m.last) resolve();
+                else socket.send({ id: 1, ack: m.data.length });
+            });
+
+            socket.send({ id: 1, ack: state.bytes });
+        }))
+        .then(() => httpRead({ schema: schema }))
+        .then((body) => {
+            expect(state.bytes).to.equal(body.length);
+            socket.close();
+        });
+    });
+
+    it('cancels a paused read', () => {
+        var socket, frames;
+
+        return util.wsConnect()
+        .then((s) => {
+            socket = s;
+            return pausedRead(socket, 1);
+        })
+        .then((state) => {
+            frames = state.frames;
+
+            return new Promise((resolve) => {
+                socket.on(1, (m) => {
+                    if (m.cancelled) resolve();
+                    else if (m.data) ++frames;
+                });
+                socket.send({ id: 1, cancel: true });
+            });
+        })
+        .then(() => {
+            // Acknowledgements of a cancelled read are ignored.
+            var cancelled = frames;
+            socket.send({ id: 1, ack: window * 16 });
+
+            return wait(500).then(() => {
+                expect(frames).to.equal(cancelled);
+            });
+        })
+        .then(() => {
+            // The id may then be reused.
+            return wsRead(socket, 1, { schema: schema, depth: info.baseDepth });
+        })
+        .then((data) => {
+            expect(data.length).to.be.above(0);
+            socket.close();
+        });
+    });
+
+    it('holds no worker threads for paused reads', () => {
+        // More paused reads than there are threads in the libuv pool.
+        var ids = [1, 2, 3, 4, 5, 6, 7, 8];
+        var socket;
+
+        return util.wsConnect()
+        .then((s) => {
+            socket = s;
+            return Promise.all(ids.map((id) => pausedRead(socket, id)));
+        })
+        .then((states) => {
+            states.forEach((state) => expect(state.last).to.equal(false));
+
+            // Other queries still run while they are paused.
+            return httpRead({ schema: schema, depth: info.baseDepth });
+        })
+        .then((body) => {
+            expect(body.length).to.be.above(0);
+
+            ids.forEach((id) => socket.send({ id: id, cancel: true }));
+            socket.close();
+        });
+    });
+});